@@ -0,0 +1,300 @@
+#include "DetMath.h"
+#include "AiDriver.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace simd;
+
+namespace {
+    // Pure pursuit: aim at the line point lookaheadBase + lookaheadPerSpeed
+    // * speed metres ahead of the nearest one.
+    const float lookaheadBase = 3.0f;
+    const float lookaheadPerSpeed = 0.35f;
+    const float throttleGain = 0.6f;
+
+    // Following distance: slow down for any car inside a corridor ahead,
+    // aiming to stop followGap metres behind it (centre to centre).
+    const float followRange = 12.0f;
+    const float followHalfWidth = 2.2f;
+    const float followGap = 5.0f;
+    const float followSpeedPerMetre = 1.2f;
+
+    // Starting positions: single file on the racing line while the cars fit
+    // gridMinSpacing apart, otherwise rows of up to three across the lane.
+    const int gridMaxLanes = 3;
+    const float gridLaneSpacing = 2.4f;
+    const float gridMinSpacing = 6.0f;
+
+    // Recovery: cars further than recoveryMargin outside their lane, or slow
+    // and facing away from the direction of travel, drive at recoverySpeed
+    // towards the point recoveryLookahead metres along the route, which ends
+    // rejoinDistance metres ahead on the racing line
+    const float recoveryMargin = 1.0f;
+    const float recoveryAlignment = 0.8f;   // cos of the heading error that counts as facing away
+    const float recoverySpeed = 4.0f;
+    const float recoveryThrottle = 0.6f;    // gentle on grass and gravel, no power oversteer
+    const float recoveryWheelSlip = 3.0f;   // m/s of rear wheel slip before easing off
+    const float recoveryLookahead = 3.0f;
+    const float rejoinDistance = 8.0f;
+    const int recoveryRegions = 3;          // nav regions refined per query, enough for the lookahead
+
+    // A cached route is planned again when the rejoin point rejoinDistance
+    // ahead has moved more than rejoinSlack metres from the one it leads to,
+    // or the car is more than replanDistance from every route point
+    const float rejoinSlack = 4.0f;
+    const float replanDistance = 2.0f;
+}
+
+void driveAiCars(const RacingLine& line, const SimState& state, int first, int count,
+    CarInput* inputs, const CarParams& params) {
+    if (line.empty()) {
+        for (int i = 0; i < count; ++i) inputs[i] = CarInput{ 0.0f, 0.0f };
+        return;
+    }
+
+    const int points = line.size();
+    const F4 zero(0.0f), one(1.0f), minusOne(-1.0f);
+
+    for (int batch = 0; batch < count; batch += 4) {
+        int lanesUsed = std::min(4, count - batch);
+
+        // Gather the batch into SoA lanes; unused lanes repeat the first car
+        float px[4], pz[4], fwdX[4], fwdZ[4], leftX[4], leftZ[4], speeds[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            const CarState& car = state.cars[first + batch + (lane < lanesUsed ? lane : 0)];
+            glm::vec3 forward = car.orientation * glm::vec3(0.0f, 0.0f, 1.0f);
+            glm::vec3 left = car.orientation * glm::vec3(1.0f, 0.0f, 0.0f);
+            px[lane] = car.pos.x;
+            pz[lane] = car.pos.z;
+            fwdX[lane] = forward.x;
+            fwdZ[lane] = forward.z;
+            leftX[lane] = left.x;
+            leftZ[lane] = left.z;
+            speeds[lane] = car.speed;
+        }
+        F4 x = load(px), z = load(pz);
+
+        // Nearest line point around where each car was located last tick
+        int nearest[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            const CarState& car = state.cars[first + batch + (lane < lanesUsed ? lane : 0)];
+            nearest[lane] = nearestLinePoint(line, glm::vec2(px[lane], pz[lane]), car.trackSegment);
+        }
+
+        F4 speed = load(speeds);
+        int lookahead[4];
+        truncToInt((F4(lookaheadBase) + F4(lookaheadPerSpeed) * vabs(speed)) * F4(1.0f / line.spacing), lookahead);
+
+        float targetX[4], targetZ[4], targetSpeeds[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            int target = (nearest[lane] + lookahead[lane]) % points;
+            targetX[lane] = line.x[target];
+            targetZ[lane] = line.z[target];
+            // Speed half way to the aim point, so braking starts before the turn
+            targetSpeeds[lane] = line.speed[(nearest[lane] + lookahead[lane] / 2) % points];
+        }
+
+        // Nearest car ahead in each lane's corridor, all cars against the
+        // four lanes at once
+        F4 fx = load(fwdX), fz = load(fwdZ), lx = load(leftX), lz = load(leftZ);
+        F4 gap(followRange);
+        for (int j = 0; j < state.carCount; ++j) {
+            const glm::vec3& other = state.cars[j].pos;
+            F4 rx = F4(other.x) - x, rz = F4(other.z) - z;
+            F4 ahead = rx * fx + rz * fz;
+            F4 side = vabs(rx * lx + rz * lz);
+            // ahead > 0.1 also skips the car itself
+            F4 blocking = maskAnd(maskAnd(cmpGt(ahead, F4(0.1f)), cmpLt(ahead, gap)), cmpLt(side, F4(followHalfWidth)));
+            gap = select(blocking, ahead, gap);
+        }
+        F4 followSpeed = vmax(gap - F4(followGap), zero) * F4(followSpeedPerMetre);
+
+        // Aim point in car space; pure pursuit curvature 2 y / L^2 turned
+        // into a wheel angle with the small-angle bicycle model
+        F4 dx = load(targetX) - x, dz = load(targetZ) - z;
+        F4 lateral = dx * lx + dz * lz;
+        F4 longitudinal = dx * fx + dz * fz;
+        F4 distanceSq = lateral * lateral + longitudinal * longitudinal + F4(1e-4f);
+        F4 wheelAngle = F4(2.0f * wheelBase * 57.29578f) * lateral / distanceSq;
+        F4 steerLimit = F4(params.maxSteer) / (one + F4(params.steerSpeedFalloff) * vabs(speed));
+        F4 steer = vmax(vmin(wheelAngle / steerLimit, one), minusOne);
+
+        F4 targetSpeed = vmin(load(targetSpeeds), followSpeed);
+        F4 throttle = vmax(vmin((targetSpeed - speed) * F4(throttleGain), one), minusOne);
+        // Never reverse while following the line
+        throttle = select(cmpLt(speed, F4(0.5f)), vmax(throttle, zero), throttle);
+
+        float steers[4], throttles[4];
+        store(steers, steer);
+        store(throttles, throttle);
+        for (int lane = 0; lane < lanesUsed; ++lane) {
+            inputs[batch + lane] = CarInput{ throttles[lane], steers[lane] };
+        }
+    }
+}
+
+void recoverAiCars(const NavGrid& nav, const TrackIndex& track, const RacingLine& line,
+    SimState& state, int first, int count, CarInput* inputs,
+    std::vector<RecoveryRoute>& routes, NavSearch& search, const CarParams& params) {
+    routes.resize(state.carCount);
+    if (nav.empty() || track.empty() || line.empty()) return;
+
+    const int points = line.size();
+    const int slackPoints = std::max(1, (int)(rejoinSlack / line.spacing));
+    // The route the car's state names, planned again when the cache has another
+    auto routeOf = [&](const CarState& car, RecoveryRoute& route) {
+        if (route.rejoin != car.recoveryRejoin || route.from != car.recoveryFrom) {
+            route.rejoin = car.recoveryRejoin;
+            route.from = car.recoveryFrom;
+            glm::vec2 goal(line.x[route.rejoin], line.z[route.rejoin]);
+            route.found = nav.findPath(route.from, goal, route.points, search, recoveryRegions) && !route.points.empty();
+        }
+        return route.found;
+    };
+
+    for (int k = 0; k < count; ++k) {
+        const int index = first + k;
+        const CarState& car = state.cars[index];
+        RecoveryRoute& route = routes[index];
+        // Off the lane, or slow and pointing well away from the direction of
+        // travel (spun, or nose against a wall)
+        bool recovering = false;
+        glm::vec3 forward = car.orientation * glm::vec3(0.0f, 0.0f, 1.0f);
+        if (car.trackSegment >= 0) {
+            int segment = car.trackSegment;
+            float alignment = forward.x * -line.normalZ[segment] + forward.z * line.normalX[segment];
+            bool offLane = std::abs(car.trackOffset) > track.halfWidth() + recoveryMargin;
+            bool facingAway = alignment < recoveryAlignment && car.speed < recoverySpeed;
+            recovering = offLane || facingAway;
+        }
+        if (!recovering) {
+            if (car.recoveryRejoin >= 0) simCarForWrite(state, index).recoveryRejoin = -1;
+            continue;
+        }
+
+        int rejoin = (car.trackSegment + (int)(rejoinDistance / line.spacing)) % points;
+        glm::vec2 pos(car.pos.x, car.pos.z);
+
+        // Route point nearest the car, and the first one past the lookahead
+        // distance from it
+        size_t nearest = 0, aim = 0;
+        bool replan = car.recoveryRejoin < 0;
+        if (!replan) {
+            int moved = std::abs(rejoin - car.recoveryRejoin);
+            replan = std::min(moved, points - moved) > slackPoints;
+        }
+        bool found = false;
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (replan) {
+                CarState& planned = simCarForWrite(state, index);
+                planned.recoveryRejoin = rejoin;
+                planned.recoveryFrom = pos;
+            }
+            found = routeOf(car, route);
+            if (!found) {
+                // Tried again next tick
+                simCarForWrite(state, index).recoveryRejoin = -1;
+                break;
+            }
+            const std::vector<glm::vec2>& path = route.points;
+            float best = 3.0e38f;
+            for (size_t j = 0; j < path.size(); ++j) {
+                glm::vec2 d = path[j] - pos;
+                float distanceSq = glm::dot(d, d);
+                if (distanceSq < best) {
+                    best = distanceSq;
+                    nearest = j;
+                }
+            }
+            aim = path.size() - 1;
+            for (size_t j = nearest; j < path.size(); ++j) {
+                glm::vec2 d = path[j] - pos;
+                if (glm::dot(d, d) >= recoveryLookahead * recoveryLookahead) {
+                    aim = j;
+                    break;
+                }
+            }
+            // A partial route (recoveryRegions) running out before its goal
+            glm::vec2 toGoal = glm::vec2(line.x[route.rejoin], line.z[route.rejoin]) - path.back();
+            bool runningOut = aim == path.size() - 1 && glm::dot(toGoal, toGoal) > recoveryLookahead * recoveryLookahead;
+            if (replan || (best <= replanDistance * replanDistance && !runningOut)) break;
+            replan = true;
+        }
+        if (!found) continue;
+        glm::vec2 aimPoint = route.points[aim];
+
+        glm::vec3 left = car.orientation * glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec2 d = aimPoint - pos;
+        float lateral = d.x * left.x + d.y * left.z;
+        float longitudinal = d.x * forward.x + d.y * forward.z;
+        // Aim point more than 45 degrees off the nose of a slow car (usually
+        // one with its nose against a wall): back up on opposite lock, which
+        // swings the nose towards it
+        if (longitudinal < std::abs(lateral) && car.speed < 1.5f) {
+            inputs[k] = CarInput{ -recoveryThrottle, lateral >= 0.0f ? -1.0f : 1.0f };
+            continue;
+        }
+
+        // Pure pursuit, or full lock towards an aim point behind the car
+        float wheelAngle = longitudinal > 0.0f
+            ? 2.0f * wheelBase * 57.29578f * lateral / (lateral * lateral + longitudinal * longitudinal + 1e-4f)
+            : (lateral >= 0.0f ? params.maxSteer : -params.maxSteer);
+        float steerLimit = params.maxSteer / (1.0f + params.steerSpeedFalloff * std::abs(car.speed));
+        float steer = std::max(-1.0f, std::min(wheelAngle / steerLimit, 1.0f));
+        float throttle = std::max(-1.0f, std::min((recoverySpeed - car.speed) * throttleGain, recoveryThrottle));
+        if (car.speed < 0.5f) throttle = std::max(throttle, 0.0f);
+        // Traction control: ease off while the driven wheels spin up
+        float wheelSpeed = 0.5f * (car.wheelSpin[frontWheelCount] + car.wheelSpin[frontWheelCount + 1]) * params.wheelRadius;
+        if (wheelSpeed - car.speed > recoveryWheelSlip) throttle *= 0.5f;
+        inputs[k] = CarInput{ throttle, steer };
+    }
+}
+
+void spawnAiGrid(SimState& state, const RacingLine& line, int count) {
+    if (line.empty()) return;
+    count = std::min(count, maxCars - state.carCount);
+    if (count <= 0) return;
+
+    // Cumulative distance along the optimised line
+    const int points = line.size();
+    std::vector<float> distance(points + 1, 0.0f);
+    for (int j = 0; j < points; ++j) {
+        int next = (j + 1) % points;
+        float dx = line.x[next] - line.x[j], dz = line.z[next] - line.z[j];
+        distance[j + 1] = distance[j] + detSqrt(dx * dx + dz * dz);
+    }
+    float lap = distance[points];
+
+    int lanes = 1;
+    while (lanes < gridMaxLanes && lap / ((count + lanes - 1) / lanes) < gridMinSpacing) ++lanes;
+    int rows = (count + lanes - 1) / lanes;
+
+    // Rows spread evenly round the lap, counting back from the start point
+    int point = points;
+    for (int i = 0; i < count; ++i) {
+        int row = i / lanes, lane = i % lanes;
+        float along = lap - (row + 1) * lap / rows + lap;
+        while (point > 0 && distance[point] > along - lap) --point;
+        int index = point % points, next = (index + 1) % points;
+
+        glm::vec3 pos(line.x[index], 0.5f, line.z[index]);
+        if (lanes > 1) {
+            // Across the lane around the centreline, so outer rows stay on the asphalt
+            float offset = (lane - (lanes - 1) * 0.5f) * gridLaneSpacing;
+            pos = glm::vec3(line.centerX[index] + line.normalX[index] * offset, 0.5f,
+                line.centerZ[index] + line.normalZ[index] * offset);
+        }
+        float heading = glm::degrees(detAtan2(line.x[next] - line.x[index], line.z[next] - line.z[index]));
+
+        int slot = state.carCount++;
+        simCarForWrite(state, slot) = makeCar(pos, heading);
+        ++state.aiCarCount;
+    }
+}
+
+void removeAiCars(SimState& state) {
+    state.carCount -= state.aiCarCount;
+    state.aiCarCount = 0;
+}
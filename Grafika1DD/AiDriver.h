@@ -0,0 +1,47 @@
+#pragma once
+#include "CarPhysics.h"
+#include "NavGrid.h"
+#include "RacingLine.h"
+#include "SimState.h"
+#include "TrackProgress.h"
+
+// Computes inputs for the cars [first, first + count) from the racing line.
+// Cars are gathered four at a time into SoA lanes; each lane finds its
+// nearest line point, steers towards a point further along the line (pure
+// pursuit, lookahead growing with speed) and drives towards the target
+// speed there, backing off behind any car close ahead. Stateless, so
+// replays and snapshots need nothing extra.
+void driveAiCars(const RacingLine& line, const SimState& state, int first, int count,
+    CarInput* inputs, const CarParams& params = CarParams());
+
+// Nav grid route of a recovering car, remembered so it is not planned
+// again every tick. Only a copy: the car's recoveryRejoin and recoveryFrom
+// say which route it follows, and a missing or different copy is planned
+// again from them, so restoring a snapshot gives the same route.
+struct RecoveryRoute {
+    int rejoin = -1;                    // racing line point it leads to, -1 = none
+    glm::vec2 from = glm::vec2(0.0f);
+    bool found = false;
+    std::vector<glm::vec2> points;
+};
+
+// Overrides the inputs of AI cars among [first, first + count) that have
+// left their lane or ended up facing the wrong way: each drives slowly
+// along a nav grid route to a point on the racing line a little ahead,
+// backing up first when the route starts behind it, then driveAiCars takes
+// over again. A car keeps its route until its rejoin point has moved on,
+// it strays from the route or nears the end of a partial one; the choice
+// is stored in the car, so it depends on the SimState alone. routes holds
+// one cached route per car index and is resized to state.carCount; search
+// is scratch space.
+void recoverAiCars(const NavGrid& nav, const TrackIndex& track, const RacingLine& line,
+    SimState& state, int first, int count, CarInput* inputs,
+    std::vector<RecoveryRoute>& routes, NavSearch& search, const CarParams& params = CarParams());
+
+// Appends count AI cars spread evenly round the racing line, single file
+// while they fit and up to three abreast when they do not, and marks them
+// as AI driven (state.aiCarCount).
+void spawnAiGrid(SimState& state, const RacingLine& line, int count);
+
+// Removes all AI cars, leaving only the cars driven by inputs.
+void removeAiCars(SimState& state);
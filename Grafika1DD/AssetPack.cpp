@@ -0,0 +1,285 @@
+#include "AssetPack.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const char packMagic[4] = { 'R', 'C', 'P', 'K' };
+    const uint32_t packVersion = 1;
+    // Blobs start on a cache line, enough for any loader reading them in place
+    const uint32_t blobAlignment = 64;
+    const size_t headerBytes = 32;
+    const size_t entryBytes = 32;
+
+    uint32_t loadU32(const unsigned char* bytes) {
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    }
+
+    uint64_t loadU64(const unsigned char* bytes) {
+        return loadU32(bytes) | ((uint64_t)loadU32(bytes + 4) << 32);
+    }
+
+    void storeU32(std::vector<unsigned char>& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out.push_back((unsigned char)(value >> (i * 8)));
+    }
+
+    void storeU64(std::vector<unsigned char>& out, uint64_t value) {
+        storeU32(out, (uint32_t)value);
+        storeU32(out, (uint32_t)(value >> 32));
+    }
+
+    std::string normalizeName(const std::string& name) {
+        std::string normalized = name;
+        std::replace(normalized.begin(), normalized.end(), '\\', '/');
+        return normalized;
+    }
+
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Index entry fields
+    uint64_t entryHash(const unsigned char* e) { return loadU64(e); }
+    uint64_t entryOffset(const unsigned char* e) { return loadU64(e + 8); }
+    uint64_t entrySize(const unsigned char* e) { return loadU64(e + 16); }
+    uint32_t entryNameOffset(const unsigned char* e) { return loadU32(e + 24); }
+    uint32_t entryNameLength(const unsigned char* e) { return loadU32(e + 28); }
+}
+
+AssetPack::~AssetPack() {
+    close();
+}
+
+bool AssetPack::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)headerBytes) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    base = (const unsigned char*)view;
+    fileSize = (size_t)size.QuadPart;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size < (off_t)headerBytes) {
+        ::close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    // The mapping keeps the file alive on its own
+    ::close(file);
+    if (view == MAP_FAILED) return false;
+    base = (const unsigned char*)view;
+    fileSize = (size_t)info.st_size;
+#endif
+
+    // Validate everything here so find() can trust the index
+    if (std::memcmp(base, packMagic, 4) != 0 || loadU32(base + 4) != packVersion) {
+        close();
+        return false;
+    }
+    uint64_t count = loadU32(base + 8);
+    uint64_t indexOffset = loadU64(base + 16), namesOffset = loadU64(base + 24);
+    if (indexOffset > fileSize || count > (fileSize - indexOffset) / entryBytes || namesOffset > fileSize) {
+        close();
+        return false;
+    }
+    entryCount = (size_t)count;
+    index = base + indexOffset;
+    names = base + namesOffset;
+    for (size_t i = 0; i < entryCount; ++i) {
+        const unsigned char* e = entry(i);
+        bool inside = entryOffset(e) <= fileSize && entrySize(e) <= fileSize - entryOffset(e)
+            && entryNameOffset(e) <= fileSize - namesOffset
+            && entryNameLength(e) <= fileSize - namesOffset - entryNameOffset(e);
+        bool sorted = i == 0 || entryHash(entry(i - 1)) <= entryHash(e);
+        if (!inside || !sorted) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void AssetPack::close() {
+    if (base) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle((HANDLE)mappingHandle);
+        CloseHandle((HANDLE)fileHandle);
+#else
+        munmap((void*)base, fileSize);
+#endif
+    }
+    base = nullptr;
+    fileSize = 0;
+    entryCount = 0;
+    index = nullptr;
+    names = nullptr;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+
+AssetView AssetPack::find(const std::string& name) const {
+    AssetView view;
+    if (!base) return view;
+    std::string normalized = normalizeName(name);
+    uint64_t hash = assetNameHash(normalized);
+
+    // First entry with the hash, then every entry sharing it
+    size_t low = 0, high = entryCount;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (entryHash(entry(mid)) < hash) low = mid + 1;
+        else high = mid;
+    }
+    for (size_t i = low; i < entryCount && entryHash(entry(i)) == hash; ++i) {
+        const unsigned char* e = entry(i);
+        if (entryNameLength(e) == normalized.size()
+            && std::memcmp(names + entryNameOffset(e), normalized.data(), normalized.size()) == 0) {
+            view.data = base + entryOffset(e);
+            view.size = (size_t)entrySize(e);
+            return view;
+        }
+    }
+    return view;
+}
+
+const unsigned char* AssetPack::entry(size_t i) const {
+    return index + i * entryBytes;
+}
+
+uint64_t assetNameHash(const std::string& name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash ^= (unsigned char)(c == '\\' ? '/' : c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool writeAssetPack(const std::vector<std::string>& files, const std::string& destination,
+    AssetPackStats& stats, std::string& error) {
+    struct Item {
+        std::string name;
+        std::string source;
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t nameOffset;
+    };
+    std::vector<Item> items;
+    for (const std::string& file : files) {
+        Item item = { normalizeName(file), file, assetNameHash(file), 0, 0, 0 };
+        items.push_back(item);
+    }
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+    });
+    for (size_t i = 1; i < items.size(); ++i) {
+        if (items[i].name == items[i - 1].name) {
+            error = "duplicate asset: " + items[i].name;
+            return false;
+        }
+    }
+
+    // Missing files fail here, when the pack is built, not at run time
+    std::string nameTable;
+    uint64_t dataBytes = 0;
+    for (Item& item : items) {
+        std::ifstream in(item.source.c_str(), std::ios::binary | std::ios::ate);
+        if (!in) {
+            error = "missing asset: " + item.source;
+            return false;
+        }
+        item.size = (uint64_t)in.tellg();
+        item.nameOffset = (uint32_t)nameTable.size();
+        nameTable += item.name;
+        dataBytes += item.size;
+    }
+
+    size_t indexOffset = headerBytes;
+    size_t namesOffset = indexOffset + items.size() * entryBytes;
+    size_t at = alignUp(namesOffset + nameTable.size(), blobAlignment);
+    for (Item& item : items) {
+        item.offset = at;
+        at = alignUp(at + (size_t)item.size, blobAlignment);
+    }
+
+    std::vector<unsigned char> head;
+    head.insert(head.end(), packMagic, packMagic + 4);
+    storeU32(head, packVersion);
+    storeU32(head, (uint32_t)items.size());
+    storeU32(head, blobAlignment);
+    storeU64(head, indexOffset);
+    storeU64(head, namesOffset);
+    for (const Item& item : items) {
+        storeU64(head, item.hash);
+        storeU64(head, item.offset);
+        storeU64(head, item.size);
+        storeU32(head, item.nameOffset);
+        storeU32(head, (uint32_t)item.name.size());
+    }
+    head.insert(head.end(), nameTable.begin(), nameTable.end());
+
+    std::ofstream out(destination.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "cannot write " + destination;
+        return false;
+    }
+    out.write((const char*)head.data(), head.size());
+    size_t written = head.size();
+    std::vector<char> padding(blobAlignment, 0);
+    for (const Item& item : items) {
+        out.write(padding.data(), item.offset - written);
+        std::ifstream in(item.source.c_str(), std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (bytes.size() != item.size) {
+            out.close();
+            std::remove(destination.c_str());
+            error = "changed while packing: " + item.source;
+            return false;
+        }
+        out.write(bytes.data(), bytes.size());
+        written = (size_t)item.offset + bytes.size();
+    }
+    if (!out) {
+        out.close();
+        std::remove(destination.c_str());
+        error = "write failed: " + destination;
+        return false;
+    }
+
+    stats.entries = items.size();
+    stats.dataBytes = (size_t)dataBytes;
+    stats.packBytes = written;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Single-file asset archive. The runtime maps the whole file read-only and
+// hands out views straight into the mapping, so loading an asset is a
+// lookup with no open, read or copy. Little-endian layout:
+//
+//   header   magic "RCPK", version, entry count, blob alignment,
+//            index offset, names offset
+//   index    per entry: name hash, blob offset, blob size, name offset,
+//            name length; sorted by hash, then name
+//   names    the entry names, not terminated
+//   blobs    the files' bytes, each starting on the alignment
+//
+// Names are paths relative to the working directory with forward slashes
+// ("textures/grass.jpg"), the same strings the loaders are given.
+
+// Bytes of one asset inside a mapped pack; valid while the pack is open.
+struct AssetView {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    explicit operator bool() const { return data != nullptr; }
+};
+
+class AssetPack {
+public:
+    AssetPack() = default;
+    ~AssetPack();
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // Maps path and validates every index entry; false if it is missing or
+    // not a valid pack.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    // View of the named asset, empty if the pack does not hold it. Safe to
+    // call from any thread while the pack is open.
+    AssetView find(const std::string& name) const;
+    size_t count() const { return entryCount; }
+
+private:
+    const unsigned char* entry(size_t index) const;
+
+    const unsigned char* base = nullptr;
+    size_t fileSize = 0;
+    size_t entryCount = 0;
+    const unsigned char* index = nullptr;
+    const unsigned char* names = nullptr;
+    void* fileHandle = nullptr;         // Windows only: file and mapping handles
+    void* mappingHandle = nullptr;
+};
+
+struct AssetPackStats {
+    size_t entries;
+    size_t dataBytes;       // the files' bytes
+    size_t packBytes;       // with header, index and padding
+};
+
+// Hash the index is sorted by: FNV-1a of the name with '\' taken as '/'.
+uint64_t assetNameHash(const std::string& name);
+
+// Writes the files to a pack at destination. Every file must exist and
+// every name must be unique; anything else is an error and no pack is left.
+bool writeAssetPack(const std::vector<std::string>& files, const std::string& destination,
+    AssetPackStats& stats, std::string& error);
@@ -0,0 +1,159 @@
+#include "DetMath.h"
+#include "BatchEnv.h"
+#include "CarPhysics.h"
+#include "JobSystem.h"
+#include "Raycast.h"
+#include "Scene.h"
+#include "TrackLayout.h"
+#include "WorldGeometry.h"
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <vector>
+
+// Every world uses the default track (trackRotation = 0): a straight along +Z.
+
+namespace {
+    const float sensorAngles[BATCH_ENV_SENSOR_COUNT] = { -60.0f, -30.0f, 0.0f, 30.0f, 60.0f };
+    const float sensorRange = 30.0f;
+    const float offTrackPenalty = -1.0f;
+
+    struct World {
+        CarState car;
+        unsigned int rng;
+    };
+
+    // xorshift32, one stream per world so worlds can reset in parallel
+    float nextRandom(unsigned int& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    void resetWorld(World& world) {
+        float x = (nextRandom(world.rng) * 2.0f - 1.0f) * 3.0f;
+        float z = -trackHalfLength + 2.0f + nextRandom(world.rng) * 8.0f;
+        float heading = (nextRandom(world.rng) * 2.0f - 1.0f) * 10.0f;
+        world.car = makeCar(glm::vec3(x, 0.5f, z), heading);
+    }
+
+    void writeObservation(const RayBvh& bvh, const World& world, float* obs) {
+        const CarState& car = world.car;
+        float heading = glm::radians(car.rotation);
+        obs[0] = car.pos.x;
+        obs[1] = car.pos.z;
+        detSinCos(heading, obs[2], obs[3]);
+        obs[4] = car.speed;
+
+        Ray rays[BATCH_ENV_SENSOR_COUNT];
+        RayHit hits[BATCH_ENV_SENSOR_COUNT];
+        for (int i = 0; i < BATCH_ENV_SENSOR_COUNT; ++i) {
+            float dirX, dirZ;
+            detSinCos(heading + glm::radians(sensorAngles[i]), dirX, dirZ);
+            rays[i].origin = car.pos;
+            rays[i].dir = glm::vec3(dirX, 0.0f, dirZ);
+            rays[i].maxDistance = sensorRange;
+        }
+        bvh.raycast(rays, BATCH_ENV_SENSOR_COUNT, hits);
+        for (int i = 0; i < BATCH_ENV_SENSOR_COUNT; ++i) {
+            obs[5 + i] = hits[i].distance;
+        }
+    }
+}
+
+struct BatchEnv {
+    std::vector<World> worlds;
+    CarParams params;
+    RayBvh bvh;   // default layout, shared read-only by every world
+};
+
+extern "C" {
+
+BatchEnv* batchEnvCreate(int worldCount, unsigned int seed) {
+    if (worldCount <= 0) return nullptr;
+
+    BatchEnv* env = new (std::nothrow) BatchEnv();
+    if (!env) return nullptr;
+
+    EnvironmentState layout = {};
+    layout.trackRotation = 0.0f;
+    layout.treeSize = 1.0f;
+    std::vector<StaticBox> boxes;
+    std::vector<WorldTriangle> triangles;
+    buildStaticColliders(defaultScene(), layout, boxes);
+    buildWorldTriangles(layout, boxes, nullptr, triangles);
+    env->bvh.build(triangles);
+
+    env->worlds.resize(worldCount);
+    for (int i = 0; i < worldCount; ++i) {
+        // Spread seeds so neighbouring worlds don't start correlated; never 0.
+        env->worlds[i].rng = (seed ^ (0x9E3779B9u * (unsigned int)(i + 1))) | 1u;
+        resetWorld(env->worlds[i]);
+    }
+    return env;
+}
+
+void batchEnvDestroy(BatchEnv* env) {
+    delete env;
+}
+
+int batchEnvWorldCount(const BatchEnv* env) {
+    return env ? (int)env->worlds.size() : 0;
+}
+
+void batchEnvReset(BatchEnv* env, float* observations) {
+    if (!env) return;
+    World* worlds = env->worlds.data();
+    jobSystem().parallelFor((int)env->worlds.size(), 256, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            resetWorld(worlds[i]);
+            if (observations) writeObservation(env->bvh, worlds[i], observations + i * BATCH_ENV_OBS_SIZE);
+        }
+    });
+}
+
+void batchEnvStep(BatchEnv* env, const float* actions, float deltaTime,
+    float* observations, float* rewards, unsigned char* dones) {
+    if (!env || !actions) return;
+
+    World* worlds = env->worlds.data();
+    const CarParams& params = env->params;
+    jobSystem().parallelFor((int)env->worlds.size(), 256, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            World& world = worlds[i];
+            CarInput input;
+            input.throttle = actions[i * BATCH_ENV_ACTION_SIZE + 0];
+            input.steer = actions[i * BATCH_ENV_ACTION_SIZE + 1];
+
+            float startZ = world.car.pos.z;
+            stepCar(world.car, input, deltaTime, params);
+
+            // Reward progress down the straight; leaving the asphalt ends the episode.
+            // Only the far end finishes: backing off the start end is off track.
+            float reward = world.car.pos.z - startZ;
+            bool offTrack = std::abs(world.car.pos.x) > trackHalfWidth || world.car.pos.z < -trackHalfLength;
+            bool finished = world.car.pos.z > trackHalfLength;
+            if (offTrack) reward += offTrackPenalty;
+
+            bool done = offTrack || finished;
+            if (done) resetWorld(world);
+
+            if (rewards) rewards[i] = reward;
+            if (dones) dones[i] = done ? 1 : 0;
+            if (observations) writeObservation(env->bvh, world, observations + i * BATCH_ENV_OBS_SIZE);
+        }
+    });
+}
+
+unsigned long long batchEnvStateHash(const BatchEnv* env) {
+    uint64_t hash = hashSeed;
+    if (!env) return hash;
+    for (const World& world : env->worlds) {
+        hash = hashCarState(world.car, hash);
+        hash = hashBytes(&world.rng, sizeof(world.rng), hash);
+    }
+    return hash;
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Batch environment: steps many independent single-car worlds at once for
+// controller training and tuning. Plain C ABI so external tools (Python
+// ctypes, other languages) can call it directly; the BatchEnv project
+// builds it as BatchEnv.dll with the simulation sources it needs.
+//
+// All buffers are owned by the caller and laid out world after world:
+//   actions      worldCount * BATCH_ENV_ACTION_SIZE  (throttle, steer in [-1, 1])
+//   observations worldCount * BATCH_ENV_OBS_SIZE
+//   rewards      worldCount
+//   dones        worldCount (1 when the episode ended this step; that world
+//                has already been reset and its observation is the new start)
+//
+// Observation of one world:
+//   [0] x  [1] z  [2] sin(heading)  [3] cos(heading)  [4] speed
+//   [5..] distance to the nearest obstacle along each sensor ray
+//         (BATCH_ENV_SENSOR_COUNT rays fanned around the heading)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(BATCH_ENV_EXPORTS)
+#define BATCH_ENV_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define BATCH_ENV_API __declspec(dllimport)
+#else
+#define BATCH_ENV_API __attribute__((visibility("default")))
+#endif
+
+#define BATCH_ENV_ACTION_SIZE 2
+#define BATCH_ENV_SENSOR_COUNT 5
+#define BATCH_ENV_OBS_SIZE (5 + BATCH_ENV_SENSOR_COUNT)
+
+typedef struct BatchEnv BatchEnv;
+
+BATCH_ENV_API BatchEnv* batchEnvCreate(int worldCount, unsigned int seed);
+BATCH_ENV_API void batchEnvDestroy(BatchEnv* env);
+BATCH_ENV_API int batchEnvWorldCount(const BatchEnv* env);
+
+// Resets every world and writes the initial observations.
+BATCH_ENV_API void batchEnvReset(BatchEnv* env, float* observations);
+
+// Advances every world by deltaTime seconds across the job system.
+BATCH_ENV_API void batchEnvStep(BatchEnv* env, const float* actions, float deltaTime,
+    float* observations, float* rewards, unsigned char* dones);
+
+// Hash of the exact state of every world. Identical inputs from an identical
+// seed give an identical hash on every machine and compiler.
+BATCH_ENV_API unsigned long long batchEnvStateHash(const BatchEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,278 @@
+#include "DetMath.h"
+#include "CarPhysics.h"
+#include "TireModel.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace simd;
+
+namespace {
+    // Slip is measured against at least this speed so it stays bounded when
+    // the car is nearly stopped.
+    const float minSlipSpeed = 3.0f;
+
+    // Adaptive step limits: h * stiffness stays below stepStability, the
+    // car moves at most maxTravelPerStep metres and turns at most
+    // maxTurnPerStep radians per step.
+    const float stepStability = 1.0f;
+    const float maxTravelPerStep = 0.25f;
+    const float maxTurnPerStep = 0.1f;
+
+    // Returns rotational speed moved toward zero by `amount`, stopping at zero.
+    float applyResistance(float spin, float amount) {
+        if (spin > amount) return spin - amount;
+        if (spin < -amount) return spin + amount;
+        return 0.0f;
+    }
+
+    glm::quat yawQuat(float rotation) {
+        float s, c;
+        detSinCos(glm::radians(rotation) * 0.5f, s, c);
+        return glm::quat(c, 0.0f, s, 0.0f);
+    }
+
+    float suspensionForce(float compression, float compressionRate, const CarParams& p) {
+        float force = p.springRate * compression + p.damperRate * compressionRate;
+        float overTravel = compression - p.suspensionLength;
+        if (overTravel > 0.0f) force += p.bumpStopRate * overTravel;
+        return std::max(0.0f, force);
+    }
+
+    // Picks the number of substeps for this tick from the stiffest thing the
+    // integrator will see: a suspension corner, a tyre at its current load,
+    // the distance travelled and the rotation rate.
+    int chooseSubsteps(const CarState& car, float deltaTime, const CarParams& p, float tyreStiffness) {
+        const float quarterMass = p.mass * 0.25f;
+
+        float maxCompression = 0.0f;
+        for (float compression : car.compression) maxCompression = std::max(maxCompression, compression);
+        float spring = p.springRate + (maxCompression > p.suspensionLength * 0.8f ? p.bumpStopRate : 0.0f);
+        float suspensionRate = detSqrt(spring / quarterMass) + p.damperRate / quarterMass;
+
+        float maxLoad = suspensionForce(maxCompression, 0.0f, p);
+        float tyreRate = tyreStiffness * p.grip * maxLoad / (quarterMass * std::max(std::abs(car.speed), minSlipSpeed));
+
+        float h = std::min(maxCarSubstep, stepStability / std::max(suspensionRate, tyreRate));
+        float speed = glm::length(car.velocity);
+        if (speed * h > maxTravelPerStep) h = maxTravelPerStep / speed;
+        float turnRate = glm::length(car.angularVelocity);
+        if (turnRate * h > maxTurnPerStep) h = maxTurnPerStep / turnRate;
+
+        int substeps = (int)std::ceil(deltaTime / h - 1e-4f);
+        return std::max(1, std::min(substeps, maxCarSubsteps));
+    }
+
+    void integrate(CarState& car, float throttle, float steer, float dt, const CarParams& p,
+        const WheelGround* ground, const TireTable& longTable, const TireTable& latTable) {
+        // Steering slews toward the target; the lock shrinks with speed.
+        float targetSteer = steer * p.maxSteer / (1.0f + p.steerSpeedFalloff * std::abs(car.speed));
+        float maxSteerDelta = p.steerRate * dt;
+        car.steerAngle += clampf(targetSteer - car.steerAngle, -maxSteerDelta, maxSteerDelta);
+
+        glm::mat3 basis = glm::mat3_cast(car.orientation);
+        glm::vec3 left = basis[0], up = basis[1], forward = basis[2];
+        float vForward = glm::dot(car.velocity, forward);
+
+        // Driver torques; drive fades out over the last fifth of the top speed
+        float drive = 0.0f, brake = 0.0f, engineBrake = 0.0f;
+        if (throttle > 0.0f) {
+            if (vForward > -1.0f) drive = throttle * p.driveTorque * clampf((p.maxSpeed - vForward) / (p.maxSpeed * 0.2f), 0.0f, 1.0f);
+            else brake = throttle * p.brakeTorque;
+        }
+        else if (throttle < 0.0f) {
+            float reverseSpeed = p.maxSpeed * 0.5f;
+            if (vForward > 1.0f) brake = -throttle * p.brakeTorque;
+            else drive = throttle * p.driveTorque * 0.5f * clampf((reverseSpeed + vForward) / (reverseSpeed * 0.2f), 0.0f, 1.0f);
+        }
+        else {
+            engineBrake = p.engineBrakeTorque;
+        }
+
+        float sinSteer, cosSteer;
+        detSinCos(glm::radians(car.steerAngle), sinSteer, cosSteer);
+
+        // Suspension: cast each mount down the car's up axis to the ground plane
+        glm::vec3 contact[4], tyreForward[4], tyreLeft[4];
+        float wheelLoad[4], vxs[4], vys[4], torque[4], resist[4], surfaceGrip[4];
+        float rolling = 0.0f;
+        for (int i = 0; i < 4; ++i) {
+            bool front = i < frontWheelCount;
+            glm::vec3 arm = basis * wheelPositions[i];
+            glm::vec3 mount = car.pos + arm;
+
+            const glm::vec3& normal = ground[i].normal;
+            float facing = glm::dot(up, normal);
+            float reach = p.suspensionLength + p.wheelRadius;
+            float distance = facing > 0.1f ? glm::dot(mount - ground[i].point, normal) / facing : reach;
+            float compression = reach - distance;
+
+            wheelLoad[i] = 0.0f;
+            vxs[i] = vys[i] = 0.0f;
+            contact[i] = mount - up * std::max(distance, 0.0f);
+            tyreForward[i] = forward;
+            tyreLeft[i] = left;
+            if (compression > 0.0f) {
+                glm::vec3 mountVelocity = car.velocity + glm::cross(car.angularVelocity, arm);
+                wheelLoad[i] = suspensionForce(compression, -glm::dot(mountVelocity, up), p);
+
+                // Tyre frame in the ground plane
+                glm::vec3 heading = front ? forward * cosSteer + left * sinSteer : forward;
+                heading -= normal * glm::dot(heading, normal);
+                heading /= detSqrt(std::max(glm::dot(heading, heading), 1e-12f));
+                tyreForward[i] = heading;
+                tyreLeft[i] = glm::cross(normal, heading);
+
+                glm::vec3 contactVelocity = car.velocity + glm::cross(car.angularVelocity, contact[i] - car.pos);
+                vxs[i] = glm::dot(contactVelocity, tyreForward[i]);
+                vys[i] = glm::dot(contactVelocity, tyreLeft[i]);
+            }
+            car.compression[i] = std::max(compression, 0.0f);
+            surfaceGrip[i] = ground[i].grip;
+            rolling += ground[i].rollingResistance * 0.25f;
+
+            torque[i] = front ? 0.0f : drive * 0.5f;
+            float axleBrake = front ? p.brakeBias : 1.0f - p.brakeBias;
+            resist[i] = (brake * axleBrake * 0.5f + (front ? 0.0f : engineBrake * 0.5f)) * dt / p.wheelInertia;
+        }
+
+        // Tyre forces for the four wheels in one SIMD pass
+        F4 vx = load(vxs), vy = load(vys);
+        F4 radius(p.wheelRadius);
+        F4 denom = vmax(vabs(vx), F4(minSlipSpeed));
+        F4 spin = load(car.wheelSpin);
+        F4 slipX = (spin * radius - vx) / denom;
+        F4 slipY = (F4(0.0f) - vy) / denom;
+        F4 slip = vsqrt(slipX * slipX + slipY * slipY);
+
+        F4 loadGrip = load(wheelLoad) * load(surfaceGrip) * F4(p.grip);
+        F4 kx = loadGrip * longTable.secant(slip);
+        F4 ky = loadGrip * latTable.secant(slip);
+
+        // Wheel spin is solved implicitly against the linearised tyre force so
+        // the stiff wheel/road coupling stays stable at the tick rate.
+        F4 h(dt / p.wheelInertia);
+        F4 coupling = radius * kx / denom;
+        spin = (spin + h * (load(torque) + coupling * vx)) / (F4(1.0f) + h * coupling * radius);
+        float spins[4];
+        store(spins, spin);
+        for (int i = 0; i < 4; ++i) {
+            car.wheelSpin[i] = applyResistance(spins[i], resist[i]);
+            car.wheelAngle[i] += car.wheelSpin[i] * dt;
+        }
+        spin = load(car.wheelSpin);
+
+        float fx[4], fy[4];
+        store(fx, kx * (spin * radius - vx) / denom);
+        store(fy, ky * slipY);
+
+        // Sum forces and moments about the centre of mass
+        glm::vec3 force(0.0f, -p.mass * gravity, 0.0f);
+        glm::vec3 moment(0.0f);
+        for (int i = 0; i < 4; ++i) {
+            if (wheelLoad[i] <= 0.0f) continue;
+            glm::vec3 f = up * wheelLoad[i] + tyreForward[i] * fx[i] + tyreLeft[i] * fy[i];
+            force += f;
+            moment += glm::cross(contact[i] - car.pos, f);
+        }
+
+        float speed = glm::length(car.velocity);
+        force -= car.velocity * (p.drag * speed);
+        force -= forward * (p.rollingResistance * rolling * p.mass * gravity * clampf(vForward, -1.0f, 1.0f));
+
+        // Semi-implicit Euler. The inertia tensor is diagonal in car space.
+        car.velocity += force * (dt / p.mass);
+        glm::vec3 angularAccel = basis * ((glm::transpose(basis) * moment) / p.inertia);
+        car.angularVelocity += angularAccel * dt;
+        car.pos += car.velocity * dt;
+
+        glm::quat spinQuat(0.0f, car.angularVelocity * (0.5f * dt));
+        glm::quat q = car.orientation + spinQuat * car.orientation;
+        float length = detSqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+        car.orientation = glm::quat(q.w / length, q.x / length, q.y / length, q.z / length);
+
+        // Heading stays continuous so callers never see a jump at +-180
+        glm::vec3 newForward = car.orientation * glm::vec3(0.0f, 0.0f, 1.0f);
+        float heading = glm::degrees(detAtan2(newForward.x, newForward.z));
+        car.rotation += wrapDegrees(heading - car.rotation);
+        car.speed = glm::dot(car.velocity, newForward);
+    }
+}
+
+CarState makeCar(const glm::vec3& pos, float rotation) {
+    CarState car;
+    car.pos = pos;
+    car.rotation = rotation;
+    car.speed = 0.0f;
+    car.steerAngle = 0.0f;
+    car.orientation = yawQuat(rotation);
+    car.velocity = glm::vec3(0.0f);
+    car.angularVelocity = glm::vec3(0.0f);
+    for (int i = 0; i < 4; ++i) {
+        car.wheelSpin[i] = 0.0f;
+        car.wheelAngle[i] = 0.0f;
+        car.compression[i] = 0.0f;
+    }
+    car.substeps = 0;
+    car.lodTier = 0;
+    car.lodDebt = 0.0f;
+    car.trackSegment = -1;
+    car.trackSector = -1;
+    car.lap = 0;
+    car.trackDistance = 0.0f;
+    car.trackOffset = 0.0f;
+    car.lapTime = 0.0f;
+    car.sectorStartTime = 0.0f;
+    car.lastSectorTime = 0.0f;
+    car.lastLapTime = 0.0f;
+    car.bestLapTime = 0.0f;
+    car.recoveryRejoin = -1;
+    car.recoveryFrom = glm::vec2(0.0f);
+    return car;
+}
+
+void resetCar(CarState& car) {
+    car = makeCar(glm::vec3(0.0f, 0.5f, 0.0f), 0.0f);
+}
+
+void setCarHeading(CarState& car, float rotation) {
+    car.rotation = rotation;
+    car.orientation = yawQuat(rotation);
+    car.angularVelocity = glm::vec3(0.0f);
+}
+
+void carWheelMounts(const CarState& car, glm::vec3 mounts[4]) {
+    glm::mat3 basis = glm::mat3_cast(car.orientation);
+    for (int i = 0; i < 4; ++i) mounts[i] = car.pos + basis * wheelPositions[i];
+}
+
+void stepCar(CarState& car, const CarInput& input, float deltaTime, const CarParams& params,
+    const WheelGround* ground) {
+    WheelGround flat[4];
+    if (!ground) {
+        for (WheelGround& g : flat) {
+            g.point = glm::vec3(0.0f);
+            g.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            g.grip = 1.0f;
+            g.rollingResistance = 1.0f;
+        }
+        ground = flat;
+    }
+
+    float throttle = clampf(input.throttle, -1.0f, 1.0f);
+    float steer = clampf(input.steer, -1.0f, 1.0f);
+
+    const TireTable& longTable = longitudinalTireTable();
+    const TireTable& latTable = lateralTireTable();
+    float tyreStiffness = std::max(longTable.zeroSlipStiffness(), latTable.zeroSlipStiffness());
+
+    int substeps = chooseSubsteps(car, deltaTime, params, tyreStiffness);
+    float dt = deltaTime / substeps;
+    for (int i = 0; i < substeps; ++i) {
+        integrate(car, throttle, steer, dt, params, ground, longTable, latTable);
+    }
+    car.substeps = substeps;
+}
+
+uint64_t hashCarState(const CarState& car, uint64_t hash) {
+    return hashBytes(&car, sizeof(CarState), hash);
+}
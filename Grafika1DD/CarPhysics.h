@@ -0,0 +1,130 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cstdint>
+
+// Tick length used when the simulation runs in deterministic mode.
+const float fixedTimeStep = 1.0f / 120.0f;
+
+// Bounds for the adaptive integrator: calm driving takes one step of up to
+// maxCarSubstep, stiff moments (impacts, high speed) up to maxCarSubsteps.
+const float maxCarSubstep = 1.0f / 120.0f;
+const int maxCarSubsteps = 16;
+
+// Half size of the car body drawn by renderCar (2 x 0.8 x 4).
+const glm::vec3 carHalfExtents = glm::vec3(1.0f, 0.4f, 2.0f);
+
+// Suspension mount points in car space (x = left, z = forward), in the
+// order renderCar draws the wheels: front right, front left, rear right,
+// rear left.
+const glm::vec3 wheelPositions[4] = {
+    glm::vec3(-1.2f, 0.0f, 1.5f), glm::vec3(1.2f, 0.0f, 1.5f),
+    glm::vec3(-1.2f, 0.0f, -1.5f), glm::vec3(1.2f, 0.0f, -1.5f)
+};
+const int frontWheelCount = 2;
+// Front to rear axle.
+const float wheelBase = wheelPositions[0].z - wheelPositions[frontWheelCount].z;
+
+const float gravity = 9.81f;
+
+inline float clampf(float x, float lo, float hi) {
+    return std::max(lo, std::min(x, hi));
+}
+
+// The same angle in (-180, 180].
+inline float wrapDegrees(float angle) {
+    while (angle > 180.0f) angle -= 360.0f;
+    while (angle < -180.0f) angle += 360.0f;
+    return angle;
+}
+
+// Dynamic state of one car. Kept trivially copyable so many cars can live
+// in flat arrays and be copied with memcpy.
+struct CarState {
+    glm::vec3 pos;              // centre of mass
+    float rotation;             // heading in degrees, 0 = +Z (derived from orientation)
+    float speed;                // forward component of velocity
+    float steerAngle;           // front wheel angle in degrees, positive = left
+    glm::quat orientation;
+    glm::vec3 velocity;         // m/s
+    glm::vec3 angularVelocity;  // rad/s, world space
+    float wheelSpin[4];         // rad/s per wheel, same order as wheelPositions
+    float wheelAngle[4];        // accumulated wheel rotation for rendering
+    float compression[4];       // suspension compression in metres, 0 = wheel in the air
+    int substeps;               // integrator steps taken by the last stepCar
+    int lodTier;                // SimLodTier the car was last stepped at
+    float lodDebt;              // seconds not yet simulated by a reduced-rate tier
+    int trackSegment;           // centreline segment found last tick, -1 = not located yet
+    int trackSector;            // last sector entered in order, -1 = not located yet
+    int lap;                    // 0 until the car first crosses the start line
+    float trackDistance;        // along the centreline from the start line
+    float trackOffset;          // sideways from the centreline, positive = left
+    float lapTime;              // seconds since the lap started
+    float sectorStartTime;      // lapTime when the current sector was entered
+    float lastSectorTime;       // 0 = no sector completed yet
+    float lastLapTime;          // 0 = no timed lap completed yet
+    float bestLapTime;
+    int recoveryRejoin;         // racing line point the AI recovery route leads to, -1 = not recovering
+    glm::vec2 recoveryFrom;     // where that route was planned from
+};
+
+// Driver controls for one tick.
+// throttle: 1 = full throttle, -1 = brake / reverse
+// steer:    1 = full left, -1 = full right
+struct CarInput {
+    float throttle;
+    float steer;
+};
+
+// Ground under one wheel for the current tick, as a plane through point,
+// and the surface's multipliers on grip and rolling resistance.
+// Sampled once per tick; the substeps intersect the suspension with it.
+struct WheelGround {
+    glm::vec3 point;
+    glm::vec3 normal;
+    float grip;
+    float rollingResistance;
+};
+
+// Rigid body on four spring-damper wheels. Torques are totals for the car:
+// drive goes to the rear axle, brakes are split by brakeBias.
+struct CarParams {
+    float mass = 1200.0f;
+    glm::vec3 inertia = glm::vec3(1700.0f, 2000.0f, 500.0f);  // pitch, yaw, roll
+    float wheelRadius = 0.3f;
+    float wheelInertia = 1.2f;
+    float suspensionLength = 0.3f;      // spring travel from mount to full droop
+    float springRate = 35000.0f;        // N/m per wheel
+    float damperRate = 2600.0f;         // N s/m per wheel
+    float bumpStopRate = 350000.0f;     // added once the travel is used up
+    float grip = 1.0f;
+    float maxSpeed = 15.0f;
+    float driveTorque = 1800.0f;
+    float brakeTorque = 2000.0f;
+    float brakeBias = 0.6f;             // share of braking on the front axle
+    float engineBrakeTorque = 300.0f;
+    float maxSteer = 30.0f;             // degrees at standstill
+    float steerRate = 150.0f;           // degrees per second
+    float steerSpeedFalloff = 0.1f;     // lock shrinks as 1 / (1 + falloff * speed)
+    float drag = 0.4f;
+    float rollingResistance = 0.015f;
+};
+
+CarState makeCar(const glm::vec3& pos, float rotation);
+void resetCar(CarState& car);
+
+// Turns the car to face `rotation` degrees and levels it.
+void setCarHeading(CarState& car, float rotation);
+
+// Advances the car by deltaTime. The step is split adaptively from the
+// current tyre and suspension stiffness and the speed. ground holds one
+// plane per wheel; nullptr means flat ground at y = 0.
+void stepCar(CarState& car, const CarInput& input, float deltaTime,
+    const CarParams& params = CarParams(), const WheelGround* ground = nullptr);
+
+// World position of each suspension mount, for sampling the ground.
+void carWheelMounts(const CarState& car, glm::vec3 mounts[4]);
+
+// Folds the exact bit pattern of the car state into a running hash.
+uint64_t hashCarState(const CarState& car, uint64_t hash);
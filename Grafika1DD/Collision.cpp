@@ -0,0 +1,404 @@
+#include "DetMath.h"
+#include "Collision.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const float restitution = 0.3f;
+    const float penetrationSlop = 0.01f;
+    const int solverIterations = 2;
+
+    // Cars moving less than this per tick cannot skip past the thinnest
+    // static box (barrierThickness) and are handled by the discrete pass.
+    const float sweepMinTravel = 0.25f;
+    // Gap left between a swept car and the box it hit.
+    const float sweepSkin = 1e-3f;
+
+    glm::vec2 support(const Obb2& box, const glm::vec2& dir) {
+        glm::vec2 p = box.center;
+        p += box.axis[0] * (glm::dot(box.axis[0], dir) >= 0.0f ? box.half.x : -box.half.x);
+        p += box.axis[1] * (glm::dot(box.axis[1], dir) >= 0.0f ? box.half.y : -box.half.y);
+        return p;
+    }
+
+    void obbBounds(const Obb2& box, glm::vec2& min, glm::vec2& max) {
+        glm::vec2 ext(
+            std::abs(box.axis[0].x) * box.half.x + std::abs(box.axis[1].x) * box.half.y,
+            std::abs(box.axis[0].y) * box.half.x + std::abs(box.axis[1].y) * box.half.y);
+        min = box.center - ext;
+        max = box.center + ext;
+    }
+
+    // Applies a horizontal velocity change and keeps the derived forward
+    // speed in step with it.
+    void addVelocity(CarState& car, const glm::vec2& dv) {
+        car.velocity.x += dv.x;
+        car.velocity.z += dv.y;
+        car.speed = glm::dot(car.velocity, car.orientation * glm::vec3(0.0f, 0.0f, 1.0f));
+    }
+
+    glm::vec2 planarVelocity(const CarState& car) {
+        return glm::vec2(car.velocity.x, car.velocity.z);
+    }
+
+    // Removes the velocity into a surface with normal n, with restitution.
+    void bounceOff(CarState& car, const glm::vec2& n) {
+        float vn = glm::dot(planarVelocity(car), n);
+        if (vn < 0.0f) {
+            addVelocity(car, -(1.0f + restitution) * vn * n);
+        }
+    }
+
+    // Moves the car out of a static box and removes the velocity into it.
+    void resolveStaticContact(CarState& car, const Contact& contact) {
+        glm::vec2 n = contact.normal;
+        float push = std::max(contact.depth - penetrationSlop, 0.0f);
+        car.pos.x += n.x * push;
+        car.pos.z += n.y * push;
+        bounceOff(car, n);
+    }
+
+    // Equal-mass contact between two cars; normal points from a to b.
+    void resolveCarContact(CarState& a, CarState& b, const Contact& contact) {
+        glm::vec2 n = contact.normal;
+        float push = std::max(contact.depth - penetrationSlop, 0.0f) * 0.5f;
+        a.pos.x -= n.x * push;
+        a.pos.z -= n.y * push;
+        b.pos.x += n.x * push;
+        b.pos.z += n.y * push;
+
+        float vn = glm::dot(planarVelocity(b) - planarVelocity(a), n);
+        if (vn < 0.0f) {
+            float j = -(1.0f + restitution) * vn * 0.5f;
+            addVelocity(a, -j * n);
+            addVelocity(b, j * n);
+        }
+    }
+}
+
+Obb2 makeObb2(const glm::vec3& center, const glm::vec3& halfExtents, float rotation) {
+    float s, c;
+    detSinCos(glm::radians(rotation), s, c);
+    Obb2 box;
+    box.center = glm::vec2(center.x, center.z);
+    box.axis[0] = glm::vec2(c, -s);
+    box.axis[1] = glm::vec2(s, c);
+    box.half = glm::vec2(halfExtents.x, halfExtents.z);
+    return box;
+}
+
+// Separating axis test over the four face normals. The contact normal is the
+// axis of least penetration; the contact point is the deepest vertex of the
+// incident box.
+bool collideObb2(const Obb2& a, const Obb2& b, Contact& contact) {
+    const glm::vec2 axes[4] = { a.axis[0], a.axis[1], b.axis[0], b.axis[1] };
+    glm::vec2 d = b.center - a.center;
+
+    float minOverlap = 0.0f;
+    int minAxis = -1;
+    for (int i = 0; i < 4; ++i) {
+        const glm::vec2& n = axes[i];
+        float ra = a.half.x * std::abs(glm::dot(a.axis[0], n)) + a.half.y * std::abs(glm::dot(a.axis[1], n));
+        float rb = b.half.x * std::abs(glm::dot(b.axis[0], n)) + b.half.y * std::abs(glm::dot(b.axis[1], n));
+        float overlap = ra + rb - std::abs(glm::dot(d, n));
+        if (overlap < 0.0f) return false;
+        if (minAxis < 0 || overlap < minOverlap) {
+            minOverlap = overlap;
+            minAxis = i;
+        }
+    }
+
+    glm::vec2 normal = axes[minAxis];
+    if (glm::dot(d, normal) < 0.0f) normal = -normal;
+
+    contact.normal = normal;
+    contact.depth = minOverlap;
+    contact.point = (minAxis < 2) ? support(b, -normal) : support(a, normal);
+    return true;
+}
+
+// Separating axis test on the moving boxes: on every axis the projections
+// overlap during one interval of the motion, and the boxes touch where all
+// intervals overlap. The axis that closes last gives the normal.
+bool sweepObb2(const Obb2& a, const Obb2& b, const glm::vec2& motion, float& toi, glm::vec2& normal) {
+    const glm::vec2 axes[4] = { a.axis[0], a.axis[1], b.axis[0], b.axis[1] };
+
+    float enter = -1.0f, exit = 2.0f;
+    int enterAxis = -1;
+    for (int i = 0; i < 4; ++i) {
+        const glm::vec2& n = axes[i];
+        float ra = a.half.x * std::abs(glm::dot(a.axis[0], n)) + a.half.y * std::abs(glm::dot(a.axis[1], n));
+        float rb = b.half.x * std::abs(glm::dot(b.axis[0], n)) + b.half.y * std::abs(glm::dot(b.axis[1], n));
+        float gap = glm::dot(b.center - a.center, n);  // b relative to a
+        float v = glm::dot(motion, n);
+        float reach = ra + rb;
+
+        if (std::abs(v) < 1e-9f) {
+            if (std::abs(gap) > reach) return false;  // separated for the whole move
+            continue;
+        }
+        // Times at which |gap + v t| == reach
+        float t0 = (-reach - gap) / v;
+        float t1 = (reach - gap) / v;
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > enter) {
+            enter = t0;
+            enterAxis = i;
+        }
+        exit = std::min(exit, t1);
+        if (enter > exit) return false;
+    }
+
+    // Overlapping from the start, or the contact begins after this step
+    if (enterAxis < 0 || enter < 0.0f || enter > 1.0f) return false;
+
+    normal = axes[enterAxis];
+    if (glm::dot(motion, normal) > 0.0f) normal = -normal;
+    toi = enter;
+    return true;
+}
+
+void SweepAndPrune::clear() {
+    proxies.clear();
+    endpoints.clear();
+    activeDynamic.clear();
+    activeStatic.clear();
+    needsFullSort = true;
+}
+
+int SweepAndPrune::addProxy(bool isStatic) {
+    Proxy proxy;
+    proxy.min = glm::vec2(0.0f);
+    proxy.max = glm::vec2(0.0f);
+    proxy.isStatic = isStatic;
+    proxy.finite = true;
+    proxy.activeSlot = -1;
+    proxies.push_back(proxy);
+
+    uint32_t id = (uint32_t)proxies.size() - 1;
+    endpoints.push_back(Endpoint{ id, 0 });
+    endpoints.push_back(Endpoint{ id, 1 });
+    needsFullSort = true;
+    return (int)id;
+}
+
+void SweepAndPrune::setBounds(int proxy, const glm::vec2& min, const glm::vec2& max) {
+    Proxy& p = proxies[proxy];
+    // NaN would break the endpoint order the sort relies on, so such a
+    // proxy is parked at the origin and skipped by the sweep
+    p.finite = std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(max.x) && std::isfinite(max.y);
+    p.min = p.finite ? glm::min(min, max) : glm::vec2(0.0f);
+    p.max = p.finite ? glm::max(min, max) : glm::vec2(0.0f);
+}
+
+float SweepAndPrune::endpointValue(const Endpoint& e) const {
+    const Proxy& p = proxies[e.proxy];
+    return e.isMax ? p.max[axis] : p.min[axis];
+}
+
+// Sorts along whichever axis the moving proxies are spread over more, so a
+// pack of cars strung out along a straight does not all overlap on the
+// sort axis. Switching needs a clear margin to avoid re-sorting every tick.
+void SweepAndPrune::chooseAxis() {
+    glm::vec2 sum(0.0f), sumSq(0.0f);
+    int count = 0;
+    for (const Proxy& p : proxies) {
+        if (p.isStatic || !p.finite) continue;
+        glm::vec2 c = (p.min + p.max) * 0.5f;
+        sum += c;
+        sumSq += c * c;
+        ++count;
+    }
+    if (count < 2) return;
+
+    glm::vec2 mean = sum / (float)count;
+    glm::vec2 variance = sumSq / (float)count - mean * mean;
+    int other = 1 - axis;
+    if (variance[other] > variance[axis] * 1.5f) {
+        axis = other;
+        needsFullSort = true;
+    }
+}
+
+void SweepAndPrune::findPairs(std::vector<std::pair<int, int>>& pairs) {
+    pairs.clear();
+    chooseAxis();
+
+    auto less = [this](const Endpoint& a, const Endpoint& b) {
+        float va = endpointValue(a), vb = endpointValue(b);
+        return va < vb || (va == vb && a.isMax < b.isMax);
+    };
+
+    if (needsFullSort) {
+        std::sort(endpoints.begin(), endpoints.end(), less);
+        needsFullSort = false;
+    }
+    else {
+        // Insertion sort: endpoints barely move between ticks
+        for (size_t i = 1; i < endpoints.size(); ++i) {
+            Endpoint e = endpoints[i];
+            size_t j = i;
+            while (j > 0 && less(e, endpoints[j - 1])) {
+                endpoints[j] = endpoints[j - 1];
+                --j;
+            }
+            endpoints[j] = e;
+        }
+    }
+
+    // Sweep: static proxies only need testing against moving ones
+    activeDynamic.clear();
+    activeStatic.clear();
+    for (Proxy& p : proxies) p.activeSlot = -1;
+    int cross = 1 - axis;
+    for (const Endpoint& e : endpoints) {
+        int id = (int)e.proxy;
+        Proxy& p = proxies[id];
+        if (!p.finite) continue;
+        std::vector<int>& list = p.isStatic ? activeStatic : activeDynamic;
+        if (e.isMax) {
+            // Only a proxy whose min endpoint was swept is in the list
+            int slot = p.activeSlot;
+            if (slot < 0) continue;
+            int last = list.back();
+            list[slot] = last;
+            proxies[last].activeSlot = slot;
+            list.pop_back();
+            p.activeSlot = -1;
+            continue;
+        }
+
+        auto test = [&](int other) {
+            const Proxy& q = proxies[other];
+            if (p.max[cross] < q.min[cross] || q.max[cross] < p.min[cross]) return;
+            pairs.emplace_back(std::min(id, other), std::max(id, other));
+        };
+        for (int other : activeDynamic) test(other);
+        if (!p.isStatic) {
+            for (int other : activeStatic) test(other);
+        }
+
+        p.activeSlot = (int)list.size();
+        list.push_back(id);
+    }
+
+    // Fixed order keeps the contact solver deterministic
+    std::sort(pairs.begin(), pairs.end());
+}
+
+void CollisionWorld::setStaticColliders(const std::vector<StaticBox>& boxes) {
+    staticBoxes.clear();
+    for (const StaticBox& box : boxes) {
+        staticBoxes.push_back(makeObb2(box.center, box.halfExtents, box.rotation));
+    }
+    rebuildBroadphase(0);
+}
+
+// Static proxies come first, so a pair (static, car) always has the static
+// proxy as its first element.
+void CollisionWorld::rebuildBroadphase(int carCount) {
+    broadphase.clear();
+    for (const Obb2& box : staticBoxes) {
+        glm::vec2 min, max;
+        obbBounds(box, min, max);
+        broadphase.setBounds(broadphase.addProxy(true), min, max);
+    }
+    carProxyBase = (int)staticBoxes.size();
+    for (int i = 0; i < carCount; ++i) {
+        broadphase.addProxy(false);
+    }
+    carProxyCount = carCount;
+}
+
+void CollisionWorld::resolve(SimState& state, const glm::vec3* previousPositions) {
+    int carCount = state.carCount;
+    if (carCount != carProxyCount) rebuildBroadphase(carCount);
+
+    carBoxes.resize(carCount);
+    for (int i = 0; i < carCount; ++i) {
+        const CarState& car = state.cars[i];
+        carBoxes[i] = makeObb2(car.pos, carHalfExtents, car.rotation);
+
+        // Bounds cover the whole move, so the sweep sees what it passed
+        glm::vec2 min, max;
+        obbBounds(carBoxes[i], min, max);
+        if (previousPositions) {
+            glm::vec2 motion(car.pos.x - previousPositions[i].x, car.pos.z - previousPositions[i].z);
+            min = glm::min(min, min - motion);
+            max = glm::max(max, max - motion);
+        }
+        broadphase.setBounds(carProxyBase + i, min, max);
+    }
+
+    broadphase.findPairs(pairs);
+
+    lastSweptCount = 0;
+    if (previousPositions) sweepFastCars(state, previousPositions);
+
+    lastContactCount = 0;
+    for (int iteration = 0; iteration < solverIterations; ++iteration) {
+        for (const auto& pair : pairs) {
+            Contact contact;
+            if (pair.first < carProxyBase) {
+                int car = pair.second - carProxyBase;
+                if (!collideObb2(staticBoxes[pair.first], carBoxes[car], contact)) continue;
+
+                CarState& carState = simCarForWrite(state, car);
+                resolveStaticContact(carState, contact);
+                carBoxes[car].center = glm::vec2(carState.pos.x, carState.pos.z);
+            }
+            else {
+                int a = pair.first - carProxyBase;
+                int b = pair.second - carProxyBase;
+                if (!collideObb2(carBoxes[a], carBoxes[b], contact)) continue;
+
+                CarState& carA = simCarForWrite(state, a);
+                CarState& carB = simCarForWrite(state, b);
+                resolveCarContact(carA, carB, contact);
+                carBoxes[a].center = glm::vec2(carA.pos.x, carA.pos.z);
+                carBoxes[b].center = glm::vec2(carB.pos.x, carB.pos.z);
+            }
+            if (iteration == 0) ++lastContactCount;
+        }
+    }
+}
+
+// Rewinds each fast car to its earliest impact with a static box. The car
+// keeps its end-of-step orientation for the sweep; the discrete pass that
+// follows settles whatever contact is left.
+void CollisionWorld::sweepFastCars(SimState& state, const glm::vec3* previousPositions) {
+    int carCount = state.carCount;
+    carToi.assign(carCount, 2.0f);
+    carToiNormal.resize(carCount);
+
+    for (const auto& pair : pairs) {
+        if (pair.first >= carProxyBase) break;  // sorted: static pairs come first
+
+        int car = pair.second - carProxyBase;
+        const glm::vec3& end = state.cars[car].pos;
+        glm::vec2 motion(end.x - previousPositions[car].x, end.z - previousPositions[car].z);
+        if (glm::dot(motion, motion) < sweepMinTravel * sweepMinTravel) continue;
+
+        Obb2 start = carBoxes[car];
+        start.center -= motion;
+        float toi;
+        glm::vec2 normal;
+        if (sweepObb2(staticBoxes[pair.first], start, motion, toi, normal) && toi < carToi[car]) {
+            carToi[car] = toi;
+            carToiNormal[car] = normal;
+        }
+    }
+
+    for (int i = 0; i < carCount; ++i) {
+        if (carToi[i] > 1.0f) continue;
+
+        CarState& car = simCarForWrite(state, i);
+        const glm::vec3& start = previousPositions[i];
+        float t = carToi[i];
+        car.pos.x = start.x + (car.pos.x - start.x) * t + carToiNormal[i].x * sweepSkin;
+        car.pos.z = start.z + (car.pos.z - start.z) * t + carToiNormal[i].y * sweepSkin;
+        bounceOff(car, carToiNormal[i]);
+        carBoxes[i].center = glm::vec2(car.pos.x, car.pos.z);
+        ++lastSweptCount;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "SimState.h"
+#include "WorldGeometry.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Oriented box in the ground plane (world XZ stored as x, y).
+struct Obb2 {
+    glm::vec2 center;
+    glm::vec2 axis[2];   // unit local X and local Z
+    glm::vec2 half;
+};
+
+struct Contact {
+    glm::vec2 normal;    // from the first box towards the second
+    glm::vec2 point;
+    float depth;
+};
+
+Obb2 makeObb2(const glm::vec3& center, const glm::vec3& halfExtents, float rotation);
+bool collideObb2(const Obb2& a, const Obb2& b, Contact& contact);
+
+// Time of impact of box b translated by motion against a fixed box a. On a
+// hit toi is the fraction of the motion travelled before the boxes touch and
+// normal points from a towards b. Boxes that already overlap at the start
+// are left to collideObb2.
+bool sweepObb2(const Obb2& a, const Obb2& b, const glm::vec2& motion, float& toi, glm::vec2& normal);
+
+// Incremental sweep-and-prune on one axis. Endpoints stay sorted between
+// updates and are re-sorted with insertion sort, which is close to linear
+// when objects move a little each tick. Pairs are reported only when the
+// boxes also overlap on the other axis, and static-static pairs are skipped.
+class SweepAndPrune {
+public:
+    void clear();
+    int addProxy(bool isStatic);
+    // Bounds that are not finite (a car whose state blew up) take the proxy
+    // out of the pairs until it has finite bounds again.
+    void setBounds(int proxy, const glm::vec2& min, const glm::vec2& max);
+    void findPairs(std::vector<std::pair<int, int>>& pairs);
+
+private:
+    struct Proxy {
+        glm::vec2 min;
+        glm::vec2 max;
+        bool isStatic;
+        bool finite;        // false keeps the proxy out of the sweep
+        int activeSlot;     // in its active list, -1 when not active
+    };
+    struct Endpoint {
+        uint32_t proxy;
+        uint32_t isMax;
+    };
+
+    float endpointValue(const Endpoint& e) const;
+    void chooseAxis();
+
+    std::vector<Proxy> proxies;
+    std::vector<Endpoint> endpoints;
+    std::vector<int> activeDynamic;
+    std::vector<int> activeStatic;
+    int axis = 1;
+    bool needsFullSort = true;
+};
+
+// Resolves car-car and car-static contacts after the cars have moved:
+// pushes boxes apart and applies restitution impulses to the velocities.
+class CollisionWorld {
+public:
+    void setStaticColliders(const std::vector<StaticBox>& boxes);
+
+    // previousPositions holds the car centres before the step. Cars that
+    // moved further than a barrier is thick are swept against the static
+    // boxes first and stopped at the first impact, so a coarse tick cannot
+    // carry them through. nullptr skips the sweep.
+    void resolve(SimState& state, const glm::vec3* previousPositions = nullptr);
+
+    // Number of contacts handled by the last resolve()
+    int contactCount() const { return lastContactCount; }
+    // Number of cars stopped by the sweep in the last resolve()
+    int sweptCount() const { return lastSweptCount; }
+
+private:
+    void rebuildBroadphase(int carCount);
+    void sweepFastCars(SimState& state, const glm::vec3* previousPositions);
+
+    SweepAndPrune broadphase;
+    std::vector<Obb2> staticBoxes;
+    std::vector<Obb2> carBoxes;
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<float> carToi;
+    std::vector<glm::vec2> carToiNormal;
+    int carProxyBase = 0;
+    int carProxyCount = 0;
+    int lastContactCount = 0;
+    int lastSweptCount = 0;
+};
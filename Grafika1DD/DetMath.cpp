@@ -0,0 +1,103 @@
+#include "DetMath.h"
+#include <cmath>
+
+namespace {
+    // pi/2 split into three parts (Cody-Waite) so k * pi/2 is subtracted exactly
+    const float halfPi1 = 1.5703125f;
+    const float halfPi2 = 4.837512969970703125e-4f;
+    const float halfPi3 = 7.54978995489188216e-8f;
+    const float twoOverPi = 0.636619772367581343f;
+
+    // Minimax polynomials on [-pi/4, pi/4] (Cephes sinf/cosf coefficients)
+    float sinPoly(float r) {
+        float z = r * r;
+        return ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+    }
+
+    float cosPoly(float r) {
+        float z = r * r;
+        return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z
+            - 0.5f * z + 1.0f;
+    }
+
+    // Returns r in [-pi/4, pi/4] and the quadrant of x.
+    float reduce(float x, int& quadrant) {
+        float k = std::floor(x * twoOverPi + 0.5f);
+        quadrant = (int)((long long)k & 3);
+        return ((x - k * halfPi1) - k * halfPi2) - k * halfPi3;
+    }
+}
+
+void detSinCos(float x, float& s, float& c) {
+    int quadrant;
+    float r = reduce(x, quadrant);
+    float sr = sinPoly(r);
+    float cr = cosPoly(r);
+    switch (quadrant) {
+    case 0: s = sr;  c = cr;  break;
+    case 1: s = cr;  c = -sr; break;
+    case 2: s = -sr; c = -cr; break;
+    default: s = -cr; c = sr; break;
+    }
+}
+
+float detSin(float x) {
+    float s, c;
+    detSinCos(x, s, c);
+    return s;
+}
+
+float detCos(float x) {
+    float s, c;
+    detSinCos(x, s, c);
+    return c;
+}
+
+float detAtan(float x) {
+    const float pi = 3.14159265358979f;
+    float sign = 1.0f;
+    if (x < 0.0f) {
+        sign = -1.0f;
+        x = -x;
+    }
+
+    // Reduce to |x| <= tan(pi/8)
+    float base = 0.0f;
+    if (x > 2.414213562373095f) {
+        base = pi * 0.5f;
+        x = -1.0f / x;
+    }
+    else if (x > 0.4142135623730950f) {
+        base = pi * 0.25f;
+        x = (x - 1.0f) / (x + 1.0f);
+    }
+
+    float z = x * x;
+    float poly = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z
+        - 3.33329491539e-1f) * z * x + x;
+    return sign * (base + poly);
+}
+
+float detAtan2(float y, float x) {
+    const float pi = 3.14159265358979f;
+    if (x == 0.0f) {
+        if (y == 0.0f) return 0.0f;
+        return y > 0.0f ? pi * 0.5f : -pi * 0.5f;
+    }
+    float a = detAtan(y / x);
+    if (x > 0.0f) return a;
+    return y >= 0.0f ? a + pi : a - pi;
+}
+
+float detSqrt(float x) {
+    return std::sqrt(x);
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Bit-reproducible math for the simulation.
+//
+// Including this header turns off floating-point contraction (FMA fusion)
+// for the rest of the translation unit, so a*b+c is always rounded twice no
+// matter which instructions the compiler may use. Every file that advances
+// simulation state must include it, and include it first: the pragma only
+// covers code after it, and glm's inline functions (dot, quaternion rotate)
+// are compiled where their header is included.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// Portable sin/cos: fixed range reduction and polynomials evaluated with
+// plain float adds and multiplies, so results don't depend on the libm.
+float detSin(float x);
+float detCos(float x);
+void detSinCos(float x, float& s, float& c);
+
+// Portable atan/atan2 (Cephes atanf reduction and polynomial).
+float detAtan(float x);
+float detAtan2(float y, float x);
+
+// IEEE 754 requires sqrt to be correctly rounded, so the hardware result is
+// already identical everywhere; wrapped so call sites are explicit.
+float detSqrt(float x);
+
+// FNV-1a over raw bytes, used for per-tick state hashes.
+const uint64_t hashSeed = 14695981039346656037ull;
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = hashSeed);
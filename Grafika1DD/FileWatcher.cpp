@@ -0,0 +1,107 @@
+#include "FileWatcher.h"
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool fileStamp(const std::string& path, uint64_t& size, uint64_t& time) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return false;
+    size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    time = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    size = (uint64_t)info.st_size;
+#ifdef __APPLE__
+    time = (uint64_t)info.st_mtimespec.tv_sec * 1000000000u + (uint64_t)info.st_mtimespec.tv_nsec;
+#else
+    time = (uint64_t)info.st_mtim.tv_sec * 1000000000u + (uint64_t)info.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+namespace {
+    void stamp(const std::string& path, uint64_t& size, uint64_t& time) {
+        if (!fileStamp(path, size, time)) size = time = 0;
+    }
+
+    void addOnce(std::vector<std::string>& changed, const std::string& path) {
+        if (std::find(changed.begin(), changed.end(), path) == changed.end()) changed.push_back(path);
+    }
+}
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    lastPoll = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (inotify >= 0) close(inotify);
+#endif
+}
+
+void FileWatcher::watch(const std::string& path) {
+    for (const File& file : files) {
+        if (file.path == path) return;
+    }
+    File file;
+    file.path = path;
+    size_t slash = path.find_last_of("/\\");
+    file.directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    file.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    stamp(path, file.size, file.time);
+#ifdef __linux__
+    // The same directory always gets the same watch descriptor back
+    if (inotify >= 0) {
+        file.watch = inotify_add_watch(inotify, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+    files.push_back(file);
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed) {
+#ifdef __linux__
+    if (inotify >= 0) {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t bytes;
+        while ((bytes = read(inotify, buffer, sizeof(buffer))) > 0) {
+            for (char* at = buffer; at < buffer + bytes; ) {
+                const inotify_event* event = (const inotify_event*)at;
+                at += sizeof(inotify_event) + event->len;
+                if (event->len == 0) continue;
+                for (const File& file : files) {
+                    if (file.watch == event->wd && file.name == event->name) addOnce(changed, file.path);
+                }
+            }
+        }
+    }
+#endif
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll < pollInterval) return;
+    lastPoll = now;
+    for (File& file : files) {
+        if (file.watch >= 0) continue;
+        uint64_t size, time;
+        stamp(file.path, size, time);
+        if (size == file.size && time == file.time) continue;
+        file.size = size;
+        file.time = time;
+        addOnce(changed, file.path);
+    }
+}
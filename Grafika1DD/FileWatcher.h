@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Size and last write time of path, the time in nanoseconds (100 ns steps
+// on Windows) so that rewriting a file within the same second still
+// changes its stamp. False when the file cannot be read.
+bool fileStamp(const std::string& path, uint64_t& size, uint64_t& time);
+
+// Reports which of a set of files were written, for hot reloading. On
+// Linux the directories holding the files are watched with inotify, so a
+// file an editor saves by writing a temporary and renaming it over the
+// original is still seen, and nothing is read until the writer closes it.
+// Elsewhere the files' size and modification time are compared, at most
+// every pollInterval.
+//
+// poll() never blocks; call it once per frame from one thread.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // The file need not exist yet; its directory must for inotify to see it.
+    void watch(const std::string& path);
+
+    // Appends the watched paths, as given to watch(), written since the
+    // last call. Each path is reported once per call.
+    void poll(std::vector<std::string>& changed);
+
+private:
+    struct File {
+        std::string path;
+        std::string directory;
+        std::string name;
+        int watch = -1;             // inotify watch of the directory
+        uint64_t size = 0;
+        uint64_t time = 0;
+    };
+
+    std::vector<File> files;
+    int inotify = -1;
+    std::chrono::steady_clock::time_point lastPoll;
+    const std::chrono::milliseconds pollInterval = std::chrono::milliseconds(500);
+};
@@ -0,0 +1,251 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "FrameCapture.h"
+#include "stb_image_write.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // BT.601 studio range, what players assume for YUV4MPEG2
+    unsigned char lumaOf(int r, int g, int b) {
+        return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    unsigned char blueDifferenceOf(int r, int g, int b) {
+        return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+    unsigned char redDifferenceOf(int r, int g, int b) {
+        return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+FrameCapture::FrameCapture(int ringSize) : slots(std::max(2, ringSize)) {
+    encoded.assign(slots.size(), false);
+}
+
+FrameCapture::~FrameCapture() {
+    stopThread();
+}
+
+void FrameCapture::screenshot(const std::string& path) {
+    screenshotPath = path;
+}
+
+bool FrameCapture::startVideo(const std::string& path, int width, int height, int fps) {
+    stopVideo();
+    std::shared_ptr<std::ofstream> file = std::make_shared<std::ofstream>(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!*file) return false;
+    // 4:2:0 with chroma sited between the luma samples, as averaging 2 x 2 gives
+    *file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+    video = file;
+    videoWidth = width;
+    videoHeight = height;
+    captured = dropped = 0;
+    captureMs = 0.0;
+    return true;
+}
+
+void FrameCapture::stopVideo() {
+    video.reset();
+}
+
+void FrameCapture::endFrame(int width, int height) {
+    if (!recording() && screenshotPath.empty() && busy == 0) return;
+    auto start = std::chrono::steady_clock::now();
+
+    collect(false);
+    release();
+
+    // A resized window no longer fits the video, which keeps its first size
+    bool videoFrame = video && width == videoWidth && height == videoHeight;
+    bool shot = !screenshotPath.empty();
+    if (video && !videoFrame) ++dropped;
+    if (videoFrame || shot) {
+        if (busy == slots.size()) {
+            // A screenshot stays due and is taken next frame
+            if (videoFrame) ++dropped;
+        }
+        else {
+            if (!encoder.joinable()) startThread();
+            Slot& slot = slots[(oldest + busy) % slots.size()];
+            size_t bytes = (size_t)width * height * 4;
+            if (!slot.buffer) glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            if (slot.bytes != bytes) {
+                glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+                slot.bytes = bytes;
+            }
+            // Into the buffer, so this only queues the copy
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slot.state = SLOT_READING;
+            slot.job.path = shot ? screenshotPath : std::string();
+            slot.job.video = videoFrame ? video : nullptr;
+            slot.job.width = width;
+            slot.job.height = height;
+            screenshotPath.clear();
+            ++busy;
+            ++captured;
+        }
+    }
+    captureMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Maps every finished readback and queues it for the encoder, oldest
+// first. Without wait it stops at the first the GPU has not finished.
+void FrameCapture::collect(bool wait) {
+    for (size_t i = 0; i < busy; ++i) {
+        size_t index = (oldest + i) % slots.size();
+        Slot& slot = slots[index];
+        if (slot.state != SLOT_READING) continue;
+        GLsync fence = (GLsync)slot.fence;
+        GLenum state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+        if (state == GL_TIMEOUT_EXPIRED) return;
+        glDeleteSync(fence);
+        slot.fence = nullptr;
+        slot.state = SLOT_ENCODING;
+
+        Job job = std::move(slot.job);
+        slot.job = Job();
+        job.slot = index;
+        if (state != GL_WAIT_FAILED) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            job.pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                (GLsizeiptr)slot.bytes, GL_MAP_READ_BIT);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        slot.mapped = job.pixels != nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            encoded[index] = !slot.mapped;
+            if (slot.mapped) jobs.push_back(std::move(job));
+        }
+        if (slot.mapped) wake.notify_one();
+        else ++dropped;
+    }
+}
+
+// Unmaps the buffers the encoder is done with, for the next readbacks
+void FrameCapture::release() {
+    while (busy > 0) {
+        Slot& slot = slots[oldest];
+        if (slot.state != SLOT_ENCODING) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!encoded[oldest]) return;
+        }
+        if (slot.mapped) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            slot.mapped = false;
+        }
+        slot.state = SLOT_FREE;
+        oldest = (oldest + 1) % slots.size();
+        --busy;
+    }
+}
+
+void FrameCapture::shutdown() {
+    collect(true);
+    stopVideo();
+    stopThread();
+    release();
+    for (Slot& slot : slots) {
+        if (slot.fence) glDeleteSync((GLsync)slot.fence);
+        if (slot.mapped) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (slot.buffer) glDeleteBuffers(1, &slot.buffer);
+        slot = Slot();
+    }
+    oldest = busy = 0;
+}
+
+void FrameCapture::startThread() {
+    stopping = false;
+    encoder = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+// Lets the encoder finish what is queued before it stops
+void FrameCapture::stopThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (encoder.joinable()) encoder.join();
+}
+
+void FrameCapture::encodeLoop() {
+    // The mapping holds GL's bottom-up rows
+    stbi_flip_vertically_on_write(1);
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        encode(job);
+        std::lock_guard<std::mutex> lock(mutex);
+        encoded[job.slot] = true;
+    }
+}
+
+void FrameCapture::encode(const Job& job) {
+    if (!job.path.empty()) {
+        if (stbi_write_png(job.path.c_str(), job.width, job.height, 4, job.pixels, job.width * 4))
+            std::cout << "Screenshot saved: " << job.path << std::endl;
+        else
+            std::cout << "Failed to save screenshot: " << job.path << std::endl;
+    }
+    if (job.video) writeVideoFrame(job);
+}
+
+// One FRAME of the stream: the Y plane, then Cb and Cr at half resolution
+void FrameCapture::writeVideoFrame(const Job& job) {
+    int width = job.width, height = job.height;
+    int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    size_t lumaBytes = (size_t)width * height, chromaBytes = (size_t)chromaWidth * chromaHeight;
+    planes.resize(lumaBytes + 2 * chromaBytes);
+    unsigned char* luma = planes.data();
+    unsigned char* blue = luma + lumaBytes;
+    unsigned char* red = blue + chromaBytes;
+    // Rows come bottom first, the stream wants the top first
+    auto row = [&job, width, height](int y) { return job.pixels + (size_t)(height - 1 - y) * width * 4; };
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* rgba = row(y);
+        unsigned char* out = luma + (size_t)y * width;
+        for (int x = 0; x < width; ++x) {
+            out[x] = lumaOf(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+        }
+    }
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        const unsigned char* upper = row(cy * 2);
+        const unsigned char* lower = row(std::min(cy * 2 + 1, height - 1));
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            int x0 = cx * 2 * 4, x1 = std::min(cx * 2 + 1, width - 1) * 4;
+            const unsigned char* corners[4] = { upper + x0, upper + x1, lower + x0, lower + x1 };
+            int r = 0, g = 0, b = 0;
+            for (const unsigned char* p : corners) {
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            size_t i = (size_t)cy * chromaWidth + cx;
+            blue[i] = blueDifferenceOf((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+            red[i] = redDifferenceOf((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+        }
+    }
+    std::ofstream& file = *job.video;
+    file << "FRAME\n";
+    file.write((const char*)planes.data(), (std::streamsize)planes.size());
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Screenshots and videos of the window without stalling the frame. Each
+// captured frame is read from the back buffer into one of a ring of pixel
+// buffer objects, so glReadPixels only queues a copy on the GPU; a fence
+// says when the copy is done, a frame or two later, and only then is the
+// buffer mapped. The encoder thread reads the pixels straight from the
+// mapping and the GL thread unmaps the buffer once it is done, so the
+// frame never touches the pixels itself. Screenshots are written as PNG
+// with stb_image_write, videos as an uncompressed YUV4MPEG2 (.y4m) stream
+// that ffmpeg and most players read.
+//
+// A frame is dropped rather than waited for when every buffer is still
+// being read back or encoded; a video then misses the frame instead of
+// slowing the simulator down.
+//
+// Everything except the encoding runs on the GL thread with the context
+// current.
+class FrameCapture {
+public:
+    explicit FrameCapture(int ringSize = 4);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Writes the next frame to path as a PNG.
+    void screenshot(const std::string& path);
+    // Writes every following frame of width x height to path until
+    // stopVideo(). The stream plays at fps, whatever the frame rate it was
+    // captured at. False when the file cannot be created.
+    bool startVideo(const std::string& path, int width, int height, int fps);
+    // The file is closed once the encoder has written its last frame.
+    void stopVideo();
+    bool recording() const { return video != nullptr; }
+
+    // Call once per frame after drawing, before swapping buffers: collects
+    // finished readbacks and starts one of this frame when a capture is due.
+    void endFrame(int width, int height);
+
+    // Frames read back, and dropped, since the last startVideo().
+    int framesCaptured() const { return captured; }
+    int framesDropped() const { return dropped; }
+    // Main thread time endFrame() took while capturing, per frame read back.
+    double averageFrameMs() const { return captured > 0 ? captureMs / captured : 0.0; }
+
+    // Writes out everything queued, closes the video and deletes the
+    // buffers. Call before the context is destroyed; the destructor only
+    // stops the encoder.
+    void shutdown();
+
+private:
+    // One frame read back, for a screenshot, a video or both
+    struct Job {
+        size_t slot = 0;
+        std::string path;                   // of the screenshot, empty for none
+        std::shared_ptr<std::ofstream> video;
+        int width = 0;
+        int height = 0;
+        const unsigned char* pixels = nullptr;  // the mapping, RGBA, bottom row first
+    };
+
+    enum SlotState { SLOT_FREE, SLOT_READING, SLOT_ENCODING };
+
+    struct Slot {
+        unsigned int buffer = 0;
+        size_t bytes = 0;                   // allocated in buffer
+        SlotState state = SLOT_FREE;
+        void* fence = nullptr;              // GLsync of the readback
+        bool mapped = false;
+        Job job;
+    };
+
+    void collect(bool wait);
+    void release();
+    void startThread();
+    void stopThread();
+    void encodeLoop();
+    void encode(const Job& job);
+    void writeVideoFrame(const Job& job);
+
+    std::vector<Slot> slots;
+    size_t oldest = 0;                      // slot read back longest ago
+    size_t busy = 0;                        // slots not free, from oldest on
+    std::string screenshotPath;             // empty when none is due
+    std::shared_ptr<std::ofstream> video;   // shared with the frames still queued
+    int videoWidth = 0;
+    int videoHeight = 0;
+    int captured = 0;
+    int dropped = 0;
+    double captureMs = 0.0;
+
+    // Shared with the encoder
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<bool> encoded;              // per slot, done with the mapping
+    bool stopping = false;
+    std::thread encoder;
+
+    // Encoder thread only
+    std::vector<unsigned char> planes;      // one frame's Y, Cb and Cr
+};
@@ -0,0 +1,90 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace {
+    // Set while a thread executes chunks, so nested parallelFor calls run
+    // inline instead of waiting on the pool they are already part of.
+    thread_local bool insideJob = false;
+}
+
+JobSystem::JobSystem(unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::run(int count, int grain, RangeFn fn, void* ctx) {
+    if (count <= 0) return;
+    grain = std::max(1, grain);
+
+    if (workers.empty() || count <= grain || insideJob) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobFn = fn;
+        jobCtx = ctx;
+        jobCount = count;
+        jobGrain = grain;
+        nextIndex.store(0, std::memory_order_relaxed);
+        busyWorkers = (unsigned int)workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    executeChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busyWorkers == 0; });
+}
+
+void JobSystem::executeChunks() {
+    insideJob = true;
+    for (;;) {
+        int begin = nextIndex.fetch_add(jobGrain, std::memory_order_relaxed);
+        if (begin >= jobCount) break;
+        jobFn(jobCtx, begin, std::min(begin + jobGrain, jobCount));
+    }
+    insideJob = false;
+}
+
+void JobSystem::workerLoop() {
+    unsigned int seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        executeChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+JobSystem& jobSystem() {
+    static JobSystem pool;
+    return pool;
+}
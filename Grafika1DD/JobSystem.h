@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fork-join thread pool shared by the simulation. parallelFor() splits
+// [0, count) into chunks of `grain` items and runs them on the workers and
+// the calling thread, returning once every chunk is done. The callable is
+// passed by pointer, so dispatching a job never allocates.
+class JobSystem {
+public:
+    explicit JobSystem(unsigned int threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Number of threads that execute chunks, including the caller.
+    unsigned int threadCount() const { return (unsigned int)workers.size() + 1; }
+
+    // fn(begin, end) is called for disjoint ranges covering [0, count).
+    template <typename Fn>
+    void parallelFor(int count, int grain, Fn&& fn) {
+        typedef typename std::remove_reference<Fn>::type FnType;
+        run(count, grain,
+            [](void* ctx, int begin, int end) { (*static_cast<FnType*>(ctx))(begin, end); },
+            const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+
+private:
+    typedef void (*RangeFn)(void* ctx, int begin, int end);
+
+    void run(int count, int grain, RangeFn fn, void* ctx);
+    void executeChunks();
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;          // one parallelFor at a time
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned int generation = 0;
+    unsigned int busyWorkers = 0;
+    bool stopping = false;
+
+    // Current job
+    RangeFn jobFn = nullptr;
+    void* jobCtx = nullptr;
+    int jobCount = 0;
+    int jobGrain = 1;
+    std::atomic<int> nextIndex{ 0 };
+};
+
+// Process-wide pool sized to the hardware.
+JobSystem& jobSystem();
@@ -0,0 +1,566 @@
+#include "MeshImporter.h"
+#include "AssetPack.h"
+#include "FileWatcher.h"
+#include "JobSystem.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+namespace {
+    const char cacheMagic[4] = { 'R', 'C', 'M', 'S' };
+    const uint32_t cacheVersion = 1;
+    const size_t cacheHeaderBytes = 64;
+    // Chunks per thread, so a chunk full of faces does not hold up the rest
+    const int chunksPerThread = 4;
+    const size_t minChunkBytes = 64 * 1024;
+
+    // One face corner. OBJ indices are 1-based and negative ones count back
+    // from the last element seen; a chunk cannot know how many came before
+    // it, so those are kept chunk-relative until every chunk is counted.
+    struct Corner {
+        int v, t, n;                // -1 for an absent uv or normal
+        unsigned char relative;     // bit per index: 1 v, 2 t, 4 n
+    };
+
+    struct Chunk {
+        std::vector<float> positions, texcoords, normals;
+        std::vector<Corner> corners;    // three per triangle
+        int positionBase = 0, texcoordBase = 0, normalBase = 0;
+        const char* error = nullptr;
+    };
+
+    struct CornerKey {
+        int v, t, n;
+        bool operator==(const CornerKey& o) const { return v == o.v && t == o.t && n == o.n; }
+    };
+
+    struct CornerKeyHash {
+        size_t operator()(const CornerKey& k) const {
+            uint64_t h = (uint64_t)(uint32_t)k.v * 0x9E3779B97F4A7C15ull;
+            h ^= ((uint64_t)(uint32_t)k.t + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= ((uint64_t)(uint32_t)k.n + 0x165667B19E3779F9ull) * 0x94D049BB133111EBull;
+            return (size_t)(h ^ (h >> 31));
+        }
+    };
+
+    bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    const char* skipSpace(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) ++p;
+        return p;
+    }
+
+    // strtod depends on the C locale and is several times slower; this
+    // reads the plain decimal and exponent forms exporters write
+    const char* parseFloat(const char* p, const char* end, float& out) {
+        p = skipSpace(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        double value = 0.0;
+        bool digits = false;
+        for (; p < end && isDigit(*p); ++p, digits = true) value = value * 10.0 + (*p - '0');
+        if (p < end && *p == '.') {
+            double scale = 0.1;
+            for (++p; p < end && isDigit(*p); ++p, scale *= 0.1, digits = true) value += (*p - '0') * scale;
+        }
+        if (!digits) return nullptr;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+            int exponent = 0;
+            for (; p < end && isDigit(*p); ++p) exponent = std::min(exponent * 10 + (*p - '0'), 400);
+            value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+        }
+        out = (float)(negative ? -value : value);
+        return p;
+    }
+
+    const char* parseInt(const char* p, const char* end, int& out) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        if (p >= end || !isDigit(*p)) return nullptr;
+        long long value = 0;
+        for (; p < end && isDigit(*p); ++p) value = std::min(value * 10 + (*p - '0'), 1LL << 31);
+        out = (int)(negative ? -value : std::min(value, (long long)INT32_MAX));
+        return p;
+    }
+
+    bool parseFloats(const char* p, const char* end, int count, std::vector<float>& out) {
+        for (int i = 0; i < count; ++i) {
+            float value;
+            p = parseFloat(p, end, value);
+            if (!p) return false;
+            out.push_back(value);
+        }
+        return true;
+    }
+
+    // OBJ index to a 0-based one, chunk-relative when negative
+    bool resolveIndex(int index, int localCount, int& out, bool& relative) {
+        if (index == 0) return false;
+        relative = index < 0;
+        out = index > 0 ? index - 1 : localCount + index;
+        return true;
+    }
+
+    // "v", "v/t", "v//n" or "v/t/n"
+    const char* parseCorner(const char* p, const char* end, const Chunk& chunk, Corner& corner) {
+        int index;
+        bool relative;
+        corner.t = corner.n = -1;
+        corner.relative = 0;
+        p = parseInt(p, end, index);
+        if (!p || !resolveIndex(index, (int)chunk.positions.size() / 3, corner.v, relative)) return nullptr;
+        if (relative) corner.relative |= 1;
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/') {
+                p = parseInt(p, end, index);
+                if (!p || !resolveIndex(index, (int)chunk.texcoords.size() / 2, corner.t, relative)) return nullptr;
+                if (relative) corner.relative |= 2;
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                p = parseInt(p, end, index);
+                if (!p || !resolveIndex(index, (int)chunk.normals.size() / 3, corner.n, relative)) return nullptr;
+                if (relative) corner.relative |= 4;
+            }
+        }
+        return p;
+    }
+
+    void parseLine(const char* p, const char* end, Chunk& chunk, std::vector<Corner>& face) {
+        p = skipSpace(p, end);
+        if (end - p < 2) return;
+        if (p[0] == 'v' && isSpace(p[1])) {
+            if (!parseFloats(p + 2, end, 3, chunk.positions)) chunk.error = "bad vertex";
+        }
+        else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && isSpace(p[2])) {
+            if (!parseFloats(p + 3, end, 2, chunk.texcoords)) chunk.error = "bad texture coordinate";
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && isSpace(p[2])) {
+            if (!parseFloats(p + 3, end, 3, chunk.normals)) chunk.error = "bad normal";
+        }
+        else if (p[0] == 'f' && isSpace(p[1])) {
+            face.clear();
+            p = skipSpace(p + 2, end);
+            while (p < end && *p != '#') {
+                Corner corner;
+                p = parseCorner(p, end, chunk, corner);
+                if (!p) {
+                    chunk.error = "bad face";
+                    return;
+                }
+                face.push_back(corner);
+                p = skipSpace(p, end);
+            }
+            if (face.size() < 3) {
+                chunk.error = "face with fewer than 3 corners";
+                return;
+            }
+            for (size_t i = 1; i + 1 < face.size(); ++i) {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i]);
+                chunk.corners.push_back(face[i + 1]);
+            }
+        }
+    }
+
+    void parseChunk(const char* p, const char* end, Chunk& chunk) {
+        std::vector<Corner> face;
+        while (p < end && !chunk.error) {
+            const char* lineEnd = (const char*)std::memchr(p, '\n', end - p);
+            if (!lineEnd) lineEnd = end;
+            parseLine(p, lineEnd, chunk, face);
+            p = lineEnd + 1;
+        }
+    }
+
+    // Area-weighted smooth normals for vertices that came without one
+    void generateNormals(MeshData& mesh, const std::vector<bool>& missing) {
+        float* v = mesh.vertices.data();
+        const int s = mesh.stride;
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+            glm::vec3 pa(v[a * s], v[a * s + 1], v[a * s + 2]);
+            glm::vec3 pb(v[b * s], v[b * s + 1], v[b * s + 2]);
+            glm::vec3 pc(v[c * s], v[c * s + 1], v[c * s + 2]);
+            glm::vec3 normal = glm::cross(pb - pa, pc - pa);
+            for (uint32_t index : { a, b, c }) {
+                if (!missing[index]) continue;
+                for (int k = 0; k < 3; ++k) v[index * s + 3 + k] += normal[k];
+            }
+        }
+        for (size_t index = 0; index < missing.size(); ++index) {
+            if (!missing[index]) continue;
+            float* n = &v[index * s + 3];
+            glm::vec3 normal(n[0], n[1], n[2]);
+            float length = glm::length(normal);
+            normal = length > 1e-12f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            n[0] = normal.x;
+            n[1] = normal.y;
+            n[2] = normal.z;
+        }
+    }
+
+    // Per-vertex tangents from the uv gradients, orthogonalised against the
+    // normal, with the bitangent's handedness in w
+    void generateTangents(MeshData& mesh) {
+        float* v = mesh.vertices.data();
+        const int s = mesh.stride;
+        size_t count = mesh.vertices.size() / s;
+        std::vector<glm::vec3> tangents(count, glm::vec3(0.0f)), bitangents(count, glm::vec3(0.0f));
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            uint32_t id[3] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+            glm::vec3 p[3];
+            glm::vec2 uv[3];
+            for (int k = 0; k < 3; ++k) {
+                const float* x = &v[id[k] * s];
+                p[k] = glm::vec3(x[0], x[1], x[2]);
+                uv[k] = glm::vec2(x[6], x[7]);
+            }
+            glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+            glm::vec2 d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+            float det = d1.x * d2.y - d2.x * d1.y;
+            if (std::fabs(det) < 1e-12f) continue;
+            float r = 1.0f / det;
+            glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+            glm::vec3 b = (e2 * d1.x - e1 * d2.x) * r;
+            for (int k = 0; k < 3; ++k) {
+                tangents[id[k]] += t;
+                bitangents[id[k]] += b;
+            }
+        }
+        for (size_t index = 0; index < count; ++index) {
+            float* x = &v[index * s];
+            glm::vec3 n(x[3], x[4], x[5]);
+            glm::vec3 t = tangents[index] - n * glm::dot(n, tangents[index]);
+            float length = glm::length(t);
+            if (length < 1e-12f) {
+                // No usable uv gradient: any direction perpendicular to the normal
+                t = std::fabs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1, 0, 0)) : glm::cross(n, glm::vec3(0, 1, 0));
+                length = glm::length(t);
+            }
+            t /= length;
+            x[8] = t.x;
+            x[9] = t.y;
+            x[10] = t.z;
+            x[11] = glm::dot(glm::cross(n, t), bitangents[index]) < 0.0f ? -1.0f : 1.0f;
+        }
+    }
+
+    void storeU32(unsigned char* at, uint32_t value) {
+        for (int i = 0; i < 4; ++i) at[i] = (unsigned char)(value >> (i * 8));
+    }
+
+    uint32_t loadU32(const unsigned char* at) {
+        return at[0] | (at[1] << 8) | (at[2] << 16) | ((uint32_t)at[3] << 24);
+    }
+
+    uint64_t loadU64(const unsigned char* at) {
+        return loadU32(at) | ((uint64_t)loadU32(at + 4) << 32);
+    }
+
+    // Header: magic, version, flags, stride, vertex count, index count,
+    // source size, source time, bounds; the blobs follow at 64 bytes.
+    // Blobs are raw floats and uint32s, so caches are little-endian only.
+    void writeHeader(unsigned char* header, const MeshData& mesh, uint64_t size, uint64_t time) {
+        std::memset(header, 0, cacheHeaderBytes);
+        std::memcpy(header, cacheMagic, 4);
+        storeU32(header + 4, cacheVersion);
+        storeU32(header + 8, (uint32_t)mesh.flags);
+        storeU32(header + 12, (uint32_t)mesh.stride);
+        storeU32(header + 16, (uint32_t)(mesh.vertices.size() / mesh.stride));
+        storeU32(header + 20, (uint32_t)mesh.indices.size());
+        storeU32(header + 24, (uint32_t)size);
+        storeU32(header + 28, (uint32_t)(size >> 32));
+        storeU32(header + 32, (uint32_t)time);
+        storeU32(header + 36, (uint32_t)(time >> 32));
+        std::memcpy(header + 40, &mesh.boundsMin[0], 12);
+        std::memcpy(header + 52, &mesh.boundsMax[0], 12);
+    }
+
+    // Validates a header against the flags and, when given, the source stamp
+    bool readHeader(const unsigned char* header, size_t available, int flags, const uint64_t* stamp,
+        MeshView& view) {
+        if (available < cacheHeaderBytes || std::memcmp(header, cacheMagic, 4) != 0) return false;
+        if (loadU32(header + 4) != cacheVersion || (int)loadU32(header + 8) != flags) return false;
+        if (stamp && (loadU64(header + 24) != stamp[0] || loadU64(header + 32) != stamp[1])) return false;
+        view.flags = flags;
+        view.stride = (int)loadU32(header + 12);
+        view.vertexCount = loadU32(header + 16);
+        view.indexCount = loadU32(header + 20);
+        std::memcpy(&view.boundsMin[0], header + 40, 12);
+        std::memcpy(&view.boundsMax[0], header + 52, 12);
+        return view.stride == ((flags & MESH_TANGENTS) ? 12 : 8);
+    }
+
+    size_t blobBytes(const MeshView& view) {
+        return view.vertexCount * view.stride * sizeof(float) + view.indexCount * sizeof(uint32_t);
+    }
+
+    bool writeCache(const std::string& path, const MeshData& mesh, uint64_t size, uint64_t time) {
+        unsigned char header[cacheHeaderBytes];
+        writeHeader(header, mesh, size, time);
+        std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write((const char*)header, cacheHeaderBytes);
+        file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+        file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        if (file) return true;
+        file.close();
+        std::remove(path.c_str());
+        return false;
+    }
+
+    bool readCache(const std::string& path, int flags, uint64_t size, uint64_t time, MeshData& mesh) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) return false;
+        unsigned char header[cacheHeaderBytes];
+        if (!file.read((char*)header, cacheHeaderBytes)) return false;
+        const uint64_t stamp[2] = { size, time };
+        MeshView view;
+        if (!readHeader(header, cacheHeaderBytes, flags, stamp, view)) return false;
+        // The counts must match the file before they size anything, so a
+        // truncated or corrupt cache is re-imported instead of allocated for
+        if (!file.seekg(0, std::ios::end) || (uint64_t)file.tellg() != cacheHeaderBytes + blobBytes(view)) return false;
+        if (!file.seekg((std::streamoff)cacheHeaderBytes)) return false;
+
+        mesh.flags = flags;
+        mesh.stride = view.stride;
+        mesh.vertices.resize(view.vertexCount * view.stride);
+        mesh.indices.resize(view.indexCount);
+        mesh.boundsMin = view.boundsMin;
+        mesh.boundsMax = view.boundsMax;
+        if (!file.read((char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(float))) return false;
+        if (!file.read((char*)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t))) return false;
+        for (uint32_t index : mesh.indices) {
+            if (index >= view.vertexCount) return false;
+        }
+        return true;
+    }
+}
+
+MeshView MeshData::view() const {
+    MeshView v;
+    v.vertices = vertices.data();
+    v.indices = indices.data();
+    v.vertexCount = vertices.size() / stride;
+    v.indexCount = indices.size();
+    v.stride = stride;
+    v.flags = flags;
+    v.boundsMin = boundsMin;
+    v.boundsMax = boundsMax;
+    return v;
+}
+
+std::string meshCachePath(const std::string& source) {
+    size_t slash = source.find_last_of("/\\");
+    size_t dot = source.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return source + ".rcms";
+    return source.substr(0, dot) + ".rcms";
+}
+
+bool importObj(const char* text, size_t size, int flags, MeshData& mesh, std::string& error) {
+    // Chunk boundaries moved forward to line starts
+    JobSystem& jobs = jobSystem();
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(jobs.threadCount() * chunksPerThread, size / minChunkBytes));
+    std::vector<const char*> bounds(chunkCount + 1);
+    const char* end = text + size;
+    bounds[0] = text;
+    bounds[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        const char* at = std::max(bounds[i - 1], text + size * i / chunkCount);
+        const char* newline = at < end ? (const char*)std::memchr(at, '\n', end - at) : nullptr;
+        bounds[i] = newline ? newline + 1 : end;
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+    jobs.parallelFor((int)chunkCount, 1, [&](int begin, int finish) {
+        for (int i = begin; i < finish; ++i) parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    int positionCount = 0, texcoordCount = 0, normalCount = 0;
+    size_t cornerCount = 0;
+    for (Chunk& chunk : chunks) {
+        if (chunk.error) {
+            error = chunk.error;
+            return false;
+        }
+        chunk.positionBase = positionCount;
+        chunk.texcoordBase = texcoordCount;
+        chunk.normalBase = normalCount;
+        positionCount += (int)chunk.positions.size() / 3;
+        texcoordCount += (int)chunk.texcoords.size() / 2;
+        normalCount += (int)chunk.normals.size() / 3;
+        cornerCount += chunk.corners.size();
+    }
+    if (cornerCount > UINT32_MAX) {
+        error = "model too large";
+        return false;
+    }
+
+    // Negative indices become absolute now that every chunk's base is known
+    jobs.parallelFor((int)chunkCount, 1, [&](int begin, int finish) {
+        for (int i = begin; i < finish; ++i) {
+            Chunk& chunk = chunks[i];
+            for (Corner& c : chunk.corners) {
+                if (c.relative & 1) c.v += chunk.positionBase;
+                if (c.relative & 2) c.t += chunk.texcoordBase;
+                if (c.relative & 4) c.n += chunk.normalBase;
+                if (c.v < 0 || c.v >= positionCount || c.t >= texcoordCount || c.n >= normalCount
+                    || ((c.relative & 2) && c.t < 0) || ((c.relative & 4) && c.n < 0)) {
+                    chunk.error = "face index out of range";
+                    return;
+                }
+            }
+        }
+    });
+    for (const Chunk& chunk : chunks) {
+        if (chunk.error) {
+            error = chunk.error;
+            return false;
+        }
+    }
+
+    std::vector<float> positions, texcoords, normals;
+    positions.reserve((size_t)positionCount * 3);
+    texcoords.reserve((size_t)texcoordCount * 2);
+    normals.reserve((size_t)normalCount * 3);
+    for (const Chunk& chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    }
+
+    mesh.flags = flags;
+    mesh.stride = (flags & MESH_TANGENTS) ? 12 : 8;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.indices.reserve(cornerCount);
+    std::vector<bool> missingNormal;
+    std::unordered_map<CornerKey, uint32_t, CornerKeyHash> welded;
+    welded.reserve(cornerCount / 3);
+    for (const Chunk& chunk : chunks) {
+        for (const Corner& c : chunk.corners) {
+            CornerKey key = { c.v, c.t, c.n };
+            auto inserted = welded.emplace(key, (uint32_t)missingNormal.size());
+            mesh.indices.push_back(inserted.first->second);
+            if (!inserted.second) continue;
+
+            const float* p = &positions[(size_t)c.v * 3];
+            const float* n = c.n >= 0 ? &normals[(size_t)c.n * 3] : nullptr;
+            const float* t = c.t >= 0 ? &texcoords[(size_t)c.t * 2] : nullptr;
+            mesh.vertices.insert(mesh.vertices.end(), { p[0], p[1], p[2],
+                n ? n[0] : 0.0f, n ? n[1] : 0.0f, n ? n[2] : 0.0f, t ? t[0] : 0.0f, t ? t[1] : 0.0f });
+            if (mesh.stride == 12) mesh.vertices.insert(mesh.vertices.end(), { 0.0f, 0.0f, 0.0f, 1.0f });
+            missingNormal.push_back(n == nullptr);
+        }
+    }
+    if (mesh.indices.empty()) {
+        error = "no faces";
+        return false;
+    }
+
+    if (std::find(missingNormal.begin(), missingNormal.end(), true) != missingNormal.end()) {
+        generateNormals(mesh, missingNormal);
+    }
+    if (flags & MESH_TANGENTS) generateTangents(mesh);
+
+    mesh.boundsMin = glm::vec3(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+    mesh.boundsMax = mesh.boundsMin;
+    for (size_t i = 0; i < mesh.vertices.size(); i += mesh.stride) {
+        glm::vec3 p(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+        mesh.boundsMin = glm::min(mesh.boundsMin, p);
+        mesh.boundsMax = glm::max(mesh.boundsMax, p);
+    }
+    return true;
+}
+
+bool loadMesh(const std::string& path, int flags, MeshData& mesh, MeshImportStats& stats, std::string& error) {
+    auto start = std::chrono::steady_clock::now();
+    stats = MeshImportStats();
+    uint64_t size, time;
+    if (!fileStamp(path, size, time)) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string cache = meshCachePath(path);
+    stats.fromCache = readCache(cache, flags, size, time, mesh);
+    if (!stats.fromCache) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            error = "cannot read " + path;
+            return false;
+        }
+        std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!importObj(text.data(), text.size(), flags, mesh, error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        writeCache(cache, mesh, size, time);
+    }
+
+    stats.vertices = mesh.vertices.size() / mesh.stride;
+    stats.triangles = mesh.indices.size() / 3;
+    stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool findPackedMesh(const AssetPack& pack, const std::string& path, int flags, MeshView& view) {
+    AssetView asset = pack.find(meshCachePath(path));
+    if (!asset || !readHeader(asset.data, asset.size, flags, nullptr, view)) return false;
+    if (asset.size - cacheHeaderBytes < blobBytes(view)) return false;
+    // The pack aligns blobs, so the floats and indices can be used in place
+    view.vertices = (const float*)(asset.data + cacheHeaderBytes);
+    view.indices = (const uint32_t*)(asset.data + cacheHeaderBytes + view.vertexCount * view.stride * sizeof(float));
+    for (size_t i = 0; i < view.indexCount; ++i) {
+        if (view.indices[i] >= view.vertexCount) return false;
+    }
+    return true;
+}
+
+GpuMesh uploadMesh(const MeshView& mesh) {
+    GpuMesh gpu;
+    glGenVertexArrays(1, &gpu.vao);
+    glGenBuffers(1, &gpu.vbo);
+    glGenBuffers(1, &gpu.ebo);
+
+    glBindVertexArray(gpu.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * mesh.stride * sizeof(float), mesh.vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * sizeof(uint32_t), mesh.indices, GL_STATIC_DRAW);
+
+    GLsizei stride = mesh.stride * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    if (mesh.flags & MESH_TANGENTS) {
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+    }
+    glBindVertexArray(0);
+
+    gpu.indexCount = (int)mesh.indexCount;
+    return gpu;
+}
+
+void deleteMesh(GpuMesh& mesh) {
+    if (mesh.vao) glDeleteVertexArrays(1, &mesh.vao);
+    if (mesh.vbo) glDeleteBuffers(1, &mesh.vbo);
+    if (mesh.ebo) glDeleteBuffers(1, &mesh.ebo);
+    mesh = GpuMesh();
+}
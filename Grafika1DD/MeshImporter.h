@@ -0,0 +1,81 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AssetPack;
+
+// Wavefront OBJ import into the renderer's interleaved layout: position,
+// normal and texture coordinates (8 floats, attributes 0-2 like the
+// built-in meshes), plus a tangent with handedness in w (attribute 3) when
+// MESH_TANGENTS is asked for. Faces are fan-triangulated, corners with the
+// same position/uv/normal triple are welded into one vertex, and missing
+// normals are generated smooth. Materials, groups and lines are ignored.
+//
+// The text is parsed in chunks on the job system; indices are resolved and
+// vertices welded afterwards in file order, so the result does not depend
+// on the thread count.
+//
+// loadMesh() keeps a binary cache next to the source (car.obj -> car.rcms)
+// holding the upload-ready vertex and index blobs, tagged with the source's
+// size and modification time. A later load is one read per blob.
+
+enum MeshFlags {
+    MESH_TANGENTS = 1
+};
+
+struct MeshView {
+    const float* vertices = nullptr;
+    const uint32_t* indices = nullptr;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    int stride = 8;             // floats per vertex
+    int flags = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+struct MeshData {
+    int flags = 0;
+    int stride = 8;
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    MeshView view() const;
+};
+
+struct MeshImportStats {
+    bool fromCache;
+    size_t vertices;
+    size_t triangles;
+    double loadMs;
+};
+
+// Where the cache for a source model lives: car.obj -> car.rcms.
+std::string meshCachePath(const std::string& source);
+
+// Parses OBJ text. False with a message for malformed faces or indices.
+bool importObj(const char* text, size_t size, int flags, MeshData& mesh, std::string& error);
+
+// The cached mesh if it is current, else imports the OBJ and rewrites the
+// cache. A cache that cannot be written only costs the next load a parse.
+bool loadMesh(const std::string& path, int flags, MeshData& mesh, MeshImportStats& stats, std::string& error);
+
+// A cache packed into an asset pack (see AssetPack.h), viewed in place with
+// no copy. Packed caches are not checked against the source.
+bool findPackedMesh(const AssetPack& pack, const std::string& path, int flags, MeshView& view);
+
+// GL objects of an uploaded mesh; needs the context current.
+struct GpuMesh {
+    unsigned int vao = 0;
+    unsigned int vbo = 0;
+    unsigned int ebo = 0;
+    int indexCount = 0;
+};
+
+GpuMesh uploadMesh(const MeshView& mesh);
+void deleteMesh(GpuMesh& mesh);
@@ -0,0 +1,402 @@
+#include "DetMath.h"
+#include "NavGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+
+#define STBCC_GRID_COUNT_X_LOG2 8
+#define STBCC_GRID_COUNT_Y_LOG2 8
+#define STB_CONNECTED_COMPONENTS_IMPLEMENTATION
+#include "stb_connected_components.h"
+
+namespace {
+    // Travel cost per SurfaceId; walls are solid and never entered
+    const float surfaceCost[SURFACE_COUNT] = {
+        1.0f,   // none
+        1.0f,   // asphalt
+        2.0f,   // grass
+        0.0f,   // barrier
+        0.0f,   // building
+        0.0f,   // tree
+        1.0f,   // kerb
+        4.0f    // gravel
+    };
+
+    bool isWall(SurfaceId surface) {
+        return surface == SURFACE_BARRIER || surface == SURFACE_BUILDING || surface == SURFACE_TREE;
+    }
+
+    // How far a blocked start or goal is moved to the nearest open cell
+    const int snapRadius = 8;
+
+    const int regionCount = NavGrid::size * NavGrid::size;
+    const uint8_t noRegion = 255;
+
+    // Grows the set cells of mask by radius cells in every direction
+    // (a square, one pass along each axis).
+    void dilate(std::vector<uint8_t>& mask, int size, int radius) {
+        std::vector<uint8_t> rows(mask.size());
+        for (int j = 0; j < size; ++j) {
+            for (int i = 0; i < size; ++i) {
+                uint8_t v = 0;
+                for (int k = std::max(0, i - radius); k <= std::min(size - 1, i + radius) && !v; ++k) v = mask[j * size + k];
+                rows[j * size + i] = v;
+            }
+        }
+        for (int j = 0; j < size; ++j) {
+            for (int i = 0; i < size; ++i) {
+                uint8_t v = 0;
+                for (int k = std::max(0, j - radius); k <= std::min(size - 1, j + radius) && !v; ++k) v = rows[k * size + i];
+                mask[j * size + i] = v;
+            }
+        }
+    }
+
+    // Starts a new query generation, clearing the marks when the counter wraps
+    uint32_t nextStamp(NavSearch& search) {
+        if (search.cost.size() != (size_t)regionCount) {
+            search.cost.assign(regionCount, 0.0f);
+            search.parent.assign(regionCount, -1);
+            search.visited.assign(regionCount, 0);
+            search.corridor.assign(regionCount, 0);
+        }
+        if (++search.stamp == 0) {
+            std::fill(search.visited.begin(), search.visited.end(), 0u);
+            std::fill(search.corridor.begin(), search.corridor.end(), 0u);
+            search.stamp = 1;
+        }
+        return search.stamp;
+    }
+
+    void pushOpen(NavSearch& search, float priority, int node) {
+        search.open.push_back(std::make_pair(priority, node));
+        std::push_heap(search.open.begin(), search.open.end(), std::greater<std::pair<float, int>>());
+    }
+
+    std::pair<float, int> popOpen(NavSearch& search) {
+        std::pop_heap(search.open.begin(), search.open.end(), std::greater<std::pair<float, int>>());
+        std::pair<float, int> top = search.open.back();
+        search.open.pop_back();
+        return top;
+    }
+}
+
+const int NavGrid::size;
+const int NavGrid::clusterCells;
+const int NavGrid::clustersPerSide;
+
+NavGrid::NavGrid() {
+    solid.assign((size_t)size * size, 1);
+    costs.assign((size_t)size * size, 1.0f);
+    regionOf.assign((size_t)size * size, noRegion);
+    clusters.resize(clustersPerSide * clustersPerSide);
+}
+
+NavGrid::~NavGrid() {
+    std::free(connectivity);
+}
+
+void NavGrid::update(const SurfaceGrid& surfaces) {
+    corner = surfaces.origin();
+    cell = surfaces.cellSize();
+    invCell = 1.0f / cell;
+
+    std::vector<uint8_t> newSolid((size_t)size * size, 1);
+    std::vector<float> newCosts((size_t)size * size, 1.0f);
+    int cellsX = std::min(size, surfaces.cellsX()), cellsZ = std::min(size, surfaces.cellsZ());
+    for (int j = 0; j < cellsZ; ++j) {
+        for (int i = 0; i < cellsX; ++i) {
+            SurfaceId surface = surfaces.at(i, j);
+            newSolid[j * size + i] = isWall(surface) ? 1 : 0;
+            newCosts[j * size + i] = std::max(surfaceCost[surface], 1.0f);
+        }
+    }
+    dilate(newSolid, size, (int)std::ceil(carHalfExtents.x * invCell));
+
+    std::vector<uint8_t> dirty(clusters.size(), 0);
+    if (!connectivity) {
+        connectivity = (stbcc_grid*)std::malloc(stbcc_grid_sizeof());
+        solid = newSolid;
+        costs = newCosts;
+        stbcc_init_grid(connectivity, solid.data(), size, size);
+        std::fill(dirty.begin(), dirty.end(), 1);
+    }
+    else {
+        stbcc_update_batch_begin(connectivity);
+        for (int j = 0; j < size; ++j) {
+            for (int i = 0; i < size; ++i) {
+                int index = j * size + i;
+                if (newSolid[index] != solid[index]) stbcc_update_grid(connectivity, i, j, newSolid[index]);
+                if (newSolid[index] != solid[index] || newCosts[index] != costs[index]) {
+                    dirty[(j / clusterCells) * clustersPerSide + i / clusterCells] = 1;
+                }
+            }
+        }
+        stbcc_update_batch_end(connectivity);
+        solid.swap(newSolid);
+        costs.swap(newCosts);
+    }
+
+    lastChanged = 0;
+    for (int c = 0; c < (int)clusters.size(); ++c) {
+        if (!dirty[c]) continue;
+        buildRegions(c % clustersPerSide, c / clustersPerSide);
+        ++lastChanged;
+    }
+    // Drop links into rebuilt clusters from the clusters that were kept
+    for (int c = 0; c < (int)clusters.size(); ++c) {
+        if (dirty[c]) continue;
+        for (Region& region : clusters[c]) {
+            region.links.erase(std::remove_if(region.links.begin(), region.links.end(),
+                [&](const Link& link) { return dirty[link.region / regionsPerCluster] != 0; }), region.links.end());
+        }
+    }
+    // Relink every boundary that touches a rebuilt cluster, once
+    for (int c = 0; c < (int)clusters.size(); ++c) {
+        int cx = c % clustersPerSide, cz = c / clustersPerSide;
+        if (cx + 1 < clustersPerSide && (dirty[c] || dirty[c + 1])) linkClusters(c, c + 1);
+        if (cz + 1 < clustersPerSide && (dirty[c] || dirty[c + clustersPerSide])) linkClusters(c, c + clustersPerSide);
+    }
+    built = true;
+}
+
+void NavGrid::buildRegions(int cx, int cz) {
+    std::vector<Region>& regions = clusters[cz * clustersPerSide + cx];
+    regions.clear();
+    int i0 = cx * clusterCells, j0 = cz * clusterCells;
+    for (int j = j0; j < j0 + clusterCells; ++j) {
+        for (int i = i0; i < i0 + clusterCells; ++i) regionOf[j * size + i] = noRegion;
+    }
+
+    // Flood fill over orthogonal neighbours, the connectivity stb uses
+    std::vector<int> stack;
+    for (int j = j0; j < j0 + clusterCells; ++j) {
+        for (int i = i0; i < i0 + clusterCells; ++i) {
+            int seed = j * size + i;
+            if (solid[seed] || regionOf[seed] != noRegion) continue;
+
+            uint8_t local = (uint8_t)regions.size();
+            glm::vec2 sum(0.0f);
+            float costSum = 0.0f, minCost = 3.0e38f;
+            int count = 0;
+            regionOf[seed] = local;
+            stack.assign(1, seed);
+            while (!stack.empty()) {
+                int index = stack.back();
+                stack.pop_back();
+                int ci = index % size, cj = index / size;
+                sum += glm::vec2((float)ci, (float)cj);
+                costSum += costs[index];
+                minCost = std::min(minCost, costs[index]);
+                ++count;
+
+                const int di[4] = { 1, -1, 0, 0 }, dj[4] = { 0, 0, 1, -1 };
+                for (int k = 0; k < 4; ++k) {
+                    int ni = ci + di[k], nj = cj + dj[k];
+                    if (ni < i0 || ni >= i0 + clusterCells || nj < j0 || nj >= j0 + clusterCells) continue;
+                    int next = nj * size + ni;
+                    if (solid[next] || regionOf[next] != noRegion) continue;
+                    regionOf[next] = local;
+                    stack.push_back(next);
+                }
+            }
+
+            Region region;
+            region.center = sum / (float)count;
+            region.cost = costSum / count;
+            region.minCost = minCost;
+            regions.push_back(region);
+        }
+    }
+}
+
+void NavGrid::linkClusters(int a, int b) {
+    // b is the right or lower neighbour of a; walk the shared edge
+    bool horizontal = b == a + 1;
+    int ax = a % clustersPerSide, az = a / clustersPerSide;
+    for (int k = 0; k < clusterCells; ++k) {
+        int i = horizontal ? (ax + 1) * clusterCells - 1 : ax * clusterCells + k;
+        int j = horizontal ? az * clusterCells + k : (az + 1) * clusterCells - 1;
+        int from = j * size + i;
+        int to = horizontal ? from + 1 : from + size;
+        if (solid[from] || solid[to]) continue;
+
+        Region& ra = clusters[a][regionOf[from]];
+        Region& rb = clusters[b][regionOf[to]];
+        int ida = a * regionsPerCluster + regionOf[from], idb = b * regionsPerCluster + regionOf[to];
+        bool known = false;
+        for (const Link& link : ra.links) known = known || link.region == idb;
+        if (known) continue;
+
+        glm::vec2 d = rb.center - ra.center;
+        float cost = detSqrt(glm::dot(d, d)) * 0.5f * (ra.cost + rb.cost);
+        ra.links.push_back(Link{ idb, cost });
+        rb.links.push_back(Link{ ida, cost });
+    }
+}
+
+bool NavGrid::cellAt(const glm::vec2& p, int& i, int& j) const {
+    float fi = (p.x - corner.x) * invCell, fj = (p.y - corner.y) * invCell;
+    // Written so a NaN position fails the test too
+    if (!(fi >= 0.0f && fj >= 0.0f && fi < (float)size && fj < (float)size)) return false;
+    i = (int)fi;
+    j = (int)fj;
+    return true;
+}
+
+bool NavGrid::nearestOpen(int& i, int& j) const {
+    if (!solid[j * size + i]) return true;
+    for (int r = 1; r <= snapRadius; ++r) {
+        for (int dj = -r; dj <= r; ++dj) {
+            for (int di = -r; di <= r; ++di) {
+                if (std::max(std::abs(di), std::abs(dj)) != r) continue;
+                int ni = i + di, nj = j + dj;
+                if (ni < 0 || nj < 0 || ni >= size || nj >= size || solid[nj * size + ni]) continue;
+                i = ni;
+                j = nj;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int NavGrid::regionAt(int i, int j) const {
+    uint8_t local = regionOf[j * size + i];
+    if (local == noRegion) return -1;
+    return ((j / clusterCells) * clustersPerSide + i / clusterCells) * regionsPerCluster + local;
+}
+
+bool NavGrid::reachable(const glm::vec2& from, const glm::vec2& to) const {
+    int i0, j0, i1, j1;
+    if (!built || !cellAt(from, i0, j0) || !cellAt(to, i1, j1)) return false;
+    if (!nearestOpen(i0, j0) || !nearestOpen(i1, j1)) return false;
+    return stbcc_query_grid_node_connection(connectivity, i0, j0, i1, j1) != 0;
+}
+
+bool NavGrid::coarsePath(int startRegion, int goalRegion, NavSearch& search) const {
+    uint32_t stamp = nextStamp(search);
+    auto regionOfId = [&](int id) -> const Region& { return clusters[id / regionsPerCluster][id % regionsPerCluster]; };
+    const glm::vec2 goalCenter = regionOfId(goalRegion).center;
+    auto heuristic = [&](int id) {
+        glm::vec2 d = regionOfId(id).center - goalCenter;
+        return detSqrt(glm::dot(d, d));
+    };
+
+    search.open.clear();
+    search.visited[startRegion] = stamp;
+    search.cost[startRegion] = 0.0f;
+    search.parent[startRegion] = -1;
+    pushOpen(search, heuristic(startRegion), startRegion);
+    bool found = false;
+    while (!search.open.empty()) {
+        std::pair<float, int> top = popOpen(search);
+        int node = top.second;
+        if (top.first > search.cost[node] + heuristic(node) + 1e-3f) continue;
+        if (node == goalRegion) {
+            found = true;
+            break;
+        }
+        for (const Link& link : regionOfId(node).links) {
+            float cost = search.cost[node] + link.cost;
+            if (search.visited[link.region] == stamp && cost >= search.cost[link.region]) continue;
+            search.visited[link.region] = stamp;
+            search.cost[link.region] = cost;
+            search.parent[link.region] = node;
+            pushOpen(search, cost + heuristic(link.region), link.region);
+        }
+    }
+    if (!found) return false;
+
+    search.regions.clear();
+    for (int node = goalRegion; node >= 0; node = search.parent[node]) search.regions.push_back(node);
+    std::reverse(search.regions.begin(), search.regions.end());
+    return true;
+}
+
+bool NavGrid::findPath(const glm::vec2& from, const glm::vec2& to, std::vector<glm::vec2>& path,
+    NavSearch& search, int maxRegions) const {
+    path.clear();
+    int si, sj, gi, gj;
+    if (!built || !cellAt(from, si, sj) || !cellAt(to, gi, gj)) return false;
+    if (!nearestOpen(si, sj) || !nearestOpen(gi, gj)) return false;
+    if (!stbcc_query_grid_node_connection(connectivity, si, sj, gi, gj)) return false;
+
+    // Corridor: the regions on the coarse route and their neighbours, so the
+    // cell search can cut corners between neighbouring regions
+    int startRegion = regionAt(si, sj), goalRegion = regionAt(gi, gj);
+    if (!coarsePath(startRegion, goalRegion, search)) return false;
+    // A partial route ends on entering the last region it refines
+    int targetRegion = -1;
+    if (maxRegions > 0 && (int)search.regions.size() > maxRegions) {
+        search.regions.resize(maxRegions);
+        targetRegion = search.regions.back();
+    }
+    uint32_t stamp = nextStamp(search);
+    float minCost = 3.0e38f;
+    for (int id : search.regions) {
+        const Region& region = clusters[id / regionsPerCluster][id % regionsPerCluster];
+        search.corridor[id] = stamp;
+        minCost = std::min(minCost, region.minCost);
+        for (const Link& link : region.links) {
+            search.corridor[link.region] = stamp;
+            minCost = std::min(minCost, clusters[link.region / regionsPerCluster][link.region % regionsPerCluster].minCost);
+        }
+    }
+
+    // Cell A*, eight neighbours without cutting past solid corners
+    // A partial search heads for the centre of its last region. Distances
+    // are scaled by the cheapest cell in the corridor, still a lower bound,
+    // so a route that is all grass does not flood the corridor
+    const int start = sj * size + si;
+    int goal = gj * size + gi;
+    glm::vec2 target((float)gi, (float)gj);
+    if (targetRegion >= 0) target = clusters[targetRegion / regionsPerCluster][targetRegion % regionsPerCluster].center;
+    auto heuristic = [&](int index) {
+        float dx = std::abs((float)(index % size) - target.x), dz = std::abs((float)(index / size) - target.y);
+        return minCost * (std::max(dx, dz) + 0.41421356f * std::min(dx, dz));
+    };
+    search.open.clear();
+    search.visited[start] = stamp;
+    search.cost[start] = 0.0f;
+    search.parent[start] = -1;
+    pushOpen(search, heuristic(start), start);
+    bool found = false;
+    while (!search.open.empty()) {
+        std::pair<float, int> top = popOpen(search);
+        int node = top.second;
+        if (top.first > search.cost[node] + heuristic(node) + 1e-3f) continue;
+        int ci = node % size, cj = node / size;
+        if (node == goal || (targetRegion >= 0 && regionAt(ci, cj) == targetRegion)) {
+            goal = node;
+            found = true;
+            break;
+        }
+        for (int dj = -1; dj <= 1; ++dj) {
+            for (int di = -1; di <= 1; ++di) {
+                if (di == 0 && dj == 0) continue;
+                int ni = ci + di, nj = cj + dj;
+                if (ni < 0 || nj < 0 || ni >= size || nj >= size) continue;
+                int next = nj * size + ni;
+                if (solid[next] || search.corridor[regionAt(ni, nj)] != stamp) continue;
+                bool diagonal = di != 0 && dj != 0;
+                if (diagonal && (solid[cj * size + ni] || solid[nj * size + ci])) continue;
+
+                float cost = search.cost[node] + (diagonal ? 1.41421356f : 1.0f) * costs[next];
+                if (search.visited[next] == stamp && cost >= search.cost[next]) continue;
+                search.visited[next] = stamp;
+                search.cost[next] = cost;
+                search.parent[next] = node;
+                pushOpen(search, cost + heuristic(next), next);
+            }
+        }
+    }
+    if (!found) return false;
+
+    for (int node = goal; node != start; node = search.parent[node]) {
+        path.push_back(corner + (glm::vec2((float)(node % size), (float)(node / size)) + 0.5f) * cell);
+    }
+    std::reverse(path.begin(), path.end());
+    return true;
+}
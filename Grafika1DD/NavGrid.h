@@ -0,0 +1,95 @@
+#pragma once
+#include "SurfaceGrid.h"
+#include "stb_connected_components.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Scratch memory for path queries, kept between calls so a query does not
+// allocate. Use one per thread that searches.
+struct NavSearch {
+    std::vector<float> cost;
+    std::vector<int> parent;
+    std::vector<uint32_t> visited;      // == stamp where cost and parent are valid
+    std::vector<uint32_t> corridor;     // == stamp for regions the cell search may enter
+    std::vector<std::pair<float, int>> open;
+    std::vector<int> regions;
+    uint32_t stamp = 0;
+};
+
+// Where cars can drive, on the surface grid's cells: everything except
+// walls, with the walls grown by half a car width so a route keeps the
+// car's centre clear of them. Each surface has a travel cost, so routes
+// prefer asphalt to grass and gravel.
+//
+// Reachability comes from stb_connected_components in constant time.
+// Routes are found on two levels: the grid is cut into square clusters,
+// each split into its connected regions; A* over the region graph picks a
+// corridor and a cell-level A* inside that corridor gives the route.
+// update() compares the new layout with the old one and only rebuilds the
+// clusters whose cells changed.
+class NavGrid {
+public:
+    static const int gridLog2 = 8;
+    static const int size = 1 << gridLog2;      // cells per side
+    static const int clusterCells = 16;
+    static const int clustersPerSide = size / clusterCells;
+
+    NavGrid();
+    ~NavGrid();
+
+    NavGrid(const NavGrid&) = delete;
+    NavGrid& operator=(const NavGrid&) = delete;
+
+    // Takes the cells from the surface grid (the part that fits in size x
+    // size cells from its origin; the rest is treated as solid).
+    void update(const SurfaceGrid& surfaces);
+
+    bool empty() const { return !built; }
+    // Clusters rebuilt by the last update().
+    int changedClusters() const { return lastChanged; }
+
+    bool reachable(const glm::vec2& from, const glm::vec2& to) const;
+
+    // Route from `from` to `to` as cell centres in world XZ, ending at the
+    // goal's cell. Points inside a grown wall start from the nearest open
+    // cell. Returns false when the goal cannot be reached.
+    //
+    // With maxRegions > 0 only the first maxRegions regions of the coarse
+    // route are refined and the path stops where it enters the last of
+    // them: enough to steer by, at a bounded cost however far the goal is.
+    bool findPath(const glm::vec2& from, const glm::vec2& to, std::vector<glm::vec2>& path,
+        NavSearch& search, int maxRegions = 0) const;
+
+private:
+    struct Link {
+        int region;     // cluster * regionsPerCluster + local region
+        float cost;
+    };
+    struct Region {
+        glm::vec2 center;   // mean cell, in cells
+        float cost;         // mean travel cost of its cells
+        float minCost;      // cheapest of its cells
+        std::vector<Link> links;
+    };
+    static const int regionsPerCluster = 256;
+
+    bool cellAt(const glm::vec2& p, int& i, int& j) const;
+    bool nearestOpen(int& i, int& j) const;
+    int regionAt(int i, int j) const;
+    void buildRegions(int cx, int cz);
+    void linkClusters(int a, int b);
+    bool coarsePath(int startRegion, int goalRegion, NavSearch& search) const;
+
+    stbcc_grid* connectivity = nullptr;
+    std::vector<uint8_t> solid;         // 1 = solid, stb_connected_components' map format
+    std::vector<float> costs;           // per cell, 1 = asphalt
+    std::vector<uint8_t> regionOf;      // local region per cell, 255 = solid
+    std::vector<std::vector<Region>> clusters;
+    glm::vec2 corner = glm::vec2(0.0f);
+    float cell = 1.0f;
+    float invCell = 1.0f;
+    bool built = false;
+    int lastChanged = 0;
+};
@@ -0,0 +1,305 @@
+#include "ParamSweep.h"
+#include "AiDriver.h"
+#include "JobSystem.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+
+namespace {
+    // Values a parameter may take; anything else makes the physics divide
+    // by zero or run backwards
+    enum ParamRange { RANGE_POSITIVE, RANGE_NON_NEGATIVE, RANGE_FRACTION };
+
+    struct ParamField {
+        const char* name;
+        float CarParams::* field;
+        ParamRange range;
+    };
+
+    const ParamField paramFields[] = {
+        { "mass", &CarParams::mass, RANGE_POSITIVE },
+        { "wheelRadius", &CarParams::wheelRadius, RANGE_POSITIVE },
+        { "wheelInertia", &CarParams::wheelInertia, RANGE_POSITIVE },
+        { "suspensionLength", &CarParams::suspensionLength, RANGE_POSITIVE },
+        { "springRate", &CarParams::springRate, RANGE_POSITIVE },
+        { "damperRate", &CarParams::damperRate, RANGE_NON_NEGATIVE },
+        { "grip", &CarParams::grip, RANGE_POSITIVE },
+        { "maxSpeed", &CarParams::maxSpeed, RANGE_POSITIVE },
+        { "driveTorque", &CarParams::driveTorque, RANGE_NON_NEGATIVE },
+        { "brakeTorque", &CarParams::brakeTorque, RANGE_NON_NEGATIVE },
+        { "brakeBias", &CarParams::brakeBias, RANGE_FRACTION },
+        { "engineBrakeTorque", &CarParams::engineBrakeTorque, RANGE_NON_NEGATIVE },
+        { "maxSteer", &CarParams::maxSteer, RANGE_POSITIVE },
+        { "steerRate", &CarParams::steerRate, RANGE_POSITIVE },
+        { "steerSpeedFalloff", &CarParams::steerSpeedFalloff, RANGE_NON_NEGATIVE },
+        { "drag", &CarParams::drag, RANGE_NON_NEGATIVE },
+        { "rollingResistance", &CarParams::rollingResistance, RANGE_NON_NEGATIVE },
+    };
+    const int paramFieldCount = sizeof(paramFields) / sizeof(paramFields[0]);
+    const char* const lineSpeedName = "lineSpeed";
+
+    // Samples handed to each thread per block; more smooths out uneven
+    // sample lengths, fewer writes results sooner
+    const int samplesPerThread = 4;
+
+    struct SampleResult {
+        std::vector<float> values;      // one per axis
+        std::vector<float> lapTimes;    // every timed lap of every car
+        int dnfCars = 0;
+        float simTime = 0.0f;
+    };
+
+    // Working memory of one sample slot in a block, reused by later blocks
+    struct SampleScratch {
+        std::unique_ptr<SimState> state = std::unique_ptr<SimState>(new SimState());
+        RacingLine line;
+        RaceScratch race;
+    };
+
+    int axisField(const std::string& name) {
+        for (int i = 0; i < paramFieldCount; ++i) {
+            if (name == paramFields[i].name) return i;
+        }
+        return -1;
+    }
+
+    // What is wrong with value for the field, nullptr when nothing. The line
+    // speed factor (field -1) must be positive.
+    const char* rangeError(int field, float value) {
+        ParamRange range = field >= 0 ? paramFields[field].range : RANGE_POSITIVE;
+        switch (range) {
+        case RANGE_POSITIVE: return value > 0.0f ? nullptr : " must be > 0: ";
+        case RANGE_NON_NEGATIVE: return value >= 0.0f ? nullptr : " must be >= 0: ";
+        default: return value >= 0.0f && value <= 1.0f ? nullptr : " must be within 0:1: ";
+        }
+    }
+
+    // Rejects inf and nan too, which strtof accepts
+    bool parseFloat(const std::string& text, float& value) {
+        char* end = nullptr;
+        value = std::strtof(text.c_str(), &end);
+        return !text.empty() && end && *end == '\0' && std::isfinite(value);
+    }
+
+    // One race of stepRace() ticks on the calling thread. The shared world
+    // is only read.
+    void runSample(const SimWorld& world, const EnvironmentState& env, const SweepConfig& config,
+        int sample, SampleScratch& scratch, SampleResult& result) {
+        SimState& state = *scratch.state;
+        initSimState(state);
+        state.env = env;
+        // One generator per sample, seeded as BatchEnv seeds its worlds
+        state.rngState = (config.seed ^ (0x9E3779B9u * (uint32_t)(sample + 1))) | 1u;
+
+        CarParams params;
+        float lineSpeed = 1.0f;
+        result.values.resize(config.axes.size());
+        for (size_t a = 0; a < config.axes.size(); ++a) {
+            const SweepAxis& axis = config.axes[a];
+            float value = axis.min + (axis.max - axis.min) * simRandom(state);
+            int field = axisField(axis.name);
+            if (field >= 0) params.*paramFields[field].field = value;
+            else lineSpeed = value;
+            result.values[a] = value;
+        }
+
+        buildRacingLine(env, params, scratch.line);
+        for (float& speed : scratch.line.speed) speed *= lineSpeed;
+        state.carCount = 0;
+        spawnAiGrid(state, scratch.line, config.cars);
+        scratch.race.collisions.setStaticColliders(world.staticBoxes);
+        scratch.race.recoveryRoutes.clear();
+
+        result.lapTimes.clear();
+        const float timeLimit = (config.laps + 1) * config.maxLapTime;
+        float time = 0.0f;
+        while (time < timeLimit) {
+            // lap is 1 on the first timed lap, so laps + 1 once the last one is done
+            bool running = false;
+            for (int i = 0; i < state.carCount; ++i) running |= state.cars[i].lap <= config.laps;
+            if (!running) break;
+
+            int previousLaps[maxCars];
+            for (int i = 0; i < state.carCount; ++i) previousLaps[i] = state.cars[i].lap;
+            stepRace(state, world, scratch.line, params, scratch.race, fixedTimeStep);
+            for (int i = 0; i < state.carCount; ++i) {
+                const CarState& car = state.cars[i];
+                int previousLap = previousLaps[i];
+                if (car.lap > previousLap && previousLap >= 1 && previousLap <= config.laps) {
+                    result.lapTimes.push_back(car.lastLapTime);
+                }
+            }
+            time += fixedTimeStep;
+        }
+
+        result.dnfCars = 0;
+        for (int i = 0; i < state.carCount; ++i) result.dnfCars += state.cars[i].lap <= config.laps ? 1 : 0;
+        result.simTime = time;
+    }
+
+    float percentile(std::vector<float>& values, float fraction) {
+        if (values.empty()) return 0.0f;
+        size_t k = std::min(values.size() - 1, (size_t)(fraction * (values.size() - 1) + 0.5f));
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+}
+
+std::vector<std::string> sweepParameterNames() {
+    std::vector<std::string> names;
+    for (int i = 0; i < paramFieldCount; ++i) names.push_back(paramFields[i].name);
+    names.push_back(lineSpeedName);
+    return names;
+}
+
+bool parseSweepArgs(int argc, char** argv, SweepConfig& config, std::string& error) {
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        if (equals == std::string::npos) {
+            error = "expected key=value: " + arg;
+            return false;
+        }
+        std::string key = arg.substr(0, equals), value = arg.substr(equals + 1);
+
+        if (key == "out") {
+            config.output = value;
+            continue;
+        }
+        if (key == "samples" || key == "laps" || key == "cars" || key == "seed") {
+            char* end = nullptr;
+            long number = std::strtol(value.c_str(), &end, 10);
+            bool ok = !value.empty() && *end == '\0' && number >= (key == "seed" ? 0 : 1);
+            if (key == "cars") ok = ok && number <= maxCars;
+            if (!ok) {
+                error = "bad value for " + key + ": " + value;
+                return false;
+            }
+            if (key == "samples") config.samples = (int)number;
+            else if (key == "laps") config.laps = (int)number;
+            else if (key == "cars") config.cars = (int)number;
+            else config.seed = (uint32_t)number;
+            continue;
+        }
+        if (key == "maxLapTime") {
+            if (!parseFloat(value, config.maxLapTime) || config.maxLapTime <= 0.0f) {
+                error = "bad value for maxLapTime: " + value;
+                return false;
+            }
+            continue;
+        }
+
+        if (axisField(key) < 0 && key != lineSpeedName) {
+            error = "unknown parameter: " + key;
+            return false;
+        }
+        SweepAxis axis;
+        axis.name = key;
+        size_t colon = value.find(':');
+        bool ok;
+        if (colon == std::string::npos) {
+            ok = parseFloat(value, axis.min);
+            axis.max = axis.min;
+        }
+        else {
+            ok = parseFloat(value.substr(0, colon), axis.min) && parseFloat(value.substr(colon + 1), axis.max);
+        }
+        if (!ok || axis.max < axis.min) {
+            error = "bad range for " + key + ": " + value;
+            return false;
+        }
+        const char* outside = rangeError(axisField(key), axis.min);
+        if (!outside) outside = rangeError(axisField(key), axis.max);
+        if (outside) {
+            error = key + outside + value;
+            return false;
+        }
+        config.axes.push_back(axis);
+    }
+    return true;
+}
+
+bool runParamSweep(const SweepConfig& config, SweepSummary& summary, std::string& error,
+    const std::function<void(const SweepProgress&)>& progress) {
+    std::ofstream csv(config.output.c_str());
+    if (!csv) {
+        error = "cannot write " + config.output;
+        return false;
+    }
+    csv << "sample";
+    for (const SweepAxis& axis : config.axes) csv << ',' << axis.name;
+    csv << ",laps,dnf,best,mean,worst,simTime\n";
+    csv.flush();
+
+    // Default layout, shared read-only by every sample
+    std::unique_ptr<SimState> initial(new SimState());
+    initSimState(*initial);
+    const EnvironmentState env = initial->env;
+    SimWorld world;
+    updateSimWorld(world, env);
+
+    JobSystem& jobs = jobSystem();
+    const int threads = (int)jobs.threadCount();
+    const int block = threads * samplesPerThread;
+    std::vector<SampleScratch> scratch(block);
+    std::vector<SampleResult> results(block);
+    std::vector<float> allLaps;
+
+    summary = SweepSummary();
+    summary.threads = (unsigned int)threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int first = 0; first < config.samples; first += block) {
+        const int count = std::min(block, config.samples - first);
+        jobs.parallelFor(count, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) runSample(world, env, config, first + i, scratch[i], results[i]);
+        });
+
+        for (int i = 0; i < count; ++i) {
+            const SampleResult& result = results[i];
+            float best = 0.0f, worst = 0.0f, sum = 0.0f;
+            if (!result.lapTimes.empty()) {
+                best = *std::min_element(result.lapTimes.begin(), result.lapTimes.end());
+                worst = *std::max_element(result.lapTimes.begin(), result.lapTimes.end());
+                for (float lap : result.lapTimes) sum += lap;
+            }
+            int laps = (int)result.lapTimes.size();
+
+            csv << first + i;
+            for (float value : result.values) csv << ',' << value;
+            csv << ',' << laps << ',' << result.dnfCars << ',' << best << ','
+                << (laps > 0 ? sum / laps : 0.0f) << ',' << worst << ',' << result.simTime << '\n';
+
+            allLaps.insert(allLaps.end(), result.lapTimes.begin(), result.lapTimes.end());
+            summary.laps += laps;
+            summary.dnfCars += result.dnfCars;
+            if (laps > 0 && (summary.bestSample < 0 || best < summary.bestLap)) {
+                summary.bestSample = first + i;
+                summary.bestLap = best;
+                summary.bestValues = result.values;
+            }
+        }
+        csv.flush();
+        if (!csv) {
+            error = "write failed: " + config.output;
+            return false;
+        }
+
+        summary.samples = first + count;
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        summary.lapsPerSecond = summary.seconds > 0.0 ? summary.laps / summary.seconds : 0.0;
+        summary.lapsPerSecondPerCore = summary.lapsPerSecond / threads;
+        if (progress) {
+            progress(SweepProgress{ summary.samples, config.samples, summary.laps, summary.seconds,
+                summary.lapsPerSecond, summary.lapsPerSecondPerCore });
+        }
+    }
+
+    summary.lapP10 = percentile(allLaps, 0.1f);
+    summary.lapP50 = percentile(allLaps, 0.5f);
+    summary.lapP90 = percentile(allLaps, 0.9f);
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "CarPhysics.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Monte Carlo sweep over car setups and driving strategy. Every sample
+// draws its parameters uniformly from the configured ranges, builds a
+// racing line for that car and runs a headless race of `cars` identical AI
+// cars for `laps` timed laps (after the untimed out lap) on the default
+// track. Samples run in parallel on the job system, one per worker at a
+// time, and results are appended to a CSV file as each block of samples
+// finishes, so a long sweep can be watched or stopped at any point.
+//
+// A sample's parameters and result depend only on the seed and the sample
+// index, never on the number of threads.
+
+// One swept quantity: a CarParams field, or "lineSpeed", a factor on the
+// racing line's target speeds (how hard the AI pushes).
+struct SweepAxis {
+    std::string name;
+    float min;
+    float max;      // == min for a fixed value
+};
+
+struct SweepConfig {
+    std::vector<SweepAxis> axes;
+    int samples = 1000;
+    int laps = 3;               // timed laps per car
+    int cars = 1;               // cars per race, all with the sample's setup
+    float maxLapTime = 60.0f;   // a car slower than this on average is a DNF
+    uint32_t seed = 1;
+    std::string output = "sweep.csv";
+};
+
+struct SweepProgress {
+    int samplesDone;
+    int samples;
+    int laps;               // timed laps completed so far
+    double seconds;         // wall clock since the start
+    double lapsPerSecond;
+    double lapsPerSecondPerCore;
+};
+
+struct SweepSummary {
+    int samples = 0;
+    int laps = 0;
+    int dnfCars = 0;
+    double seconds = 0.0;
+    unsigned int threads = 0;
+    double lapsPerSecond = 0.0;
+    double lapsPerSecondPerCore = 0.0;
+    // Distribution of every timed lap of the sweep
+    float lapP10 = 0.0f, lapP50 = 0.0f, lapP90 = 0.0f;
+    // Sample with the fastest best lap
+    int bestSample = -1;
+    float bestLap = 0.0f;
+    std::vector<float> bestValues;  // one per axis
+};
+
+// Names accepted in SweepAxis::name.
+std::vector<std::string> sweepParameterNames();
+
+// Reads "key=value" arguments: samples, laps, cars, maxLapTime, seed and
+// out are options, any parameter name takes "min:max" or a fixed value.
+// Returns false with a message on anything it does not understand, and on
+// ranges the physics cannot run with (a mass or wheel radius of 0, a brake
+// bias outside 0:1, ...).
+bool parseSweepArgs(int argc, char** argv, SweepConfig& config, std::string& error);
+
+// Runs the sweep, calling progress after every block of samples. Returns
+// false with a message if the output cannot be written.
+bool runParamSweep(const SweepConfig& config, SweepSummary& summary, std::string& error,
+    const std::function<void(const SweepProgress&)>& progress = nullptr);
@@ -0,0 +1,238 @@
+#include "DetMath.h"
+#include "RacingLine.h"
+#include "JobSystem.h"
+#include "TireModel.h"
+#include "TrackLayout.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+
+namespace {
+    const float targetSpacing = 0.5f;
+    // Each half of the asphalt is one lane; the ends of the loop are half
+    // circles filling the lane width.
+    const float laneHalfWidth = trackHalfWidth * 0.5f;
+    const float turnRadius = laneHalfWidth;
+    const float turnCenterZ = trackHalfLength - 2.0f * laneHalfWidth;
+    const float edgeMargin = 0.5f;
+
+    // Curvature relaxation runs from a coarse stencil down to neighbouring
+    // points so the long bends settle in a few hundred iterations.
+    const int coarsestStride = 16;
+    const int iterationsPerStride = 100;
+    const float probeOffset = 0.01f;
+    const float maxMove = 0.5f;
+
+    // Share of the peak tyre grip used in corners, and the longitudinal
+    // limits for the speed profile (m/s^2).
+    const float cornerGripUse = 0.7f;
+    const float brakeAcceleration = 5.0f;
+    const float driveAcceleration = 3.0f;
+    const float minimumSpeed = 2.0f;
+
+    // Points searched either side of the hint; the line leaves the
+    // centreline by at most maxOffset, which shifts the nearest point by a
+    // few indices in the bends
+    const int nearestWindow = 16;
+
+    // Centreline point at arc length s in track space: up the +X straight,
+    // round the far end, down the -X straight and round the near end.
+    glm::vec2 centerlinePoint(float s) {
+        const float straight = 2.0f * turnCenterZ;
+        const float turn = glm::pi<float>() * turnRadius;
+        if (s < straight) return glm::vec2(laneHalfWidth, -turnCenterZ + s);
+        s -= straight;
+        if (s < turn) {
+            float sn, cs;
+            detSinCos(s / turnRadius, sn, cs);
+            return glm::vec2(turnRadius * cs, turnCenterZ + turnRadius * sn);
+        }
+        s -= turn;
+        if (s < straight) return glm::vec2(-laneHalfWidth, turnCenterZ - s);
+        s -= straight;
+        float sn, cs;
+        detSinCos(s / turnRadius, sn, cs);
+        return glm::vec2(-turnRadius * cs, -turnCenterZ - turnRadius * sn);
+    }
+
+    // Signed curvature of the circle through a, b and c (positive when the
+    // path turns left).
+    float mengerCurvature(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+        glm::vec2 ab = b - a, bc = c - b, ac = c - a;
+        float cross = ab.x * bc.y - ab.y * bc.x;
+        float lengths = detSqrt(glm::dot(ab, ab) * glm::dot(bc, bc) * glm::dot(ac, ac));
+        return lengths > 0.0f ? 2.0f * cross / lengths : 0.0f;
+    }
+
+    // One Gauss-Seidel sweep over the points on the stride grid, in three
+    // colours: update(i) reads points up to two strides away, so points of
+    // one colour are independent and each colour is updated in parallel, in
+    // place. Needs offsets.size() to be a multiple of 3 * stride.
+    template <typename Fn>
+    void relax(std::vector<float>& offsets, int stride, Fn update) {
+        int points = (int)offsets.size() / stride;
+        for (int colour = 0; colour < 3; ++colour) {
+            jobSystem().parallelFor(points / 3, 16, [&](int begin, int end) {
+                for (int k = begin; k < end; ++k) {
+                    int i = (k * 3 + colour) * stride;
+                    offsets[i] = update(i);
+                }
+            });
+        }
+    }
+}
+
+void buildRacingLine(const EnvironmentState& env, const CarParams& params, RacingLine& line) {
+    // Point count is a multiple of 3 * coarsestStride for the relaxation
+    const float lapLength = 4.0f * turnCenterZ + 2.0f * glm::pi<float>() * turnRadius;
+    const int block = 3 * coarsestStride;
+    int n = std::max(1, (int)(lapLength / (targetSpacing * block) + 0.5f)) * block;
+    line.length = lapLength;
+    line.spacing = lapLength / n;
+    line.halfWidth = laneHalfWidth;
+    line.maxOffset = laneHalfWidth - carHalfExtents.x - edgeMargin;
+
+    line.centerX.resize(n);
+    line.centerZ.resize(n);
+    line.normalX.resize(n);
+    line.normalZ.resize(n);
+    line.x.resize(n);
+    line.z.resize(n);
+    line.speed.resize(n);
+
+    // Same rotation as renderTrack
+    float s, c;
+    detSinCos(glm::radians(env.trackRotation), s, c);
+    for (int i = 0; i < n; ++i) {
+        glm::vec2 p = centerlinePoint(i * line.spacing);
+        line.centerX[i] = p.x * c + p.y * s;
+        line.centerZ[i] = -p.x * s + p.y * c;
+    }
+    for (int i = 0; i < n; ++i) {
+        int prev = (i + n - 1) % n, next = (i + 1) % n;
+        glm::vec2 tangent(line.centerX[next] - line.centerX[prev], line.centerZ[next] - line.centerZ[prev]);
+        tangent /= detSqrt(glm::dot(tangent, tangent));
+        line.normalX[i] = tangent.y;
+        line.normalZ[i] = -tangent.x;
+    }
+
+    auto pointAt = [&](const std::vector<float>& offsets, int i) {
+        i = (i + n) % n;
+        return glm::vec2(line.centerX[i] + line.normalX[i] * offsets[i],
+            line.centerZ[i] + line.normalZ[i] * offsets[i]);
+    };
+    auto clampOffset = [&](float offset) {
+        return std::max(-line.maxOffset, std::min(offset, line.maxOffset));
+    };
+
+    // Minimum-curvature line: coordinate descent on the sum of squared
+    // curvatures. Each point takes a Newton step sideways on the three
+    // curvatures it touches (derivatives by finite differences), clamped to
+    // the lane. Long bends spread over the straights, so the turns open up
+    // to the widest radius the lane allows.
+    std::vector<float> offsets(n, 0.0f);
+    for (int stride = coarsestStride; stride >= 1; stride /= 2) {
+        auto localEnergy = [&](int i, float offset) {
+            glm::vec2 p[5];
+            for (int k = 0; k < 5; ++k) p[k] = pointAt(offsets, i + (k - 2) * stride);
+            int wrapped = (i + n) % n;
+            p[2] = glm::vec2(line.centerX[wrapped] + line.normalX[wrapped] * offset,
+                line.centerZ[wrapped] + line.normalZ[wrapped] * offset);
+            float energy = 0.0f;
+            for (int k = 1; k <= 3; ++k) {
+                float curvature = mengerCurvature(p[k - 1], p[k], p[k + 1]);
+                energy += curvature * curvature;
+            }
+            return energy;
+        };
+        for (int iteration = 0; iteration < iterationsPerStride; ++iteration) {
+            relax(offsets, stride, [&](int i) {
+                float a = offsets[i];
+                float e0 = localEnergy(i, a - probeOffset), e1 = localEnergy(i, a), e2 = localEnergy(i, a + probeOffset);
+                float slope = (e2 - e0) / (2.0f * probeOffset);
+                float bend = (e2 - 2.0f * e1 + e0) / (probeOffset * probeOffset);
+                float move = bend > 0.0f ? -slope / bend : (slope > 0.0f ? -maxMove : maxMove);
+                return clampOffset(a + std::max(-maxMove, std::min(move, maxMove)));
+            });
+        }
+        // Points between the grid points follow linearly before refining
+        for (int i = 0; i < n; i += stride) {
+            for (int j = 1; j < stride; ++j) {
+                float t = (float)j / stride;
+                offsets[i + j] = offsets[i] + (offsets[(i + stride) % n] - offsets[i]) * t;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        glm::vec2 p = pointAt(offsets, i);
+        line.x[i] = p.x;
+        line.z[i] = p.y;
+    }
+
+    // Corner speed from the curvature through points two apart (Menger
+    // curvature): the lower of the grip limit and the speed at which the
+    // speed-dependent steering lock still reaches the wheel angle, capped by
+    // the car's top speed
+    const float lateralLimit = cornerGripUse * params.grip * lateralTireCurve.d * gravity;
+    jobSystem().parallelFor(n, 64, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            float curvature = std::abs(mengerCurvature(pointAt(offsets, i - 2), pointAt(offsets, i),
+                pointAt(offsets, i + 2)));
+            float speed = params.maxSpeed;
+            if (curvature > 1e-4f) {
+                float wheelAngle = glm::degrees(wheelBase * curvature);
+                float steerSpeed = (params.maxSteer / wheelAngle - 1.0f) / params.steerSpeedFalloff;
+                speed = std::min(speed, std::min(detSqrt(lateralLimit / curvature), steerSpeed));
+            }
+            line.speed[i] = std::max(speed, minimumSpeed);
+        }
+    });
+
+    // Braking limit backwards and acceleration limit forwards; two laps each
+    // so the limits carry across the start point
+    for (int k = 2 * n - 1; k >= 0; --k) {
+        int i = k % n, next = (k + 1) % n;
+        line.speed[i] = std::min(line.speed[i],
+            detSqrt(line.speed[next] * line.speed[next] + 2.0f * brakeAcceleration * line.spacing));
+    }
+    for (int k = 1; k <= 2 * n; ++k) {
+        int i = k % n, prev = (k - 1) % n;
+        line.speed[i] = std::min(line.speed[i],
+            detSqrt(line.speed[prev] * line.speed[prev] + 2.0f * driveAcceleration * line.spacing));
+    }
+}
+
+int nearestLinePoint(const RacingLine& line, const glm::vec2& pos, int hint) {
+    const int n = line.size();
+    auto distanceSq = [&](int j) {
+        j = (j % n + n) % n;
+        float dx = pos.x - line.x[j], dz = pos.y - line.z[j];
+        return dx * dx + dz * dz;
+    };
+
+    int first = 0, last = n - 1;
+    if (hint >= 0 && 2 * nearestWindow + 1 < n) {
+        first = hint - nearestWindow;
+        last = hint + nearestWindow;
+    }
+    int nearest = first;
+    float best = distanceSq(first);
+    for (int j = first + 1; j <= last; ++j) {
+        float d = distanceSq(j);
+        if (d < best) {
+            best = d;
+            nearest = j;
+        }
+    }
+    // A car that moved further than the window since the hint was taken
+    if (last - first + 1 < n) {
+        int step = nearest == first ? -1 : nearest == last ? 1 : 0;
+        for (int guard = 0; step != 0 && guard < n; ++guard) {
+            float d = distanceSq(nearest + step);
+            if (d >= best) break;
+            best = d;
+            nearest += step;
+        }
+    }
+    return (nearest % n + n) % n;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "CarPhysics.h"
+#include "SimState.h"
+#include <vector>
+
+// The lap driven on the asphalt: a stadium loop with one straight down each
+// half of the track, joined by half circles near the ends. Points are spaced
+// evenly along the centreline and stored as SoA so drivers can scan them
+// four at a time.
+struct RacingLine {
+    std::vector<float> centerX, centerZ;   // track centreline
+    std::vector<float> normalX, normalZ;   // unit, to the left of travel
+    std::vector<float> x, z;               // optimised line
+    std::vector<float> speed;              // target speed in m/s
+    float spacing = 0.0f;                  // along the centreline
+    float length = 0.0f;                   // centreline lap length
+    float halfWidth = 0.0f;                // lane half width around the centreline
+    float maxOffset = 0.0f;                // how far the line may leave the centreline
+
+    int size() const { return (int)x.size(); }
+    bool empty() const { return x.empty(); }
+};
+
+// Builds the centreline for the current trackRotation, relaxes the line
+// towards minimum curvature inside the lane (points are updated in parallel)
+// and derives a speed profile from the curvature and the car's grip,
+// braking and acceleration limits.
+void buildRacingLine(const EnvironmentState& env, const CarParams& params, RacingLine& line);
+
+// Index of the line point nearest to pos. Line point i lies beside
+// centreline point i, so hint is the car's trackSegment: only the points
+// around it are searched, following the distance downhill past the window
+// edge. With hint -1 the whole lap is scanned.
+int nearestLinePoint(const RacingLine& line, const glm::vec2& pos, int hint);
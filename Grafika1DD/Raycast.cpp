@@ -0,0 +1,300 @@
+#include "DetMath.h"
+#include "Raycast.h"
+#include "JobSystem.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace simd;
+
+static_assert(sizeof(RayBvh::Node) == 32, "BVH nodes should stay 32 bytes");
+
+namespace {
+    const uint32_t interiorFlag = 0x80000000u;
+    const int binCount = 12;
+    const int maxLeafSize = 4;
+    // Traversal keeps at most one pending sibling per level plus the two
+    // children just pushed, so capping the tree depth one below the stack
+    // size means the stack can never overflow
+    const int maxStackDepth = 64;
+    const int maxTreeDepth = maxStackDepth - 1;
+
+    struct Aabb {
+        glm::vec3 bmin = glm::vec3(FLT_MAX);
+        glm::vec3 bmax = glm::vec3(-FLT_MAX);
+
+        void grow(const glm::vec3& p) { bmin = glm::min(bmin, p); bmax = glm::max(bmax, p); }
+        void grow(const Aabb& b) { bmin = glm::min(bmin, b.bmin); bmax = glm::max(bmax, b.bmax); }
+        float area() const {
+            glm::vec3 e = bmax - bmin;
+            return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+    };
+
+    // 1/d without infinities: axis-parallel rays get a huge finite value so
+    // the slab test never produces 0 * inf = NaN.
+    float safeInverse(float d) {
+        const float tiny = 1e-20f;
+        if (std::fabs(d) < tiny) d = d < 0.0f ? -tiny : tiny;
+        return 1.0f / d;
+    }
+
+    // SoA view of up to four rays.
+    struct Packet {
+        F4 ox, oy, oz;
+        F4 dx, dy, dz;
+        F4 ix, iy, iz;
+    };
+}
+
+void RayBvh::build(const std::vector<WorldTriangle>& source) {
+    nodes.clear();
+    triangles.clear();
+    if (source.empty()) return;
+
+    std::vector<uint32_t> order(source.size());
+    std::vector<glm::vec3> centroids(source.size());
+    for (size_t i = 0; i < source.size(); ++i) {
+        order[i] = (uint32_t)i;
+        centroids[i] = (source[i].v[0] + source[i].v[1] + source[i].v[2]) * (1.0f / 3.0f);
+    }
+
+    nodes.reserve(source.size() * 2);
+    Node root;
+    root.leftOrFirst = 0;
+    root.count = (uint32_t)source.size();
+    nodes.push_back(root);
+    subdivide(0, 0, order, source, centroids);
+
+    triangles.resize(source.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const WorldTriangle& t = source[order[i]];
+        Triangle& out = triangles[i];
+        out.v0 = t.v[0];
+        out.e1 = t.v[1] - t.v[0];
+        out.e2 = t.v[2] - t.v[0];
+        out.surface = t.surface;
+    }
+}
+
+void RayBvh::subdivide(uint32_t nodeIndex, int depth, std::vector<uint32_t>& order,
+    const std::vector<WorldTriangle>& source, const std::vector<glm::vec3>& centroids) {
+    uint32_t first = nodes[nodeIndex].leftOrFirst;
+    uint32_t count = nodes[nodeIndex].count;
+
+    Aabb bounds, centroidBounds;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const WorldTriangle& t = source[order[i]];
+        bounds.grow(t.v[0]);
+        bounds.grow(t.v[1]);
+        bounds.grow(t.v[2]);
+        centroidBounds.grow(centroids[order[i]]);
+    }
+    nodes[nodeIndex].bmin = bounds.bmin;
+    nodes[nodeIndex].bmax = bounds.bmax;
+    // Past the depth cap a node stays a (larger) leaf
+    if (count <= (uint32_t)maxLeafSize || depth + 1 >= maxTreeDepth) return;
+
+    // Binned SAH: try every bin boundary on every axis.
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = bounds.area() * count;
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = centroidBounds.bmin[axis], hi = centroidBounds.bmax[axis];
+        if (hi - lo < 1e-6f) continue;
+        float scale = binCount / (hi - lo);
+
+        Aabb binBounds[binCount];
+        int binTris[binCount] = {};
+        for (uint32_t i = first; i < first + count; ++i) {
+            int b = std::min(binCount - 1, (int)((centroids[order[i]][axis] - lo) * scale));
+            const WorldTriangle& t = source[order[i]];
+            binBounds[b].grow(t.v[0]);
+            binBounds[b].grow(t.v[1]);
+            binBounds[b].grow(t.v[2]);
+            binTris[b]++;
+        }
+
+        float leftArea[binCount - 1];
+        int leftCount[binCount - 1];
+        Aabb acc;
+        int n = 0;
+        for (int b = 0; b < binCount - 1; ++b) {
+            acc.grow(binBounds[b]);
+            n += binTris[b];
+            leftArea[b] = acc.area();
+            leftCount[b] = n;
+        }
+        acc = Aabb();
+        n = 0;
+        for (int b = binCount - 1; b > 0; --b) {
+            acc.grow(binBounds[b]);
+            n += binTris[b];
+            float cost = leftArea[b - 1] * leftCount[b - 1] + acc.area() * n;
+            if (leftCount[b - 1] > 0 && n > 0 && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+    if (bestAxis < 0) return;
+
+    float lo = centroidBounds.bmin[bestAxis];
+    float scale = binCount / (centroidBounds.bmax[bestAxis] - lo);
+    uint32_t* begin = order.data() + first;
+    uint32_t* mid = std::partition(begin, begin + count, [&](uint32_t tri) {
+        return std::min(binCount - 1, (int)((centroids[tri][bestAxis] - lo) * scale)) < bestSplit;
+    });
+    uint32_t leftCount = (uint32_t)(mid - begin);
+
+    uint32_t left = (uint32_t)nodes.size();
+    Node child;
+    child.leftOrFirst = first;
+    child.count = leftCount;
+    nodes.push_back(child);
+    child.leftOrFirst = first + leftCount;
+    child.count = count - leftCount;
+    nodes.push_back(child);
+
+    nodes[nodeIndex].leftOrFirst = left;
+    nodes[nodeIndex].count = interiorFlag | (uint32_t)bestAxis;
+    subdivide(left, depth + 1, order, source, centroids);
+    subdivide(left + 1, depth + 1, order, source, centroids);
+}
+
+void RayBvh::raycast(const Ray* rays, int count, RayHit* hits) const {
+    for (int i = 0; i < count; i += 4) {
+        tracePacket(rays + i, std::min(4, count - i), hits + i);
+    }
+}
+
+void RayBvh::tracePacket(const Ray* rays, int count, RayHit* hits) const {
+    if (nodes.empty()) {
+        for (int i = 0; i < count; ++i) {
+            hits[i].distance = rays[i].maxDistance;
+            hits[i].surface = SURFACE_NONE;
+        }
+        return;
+    }
+
+    float soa[9][4], tMax[4];
+    for (int i = 0; i < 4; ++i) {
+        // Unused lanes repeat ray 0 with a zero range so they never hit.
+        const Ray& r = rays[i < count ? i : 0];
+        soa[0][i] = r.origin.x; soa[1][i] = r.origin.y; soa[2][i] = r.origin.z;
+        soa[3][i] = r.dir.x; soa[4][i] = r.dir.y; soa[5][i] = r.dir.z;
+        soa[6][i] = safeInverse(r.dir.x); soa[7][i] = safeInverse(r.dir.y); soa[8][i] = safeInverse(r.dir.z);
+        tMax[i] = i < count ? r.maxDistance : 0.0f;
+    }
+    Packet p;
+    p.ox = load(soa[0]); p.oy = load(soa[1]); p.oz = load(soa[2]);
+    p.dx = load(soa[3]); p.dy = load(soa[4]); p.dz = load(soa[5]);
+    p.ix = load(soa[6]); p.iy = load(soa[7]); p.iz = load(soa[8]);
+
+    F4 bestT = load(tMax);
+    F4 bestSurface(0.0f);
+    const F4 zero(0.0f), one(1.0f), epsilon(1e-9f);
+
+    uint32_t stack[maxStackDepth];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        // Slab test for all four rays at once
+        F4 t1x = (F4(node.bmin.x) - p.ox) * p.ix, t2x = (F4(node.bmax.x) - p.ox) * p.ix;
+        F4 t1y = (F4(node.bmin.y) - p.oy) * p.iy, t2y = (F4(node.bmax.y) - p.oy) * p.iy;
+        F4 t1z = (F4(node.bmin.z) - p.oz) * p.iz, t2z = (F4(node.bmax.z) - p.oz) * p.iz;
+        F4 tNear = vmax(vmax(vmin(t1x, t2x), vmin(t1y, t2y)), vmax(vmin(t1z, t2z), zero));
+        F4 tFar = vmin(vmin(vmax(t1x, t2x), vmax(t1y, t2y)), vmin(vmax(t1z, t2z), bestT));
+        if (maskBits(cmpLe(tNear, tFar)) == 0) continue;
+
+        if (node.count & interiorFlag) {
+            // Visit the child on the packet's side of the split first.
+            int axis = node.count & 3;
+            bool negative = rays[0].dir[axis] < 0.0f;
+            assert(top + 2 <= maxStackDepth);
+            stack[top++] = node.leftOrFirst + (negative ? 0 : 1);
+            stack[top++] = node.leftOrFirst + (negative ? 1 : 0);
+            continue;
+        }
+
+        // Moller-Trumbore against each leaf triangle, four rays at a time
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+            const Triangle& tri = triangles[i];
+            F4 e1x(tri.e1.x), e1y(tri.e1.y), e1z(tri.e1.z);
+            F4 e2x(tri.e2.x), e2y(tri.e2.y), e2z(tri.e2.z);
+
+            F4 hx = p.dy * e2z - p.dz * e2y;
+            F4 hy = p.dz * e2x - p.dx * e2z;
+            F4 hz = p.dx * e2y - p.dy * e2x;
+            F4 det = e1x * hx + e1y * hy + e1z * hz;
+            F4 valid = cmpGt(vabs(det), epsilon);
+            F4 invDet = one / select(valid, det, one);
+
+            F4 sx = p.ox - F4(tri.v0.x), sy = p.oy - F4(tri.v0.y), sz = p.oz - F4(tri.v0.z);
+            F4 u = (sx * hx + sy * hy + sz * hz) * invDet;
+            valid = maskAnd(valid, maskAnd(cmpGe(u, zero), cmpLe(u, one)));
+
+            F4 qx = sy * e1z - sz * e1y;
+            F4 qy = sz * e1x - sx * e1z;
+            F4 qz = sx * e1y - sy * e1x;
+            F4 v = (p.dx * qx + p.dy * qy + p.dz * qz) * invDet;
+            valid = maskAnd(valid, maskAnd(cmpGe(v, zero), cmpLe(u + v, one)));
+
+            F4 t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+            valid = maskAnd(valid, maskAnd(cmpGt(t, zero), cmpLt(t, bestT)));
+            if (maskBits(valid) == 0) continue;
+
+            bestT = select(valid, t, bestT);
+            bestSurface = select(valid, F4((float)tri.surface), bestSurface);
+        }
+    }
+
+    float outT[4], outSurface[4];
+    store(outT, bestT);
+    store(outSurface, bestSurface);
+    for (int i = 0; i < count; ++i) {
+        hits[i].distance = outT[i];
+        hits[i].surface = (SurfaceId)(int)outSurface[i];
+    }
+}
+
+void castCarSensors(const RayBvh& bvh, const CarState* cars, int carCount,
+    const SensorConfig& cfg, float* distances, uint8_t* surfaces, const uint8_t* active) {
+    const int rayCount = cfg.rayCount;
+    if (rayCount <= 0) return;
+
+    // A full circle must not repeat its first ray at the end.
+    bool fullCircle = cfg.fieldOfView >= 360.0f;
+    float step = rayCount > 1 ? cfg.fieldOfView / (fullCircle ? rayCount : rayCount - 1) : 0.0f;
+    float start = rayCount > 1 ? -cfg.fieldOfView * 0.5f : 0.0f;
+
+    jobSystem().parallelFor(carCount, 4, [&](int begin, int end) {
+        const int batch = 64;
+        Ray rays[batch];
+        RayHit hits[batch];
+        for (int c = begin; c < end; ++c) {
+            if (active && !active[c]) continue;
+            const CarState& car = cars[c];
+            glm::vec3 origin = car.pos + glm::vec3(0.0f, cfg.mountHeight, 0.0f);
+            for (int first = 0; first < rayCount; first += batch) {
+                int n = std::min(batch, rayCount - first);
+                for (int i = 0; i < n; ++i) {
+                    float s, co;
+                    detSinCos(glm::radians(car.rotation + start + step * (first + i)), s, co);
+                    rays[i].origin = origin;
+                    rays[i].dir = glm::vec3(s, 0.0f, co);
+                    rays[i].maxDistance = cfg.range;
+                }
+                bvh.raycast(rays, n, hits);
+                for (int i = 0; i < n; ++i) {
+                    if (distances) distances[c * rayCount + first + i] = hits[i].distance;
+                    if (surfaces) surfaces[c * rayCount + first + i] = hits[i].surface;
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "SimState.h"
+#include "WorldGeometry.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 dir;       // unit length
+    float maxDistance;
+};
+
+struct RayHit {
+    float distance;      // maxDistance when nothing was hit
+    SurfaceId surface;   // SURFACE_NONE when nothing was hit
+};
+
+// Bounding volume hierarchy over the static world triangles, built with
+// binned SAH. Nodes are 32 bytes and stored depth-first; leaf triangles are
+// stored contiguously in node order.
+class RayBvh {
+public:
+    void build(const std::vector<WorldTriangle>& triangles);
+    bool empty() const { return nodes.empty(); }
+
+    // Traces rays four at a time with SIMD; hits[i] answers rays[i].
+    void raycast(const Ray* rays, int count, RayHit* hits) const;
+
+    struct Node {
+        glm::vec3 bmin;
+        uint32_t leftOrFirst;   // interior: left child (right is left + 1); leaf: first triangle
+        glm::vec3 bmax;
+        uint32_t count;         // leaf: triangle count; interior: interiorFlag | split axis
+    };
+    struct Triangle {
+        glm::vec3 v0;
+        glm::vec3 e1;
+        glm::vec3 e2;
+        SurfaceId surface;
+    };
+
+private:
+    void subdivide(uint32_t nodeIndex, int depth, std::vector<uint32_t>& order,
+        const std::vector<WorldTriangle>& source, const std::vector<glm::vec3>& centroids);
+    void tracePacket(const Ray* rays, int count, RayHit* hits) const;
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+};
+
+// Lidar-style fan of horizontal rays mounted on each car.
+struct SensorConfig {
+    int rayCount = 64;
+    float fieldOfView = 360.0f;   // degrees, centred on the heading
+    float range = 50.0f;
+    float mountHeight = 0.3f;     // above the car position
+};
+
+// Casts cfg.rayCount rays for each of cars[0..carCount) across the job system.
+// Outputs are laid out car after car: distances[car * rayCount + ray].
+// Cars with active[car] == 0 are skipped and keep their previous readings.
+void castCarSensors(const RayBvh& bvh, const CarState* cars, int carCount,
+    const SensorConfig& cfg, float* distances, uint8_t* surfaces, const uint8_t* active = nullptr);
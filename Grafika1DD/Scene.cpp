@@ -0,0 +1,526 @@
+#include "Scene.h"
+#include "FileWatcher.h"
+#include "WorldGeometry.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace {
+    // The circuit as it was hard-coded: barriers along the track, six trees
+    // and three grandstands. Colliders come out in the order the physics has
+    // always built them, so recorded runs still replay.
+    const char* defaultSceneText = R"(
+texture building textures/building.jpg
+
+material barrier 0.9 0.9 0.9
+material trunk 0.4 0.2 0.1
+material crown 0.2 0.5 0.2 tint tree
+material building 0.7 0.7 0.8 texture building
+
+prop cube barrier pos -11 0.5 0 scale 0.5 1 42 space track collider barrier
+prop cube barrier pos 11 0.5 0 scale 0.5 1 42 space track collider barrier
+
+prop cube trunk pos -15 1 -15 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+prop cube trunk pos 15 1 -15 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+prop cube trunk pos -15 1 15 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+prop cube trunk pos 15 1 15 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+prop cube trunk pos -25 1 0 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+prop cube trunk pos 25 1 0 scale 0.3 2 0.3 tag trunk collider tree flatten 2 2
+
+prop cube crown pos -15 2.5 -15 scale 1.5 1.5 1.5 tag crown
+prop cube crown pos 15 2.5 -15 scale 1.5 1.5 1.5 tag crown
+prop cube crown pos -15 2.5 15 scale 1.5 1.5 1.5 tag crown
+prop cube crown pos 15 2.5 15 scale 1.5 1.5 1.5 tag crown
+prop cube crown pos -25 2.5 0 scale 1.5 1.5 1.5 tag crown
+prop cube crown pos 25 2.5 0 scale 1.5 1.5 1.5 tag crown
+
+prop cube building pos 0 3 -30 scale 8 6 4 collider building flatten 5 3
+prop cube building pos -20 3 -25 scale 8 6 4 collider building flatten 5 3
+prop cube building pos 20 3 -25 scale 8 6 4 collider building flatten 5 3
+
+light headlight pos -0.5 0 2.1 yaw -15 scale 0.3 1.5 0.3 on 1 1 0.9 4 off 0.2 0.2 0.2 0.2
+light headlight pos 0.5 0 2.1 yaw 15 scale 0.3 1.5 0.3 on 1 1 0.9 4 off 0.2 0.2 0.2 0.2
+light taillight pos -0.5 0.2 -2 scale 0.2 0.2 0.1 on 1 0 0 3 off 0.3 0 0 1
+light taillight pos 0.5 0.2 -2 scale 0.2 0.2 0.1 on 1 0 0 3 off 0.3 0 0 1
+)";
+
+    const char compiledMagic[4] = { 'R', 'C', 'S', 'C' };
+    const uint32_t compiledVersion = 1;
+    const size_t compiledHeaderBytes = 64;
+    const size_t sectionAlign = 16;
+
+    // Reads the tokens of one statement with its line number for errors.
+    class Statement {
+    public:
+        Statement(const std::string& line, int number) : tokens(line), number(number) {}
+
+        bool word(std::string& out) { return (bool)(tokens >> out); }
+
+        bool number3(glm::vec3& out, std::string& error) {
+            return number1(out.x, error) && number1(out.y, error) && number1(out.z, error);
+        }
+
+        bool number1(float& out, std::string& error) {
+            std::string token;
+            char* end = nullptr;
+            if (tokens >> token) out = std::strtof(token.c_str(), &end);
+            if (!end || *end != '\0') return fail("expected a number" + (token.empty() ? "" : ", got '" + token + "'"), error);
+            return true;
+        }
+
+        bool fail(const std::string& message, std::string& error) const {
+            error = "line " + std::to_string(number) + ": " + message;
+            return false;
+        }
+
+    private:
+        std::istringstream tokens;
+        int number;
+    };
+
+    int findName(const std::vector<std::string>& names, const std::string& name) {
+        auto it = std::find(names.begin(), names.end(), name);
+        return it == names.end() ? -1 : (int)(it - names.begin());
+    }
+
+    struct ParsedProp {
+        uint32_t batch;
+        glm::mat4 transform;
+    };
+
+    bool parseProp(Statement& statement, const std::vector<std::string>& materialNames, Scene& scene,
+        std::vector<ParsedProp>& props, std::string& error) {
+        static const char* meshNames[PROP_MESH_COUNT] = { "cube", "cylinder", "cone" };
+        std::string meshName, materialName, key;
+        if (!statement.word(meshName) || !statement.word(materialName)) {
+            return statement.fail("expected: prop <mesh> <material> pos <x> <y> <z> ...", error);
+        }
+        SceneBatch batch = {};
+        batch.mesh = (uint32_t)(std::find(meshNames, meshNames + PROP_MESH_COUNT, meshName) - meshNames);
+        if (batch.mesh == PROP_MESH_COUNT) return statement.fail("unknown mesh '" + meshName + "'", error);
+        int material = findName(materialNames, materialName);
+        if (material < 0) return statement.fail("unknown material '" + materialName + "'", error);
+        batch.material = (uint32_t)material;
+
+        glm::vec3 pos(0.0f), scale(1.0f);
+        float yaw = 0.0f;
+        bool hasPos = false;
+        SceneCollider collider = {};
+        collider.kind = noCollider;
+        while (statement.word(key)) {
+            if (key == "pos") {
+                if (!statement.number3(pos, error)) return false;
+                hasPos = true;
+            }
+            else if (key == "yaw") {
+                if (!statement.number1(yaw, error)) return false;
+            }
+            else if (key == "scale") {
+                if (!statement.number3(scale, error)) return false;
+            }
+            else if (key == "space") {
+                std::string space;
+                statement.word(space);
+                if (space == "track") batch.space = SPACE_TRACK;
+                else if (space == "world") batch.space = SPACE_WORLD;
+                else return statement.fail("space is world or track", error);
+            }
+            else if (key == "tag") {
+                std::string tag;
+                statement.word(tag);
+                if (tag == "trunk") batch.tag = TAG_TRUNK;
+                else if (tag == "crown") batch.tag = TAG_CROWN;
+                else return statement.fail("tag is trunk or crown", error);
+            }
+            else if (key == "collider") {
+                std::string kind;
+                statement.word(kind);
+                if (kind == "barrier") collider.kind = COLLIDER_BARRIER;
+                else if (kind == "building") collider.kind = COLLIDER_BUILDING;
+                else if (kind == "tree") collider.kind = COLLIDER_TREE;
+                else return statement.fail("collider is barrier, building or tree", error);
+            }
+            else if (key == "flatten") {
+                if (!statement.number1(collider.flattenHalf.x, error) || !statement.number1(collider.flattenHalf.y, error)) {
+                    return false;
+                }
+            }
+            else {
+                return statement.fail("unknown prop field '" + key + "'", error);
+            }
+        }
+        if (!hasPos) return statement.fail("prop without pos", error);
+
+        // Few batches per scene, so a linear search is cheaper than a map
+        uint32_t index = 0;
+        for (; index < scene.batches.size(); ++index) {
+            const SceneBatch& b = scene.batches[index];
+            if (b.mesh == batch.mesh && b.material == batch.material && b.space == batch.space && b.tag == batch.tag) break;
+        }
+        if (index == scene.batches.size()) scene.batches.push_back(batch);
+        ++scene.batches[index].count;
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), pos);
+        if (yaw != 0.0f) transform = glm::rotate(transform, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        props.push_back({ index, glm::scale(transform, scale) });
+
+        if (collider.kind != noCollider || collider.flattenHalf != glm::vec2(0.0f)) {
+            collider.center = pos;
+            collider.yaw = yaw;
+            collider.halfExtents = scale * 0.5f;
+            collider.space = batch.space;
+            collider.tag = batch.tag;
+            scene.colliders.push_back(collider);
+        }
+        return true;
+    }
+
+    bool parseLight(Statement& statement, Scene& scene, std::string& error) {
+        std::string kind, key;
+        statement.word(kind);
+        SceneLight light = {};
+        if (kind == "headlight") light.kind = LIGHT_HEADLIGHT;
+        else if (kind == "taillight") light.kind = LIGHT_TAILLIGHT;
+        else return statement.fail("light is headlight or taillight", error);
+        light.scale = glm::vec3(1.0f);
+        light.onColor = light.offColor = glm::vec3(1.0f);
+
+        while (statement.word(key)) {
+            bool ok;
+            if (key == "pos") ok = statement.number3(light.offset, error);
+            else if (key == "yaw") ok = statement.number1(light.yaw, error);
+            else if (key == "scale") ok = statement.number3(light.scale, error);
+            else if (key == "on") ok = statement.number3(light.onColor, error) && statement.number1(light.onGlow, error);
+            else if (key == "off") ok = statement.number3(light.offColor, error) && statement.number1(light.offGlow, error);
+            else return statement.fail("unknown light field '" + key + "'", error);
+            if (!ok) return false;
+        }
+        scene.lights.push_back(light);
+        return true;
+    }
+
+    // Section offsets of a compiled scene with the given counts.
+    struct Layout {
+        size_t instances, materials, batches, colliders, lights, textures, end;
+    };
+
+    size_t alignUp(size_t offset) {
+        return (offset + sectionAlign - 1) & ~(sectionAlign - 1);
+    }
+
+    Layout layoutFor(const uint32_t counts[6], uint32_t textureBytes) {
+        Layout layout;
+        layout.instances = compiledHeaderBytes;
+        layout.materials = alignUp(layout.instances + (size_t)counts[0] * sizeof(glm::mat4));
+        layout.batches = alignUp(layout.materials + (size_t)counts[1] * sizeof(SceneMaterial));
+        layout.colliders = alignUp(layout.batches + (size_t)counts[2] * sizeof(SceneBatch));
+        layout.lights = alignUp(layout.colliders + (size_t)counts[3] * sizeof(SceneCollider));
+        layout.textures = alignUp(layout.lights + (size_t)counts[4] * sizeof(SceneLight));
+        layout.end = layout.textures + textureBytes;
+        return layout;
+    }
+
+    // Header: magic, version, source size, source time, then the counts of
+    // instances, materials, batches, colliders, lights and textures and the
+    // bytes of the texture names (each ends in a zero byte).
+    struct Header {
+        uint64_t sourceSize;
+        uint64_t sourceTime;
+        uint32_t counts[6];
+        uint32_t textureBytes;
+    };
+
+    void storeU32(unsigned char* at, uint32_t value) {
+        for (int i = 0; i < 4; ++i) at[i] = (unsigned char)(value >> (i * 8));
+    }
+
+    uint32_t loadU32(const unsigned char* at) {
+        return at[0] | (at[1] << 8) | (at[2] << 16) | ((uint32_t)at[3] << 24);
+    }
+
+    void writeHeader(unsigned char* out, const Header& header) {
+        std::memset(out, 0, compiledHeaderBytes);
+        std::memcpy(out, compiledMagic, 4);
+        storeU32(out + 4, compiledVersion);
+        storeU32(out + 8, (uint32_t)header.sourceSize);
+        storeU32(out + 12, (uint32_t)(header.sourceSize >> 32));
+        storeU32(out + 16, (uint32_t)header.sourceTime);
+        storeU32(out + 20, (uint32_t)(header.sourceTime >> 32));
+        for (int i = 0; i < 6; ++i) storeU32(out + 24 + i * 4, header.counts[i]);
+        storeU32(out + 48, header.textureBytes);
+    }
+
+    bool readHeader(const unsigned char* in, Header& header) {
+        if (std::memcmp(in, compiledMagic, 4) != 0 || loadU32(in + 4) != compiledVersion) return false;
+        header.sourceSize = loadU32(in + 8) | ((uint64_t)loadU32(in + 12) << 32);
+        header.sourceTime = loadU32(in + 16) | ((uint64_t)loadU32(in + 20) << 32);
+        for (int i = 0; i < 6; ++i) header.counts[i] = loadU32(in + 24 + i * 4);
+        header.textureBytes = loadU32(in + 48);
+        return true;
+    }
+
+    void sizeSections(const Header& header, Scene& scene) {
+        scene.instances.resize(header.counts[0]);
+        scene.materials.resize(header.counts[1]);
+        scene.batches.resize(header.counts[2]);
+        scene.colliders.resize(header.counts[3]);
+        scene.lights.resize(header.counts[4]);
+    }
+
+    bool splitTextureNames(const char* names, const Header& header, Scene& scene) {
+        scene.textures.clear();
+        size_t start = 0;
+        for (size_t i = 0; i < header.textureBytes; ++i) {
+            if (names[i] != '\0') continue;
+            scene.textures.emplace_back(names + start, i - start);
+            start = i + 1;
+        }
+        return start == header.textureBytes && scene.textures.size() == header.counts[5];
+    }
+
+    // Every index in range, so the renderer and physics can trust the data
+    bool validScene(const Scene& scene) {
+        size_t next = 0;
+        for (const SceneBatch& batch : scene.batches) {
+            if (batch.mesh >= PROP_MESH_COUNT || batch.material >= scene.materials.size() || batch.space > SPACE_TRACK) {
+                return false;
+            }
+            if (batch.first != next || batch.count > scene.instances.size() - next) return false;
+            next += batch.count;
+        }
+        if (next != scene.instances.size()) return false;
+        for (const SceneMaterial& material : scene.materials) {
+            if (material.texture < -1 || material.texture >= (int32_t)scene.textures.size()) return false;
+        }
+        for (const SceneCollider& collider : scene.colliders) {
+            if ((collider.kind != noCollider && collider.kind > COLLIDER_TREE) || collider.space > SPACE_TRACK) return false;
+        }
+        return true;
+    }
+
+    // Reads a compiled file section by section straight into the scene's
+    // vectors. With a stamp, a file compiled from another source is refused.
+    bool readCompiledFile(const std::string& path, const uint64_t* size, const uint64_t* time, Scene& scene) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        unsigned char bytes[compiledHeaderBytes];
+        Header header;
+        if (!file.read((char*)bytes, compiledHeaderBytes) || !readHeader(bytes, header)) return false;
+        if (size && (header.sourceSize != *size || header.sourceTime != *time)) return false;
+
+        Layout layout = layoutFor(header.counts, header.textureBytes);
+        if (!file.seekg(0, std::ios::end) || (size_t)file.tellg() < layout.end) return false;
+        sizeSections(header, scene);
+        std::vector<char> names(header.textureBytes);
+        auto section = [&file](size_t offset, void* data, size_t bytes) {
+            return (bool)file.seekg((std::streamoff)offset).read((char*)data, (std::streamsize)bytes);
+        };
+        bool ok = section(layout.instances, scene.instances.data(), scene.instances.size() * sizeof(glm::mat4))
+            && section(layout.materials, scene.materials.data(), scene.materials.size() * sizeof(SceneMaterial))
+            && section(layout.batches, scene.batches.data(), scene.batches.size() * sizeof(SceneBatch))
+            && section(layout.colliders, scene.colliders.data(), scene.colliders.size() * sizeof(SceneCollider))
+            && section(layout.lights, scene.lights.data(), scene.lights.size() * sizeof(SceneLight))
+            && section(layout.textures, names.data(), names.size());
+        return ok && splitTextureNames(names.data(), header, scene) && validScene(scene);
+    }
+
+    bool writeCompiled(const Scene& scene, const std::string& path, uint64_t sourceSize, uint64_t sourceTime,
+        std::string& error) {
+        Header header = {};
+        header.sourceSize = sourceSize;
+        header.sourceTime = sourceTime;
+        header.counts[0] = (uint32_t)scene.instances.size();
+        header.counts[1] = (uint32_t)scene.materials.size();
+        header.counts[2] = (uint32_t)scene.batches.size();
+        header.counts[3] = (uint32_t)scene.colliders.size();
+        header.counts[4] = (uint32_t)scene.lights.size();
+        header.counts[5] = (uint32_t)scene.textures.size();
+        std::string names;
+        for (const std::string& texture : scene.textures) names += texture + '\0';
+        header.textureBytes = (uint32_t)names.size();
+
+        Layout layout = layoutFor(header.counts, header.textureBytes);
+        std::vector<unsigned char> out(layout.end, 0);
+        unsigned char headerBytes[compiledHeaderBytes];
+        writeHeader(headerBytes, header);
+        std::memcpy(out.data(), headerBytes, compiledHeaderBytes);
+        auto section = [&out](size_t offset, const void* data, size_t bytes) {
+            if (bytes) std::memcpy(out.data() + offset, data, bytes);
+        };
+        section(layout.instances, scene.instances.data(), scene.instances.size() * sizeof(glm::mat4));
+        section(layout.materials, scene.materials.data(), scene.materials.size() * sizeof(SceneMaterial));
+        section(layout.batches, scene.batches.data(), scene.batches.size() * sizeof(SceneBatch));
+        section(layout.colliders, scene.colliders.data(), scene.colliders.size() * sizeof(SceneCollider));
+        section(layout.lights, scene.lights.data(), scene.lights.size() * sizeof(SceneLight));
+        section(layout.textures, names.data(), names.size());
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file.write((const char*)out.data(), (std::streamsize)out.size())) {
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool endsWith(const std::string& text, const std::string& suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+const Scene& defaultScene() {
+    static const Scene scene = [] {
+        Scene parsed;
+        std::string error;
+        parseScene(defaultSceneText, std::strlen(defaultSceneText), parsed, error);
+        return parsed;
+    }();
+    return scene;
+}
+
+bool parseScene(const char* text, size_t size, Scene& scene, std::string& error) {
+    scene = Scene();
+    std::vector<std::string> materialNames, textureNames;
+    std::vector<ParsedProp> props;
+
+    std::istringstream lines(std::string(text, size));
+    std::string line;
+    for (int number = 1; std::getline(lines, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        Statement statement(line, number);
+        std::string keyword;
+        if (!statement.word(keyword)) continue;
+
+        if (keyword == "texture") {
+            std::string name, path;
+            if (!statement.word(name) || !statement.word(path)) return statement.fail("expected: texture <name> <path>", error);
+            if (findName(textureNames, name) >= 0) return statement.fail("texture '" + name + "' defined twice", error);
+            textureNames.push_back(name);
+            scene.textures.push_back(path);
+        }
+        else if (keyword == "material") {
+            std::string name, key;
+            SceneMaterial material = {};
+            material.texture = -1;
+            if (!statement.word(name) || !statement.number3(material.color, error)) {
+                return statement.fail("expected: material <name> <r> <g> <b> ...", error);
+            }
+            if (findName(materialNames, name) >= 0) return statement.fail("material '" + name + "' defined twice", error);
+            while (statement.word(key)) {
+                if (key == "emissive") {
+                    if (!statement.number3(material.emissive, error)) return false;
+                }
+                else if (key == "texture") {
+                    std::string texture;
+                    statement.word(texture);
+                    material.texture = findName(textureNames, texture);
+                    if (material.texture < 0) return statement.fail("unknown texture '" + texture + "'", error);
+                }
+                else if (key == "tint") {
+                    std::string tint;
+                    statement.word(tint);
+                    if (tint != "tree") return statement.fail("only 'tint tree' is supported", error);
+                    material.flags |= MATERIAL_TINT_TREE;
+                }
+                else {
+                    return statement.fail("unknown material field '" + key + "'", error);
+                }
+            }
+            materialNames.push_back(name);
+            scene.materials.push_back(material);
+        }
+        else if (keyword == "prop") {
+            if (!parseProp(statement, materialNames, scene, props, error)) return false;
+        }
+        else if (keyword == "light") {
+            if (!parseLight(statement, scene, error)) return false;
+        }
+        else {
+            return statement.fail("unknown statement '" + keyword + "'", error);
+        }
+    }
+
+    // Group the instances by batch, keeping file order within each
+    uint32_t first = 0;
+    std::vector<uint32_t> next(scene.batches.size());
+    for (size_t i = 0; i < scene.batches.size(); ++i) {
+        scene.batches[i].first = next[i] = first;
+        first += scene.batches[i].count;
+    }
+    scene.instances.resize(props.size());
+    for (const ParsedProp& prop : props) scene.instances[next[prop.batch]++] = prop.transform;
+    return true;
+}
+
+std::string compiledScenePath(const std::string& source) {
+    size_t slash = source.find_last_of("/\\");
+    size_t dot = source.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return source + ".rcsc";
+    return source.substr(0, dot) + ".rcsc";
+}
+
+bool writeCompiledScene(const Scene& scene, const std::string& path, std::string& error) {
+    return writeCompiled(scene, path, 0, 0, error);
+}
+
+bool readCompiledScene(const unsigned char* data, size_t size, Scene& scene) {
+    Header header;
+    if (size < compiledHeaderBytes || !readHeader(data, header)) return false;
+    Layout layout = layoutFor(header.counts, header.textureBytes);
+    if (layout.end > size) return false;
+
+    sizeSections(header, scene);
+    auto section = [data](size_t offset, void* out, size_t bytes) {
+        if (bytes) std::memcpy(out, data + offset, bytes);
+    };
+    section(layout.instances, scene.instances.data(), scene.instances.size() * sizeof(glm::mat4));
+    section(layout.materials, scene.materials.data(), scene.materials.size() * sizeof(SceneMaterial));
+    section(layout.batches, scene.batches.data(), scene.batches.size() * sizeof(SceneBatch));
+    section(layout.colliders, scene.colliders.data(), scene.colliders.size() * sizeof(SceneCollider));
+    section(layout.lights, scene.lights.data(), scene.lights.size() * sizeof(SceneLight));
+    return splitTextureNames((const char*)data + layout.textures, header, scene) && validScene(scene);
+}
+
+bool loadScene(const std::string& path, Scene& scene, SceneLoadStats& stats, std::string& error) {
+    auto start = std::chrono::steady_clock::now();
+    stats = SceneLoadStats();
+    uint64_t size, time;
+    if (!fileStamp(path, size, time)) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    if (endsWith(path, ".rcsc")) {
+        stats.compiled = readCompiledFile(path, nullptr, nullptr, scene);
+        if (!stats.compiled) {
+            error = path + ": not a compiled scene";
+            return false;
+        }
+    }
+    else {
+        std::string compiled = compiledScenePath(path);
+        stats.compiled = readCompiledFile(compiled, &size, &time, scene);
+        if (!stats.compiled) {
+            std::ifstream file(path.c_str(), std::ios::binary);
+            if (!file) {
+                error = "cannot read " + path;
+                return false;
+            }
+            std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!parseScene(text.data(), text.size(), scene, error)) {
+                error = path + ": " + error;
+                return false;
+            }
+            // A compiled form that cannot be written only costs the next load a parse
+            std::string ignored;
+            writeCompiled(scene, compiled, size, time, ignored);
+        }
+    }
+
+    stats.props = scene.instances.size();
+    stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Circuit props, their materials and collision, and the lights attached to
+// the cars, loaded from a scene file instead of being compiled in.
+//
+// The text form is one statement per line, '#' starts a comment:
+//
+//   texture  <name> <path>
+//   material <name> <r> <g> <b> [emissive <r> <g> <b>] [texture <name>] [tint tree]
+//   prop     <cube|cylinder|cone> <material> pos <x> <y> <z> [yaw <deg>] [scale <x> <y> <z>]
+//            [space track] [tag trunk|crown] [collider barrier|building|tree] [flatten <hx> <hz>]
+//   light    <headlight|taillight> pos <x> <y> <z> [yaw <deg>] [scale <x> <y> <z>]
+//            [on <r> <g> <b> <glow>] [off <r> <g> <b> <glow>]
+//
+// Props in track space turn with the track rotation. Trunks and crowns follow
+// the tree size and shape toggles, and a "tint tree" material takes the tree
+// colour; a round crown uses its scale as given and a tall one stretches it
+// by tallCrownStretch. A collider is the prop's box; flatten levels the
+// terrain over a rectangle around the prop. Lights are placed in car space
+// and are on with the headlights or the brakes.
+//
+// The compiled form (.rcsc) is these structures as they are in memory,
+// little-endian, each section 16-byte aligned: loading copies every section
+// straight into its vector, and instances are grouped by batch so the
+// renderer uploads them to its instance buffer in one call.
+
+enum PropMesh : uint32_t { PROP_CUBE, PROP_CYLINDER, PROP_CONE, PROP_MESH_COUNT };
+enum PropSpace : uint32_t { SPACE_WORLD, SPACE_TRACK };
+enum PropTag : uint32_t { TAG_NONE, TAG_TRUNK, TAG_CROWN };
+enum MaterialFlags : uint32_t { MATERIAL_TINT_TREE = 1 };
+enum LightKind : uint32_t { LIGHT_HEADLIGHT, LIGHT_TAILLIGHT };
+
+struct SceneMaterial {
+    glm::vec3 color;
+    uint32_t flags;
+    glm::vec3 emissive;
+    int32_t texture;            // into Scene::textures, -1 for none
+};
+
+// Instances [first, first + count) share a mesh, material, space and tag.
+struct SceneBatch {
+    uint32_t mesh;
+    uint32_t material;
+    uint32_t space;
+    uint32_t tag;
+    uint32_t first;
+    uint32_t count;
+    uint32_t pad[2];
+};
+
+struct SceneCollider {
+    glm::vec3 center;           // in the prop's space
+    float yaw;                  // degrees, car convention
+    glm::vec3 halfExtents;
+    uint32_t kind;              // ColliderKind, or noCollider
+    glm::vec2 flattenHalf;      // 0 for none
+    uint32_t space;
+    uint32_t tag;
+};
+
+// A headlight is a cone pointing forward, turned by yaw towards the centre
+// line; a taillight is a box. Emission is the colour times its glow.
+struct SceneLight {
+    uint32_t kind;
+    float yaw;                  // degrees
+    glm::vec3 offset;
+    glm::vec3 scale;
+    glm::vec3 onColor;
+    glm::vec3 offColor;
+    float onGlow;
+    float offGlow;
+};
+
+const uint32_t noCollider = 0xFFFFFFFFu;
+const glm::vec3 tallCrownStretch = glm::vec3(0.8f, 4.0f / 3.0f, 0.8f);
+
+static_assert(sizeof(SceneMaterial) == 32 && sizeof(SceneBatch) == 32 && sizeof(SceneCollider) == 48
+    && sizeof(SceneLight) == 64 && sizeof(glm::mat4) == 64, "scene sections are written as laid out");
+
+struct Scene {
+    std::vector<std::string> textures;
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneBatch> batches;
+    std::vector<glm::mat4> instances;       // translate * yaw * scale, grouped by batch
+    std::vector<SceneCollider> colliders;   // file order, props with a collider or flatten
+    std::vector<SceneLight> lights;
+};
+
+struct SceneLoadStats {
+    bool compiled;              // read from the binary form
+    size_t props;
+    double loadMs;
+};
+
+// The layout the simulator shipped with, used when no scene file is given.
+const Scene& defaultScene();
+
+// Parses the text form. Errors name the line.
+bool parseScene(const char* text, size_t size, Scene& scene, std::string& error);
+
+// Where the compiled form of a scene file lives: track.scene -> track.rcsc.
+std::string compiledScenePath(const std::string& source);
+
+bool writeCompiledScene(const Scene& scene, const std::string& path, std::string& error);
+// Copies a compiled scene out of memory, for example an asset pack view.
+bool readCompiledScene(const unsigned char* data, size_t size, Scene& scene);
+
+// A .rcsc path is read as is. A text scene is read through its compiled
+// form when that is newer, and otherwise parsed and compiled for next time.
+bool loadScene(const std::string& path, Scene& scene, SceneLoadStats& stats, std::string& error);
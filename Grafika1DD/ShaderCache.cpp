@@ -0,0 +1,194 @@
+#include "ShaderCache.h"
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+    const char cacheMagic[4] = { 'R', 'C', 'S', 'P' };
+    const uint32_t cacheVersion = 1;
+    // Anything bigger is a corrupt length field, not a program
+    const uint32_t maxBinaryBytes = 64u << 20;
+
+    // FNV-1a; stable across runs and compilers, unlike std::hash
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t hashString(uint64_t hash, const std::string& text) {
+        // The terminator keeps "ab"+"c" and "a"+"bc" apart
+        return hashBytes(hash, text.c_str(), text.size() + 1);
+    }
+
+    const uint64_t hashSeed = 14695981039346656037ull;
+
+    std::string glString(GLenum name) {
+        const GLubyte* text = glGetString(name);
+        return text ? (const char*)text : "";
+    }
+
+    void writeU32(std::ofstream& file, uint32_t value) {
+        unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8),
+            (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+        file.write((const char*)bytes, 4);
+    }
+
+    void writeU64(std::ofstream& file, uint64_t value) {
+        writeU32(file, (uint32_t)value);
+        writeU32(file, (uint32_t)(value >> 32));
+    }
+
+    bool readU32(std::ifstream& file, uint32_t& value) {
+        unsigned char bytes[4];
+        if (!file.read((char*)bytes, 4)) return false;
+        value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        return true;
+    }
+
+    bool readU64(std::ifstream& file, uint64_t& value) {
+        uint32_t low, high;
+        if (!readU32(file, low) || !readU32(file, high)) return false;
+        value = low | ((uint64_t)high << 32);
+        return true;
+    }
+
+    void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    }
+}
+
+ShaderCache::ShaderCache(const std::string& directory)
+    : directory(directory) {
+}
+
+void ShaderCache::init() {
+    driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+    supported = false;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    if (supported) makeDirectory(directory);
+}
+
+uint64_t ShaderCache::programKey(const char* vertexSource, const char* fragmentSource, const std::string& defines) const {
+    uint64_t hash = hashBytes(hashSeed, &cacheVersion, sizeof(cacheVersion));
+    hash = hashString(hash, vertexSource);
+    hash = hashString(hash, fragmentSource);
+    hash = hashString(hash, defines);
+    return hashString(hash, driver);
+}
+
+unsigned int ShaderCache::load(const std::string& name, uint64_t key) {
+    if (!supported) return 0;
+    std::string file = path(name);
+    std::ifstream in(file.c_str(), std::ios::binary);
+    if (!in) return 0;
+
+    char magic[4];
+    uint32_t version, format, size;
+    uint64_t storedKey, checksum;
+    if (!in.read(magic, 4) || std::memcmp(magic, cacheMagic, 4) != 0) return 0;
+    if (!readU32(in, version) || version != cacheVersion) return 0;
+    if (!readU64(in, storedKey) || storedKey != key) return 0;
+    if (!readU32(in, format) || !readU32(in, size) || !readU64(in, checksum)) return 0;
+    if (size == 0 || size > maxBinaryBytes) return 0;
+    std::vector<char> binary(size);
+    if (!in.read(binary.data(), size)) return 0;
+    in.close();
+    if (hashBytes(hashSeed, binary.data(), size) != checksum) {
+        std::remove(file.c_str());
+        return 0;
+    }
+
+    // Drivers may reject their own binaries after an update that kept the
+    // version string; the link status is the only reliable check
+    while (glGetError() != GL_NO_ERROR) {}
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, (GLenum)format, binary.data(), (GLsizei)size);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (glGetError() != GL_NO_ERROR || !linked) {
+        glDeleteProgram(program);
+        std::remove(file.c_str());
+        return 0;
+    }
+    return program;
+}
+
+void ShaderCache::prepare(unsigned int program) const {
+    if (supported) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ShaderCache::save(const std::string& name, uint64_t key, unsigned int program) {
+    if (!supported) return false;
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0 || (uint32_t)size > maxBinaryBytes) return false;
+
+    std::vector<char> binary(size);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, size, &written, &format, binary.data());
+    if (written <= 0) return false;
+
+    std::string file = path(name);
+    std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(cacheMagic, 4);
+    writeU32(out, cacheVersion);
+    writeU64(out, key);
+    writeU32(out, (uint32_t)format);
+    writeU32(out, (uint32_t)written);
+    writeU64(out, hashBytes(hashSeed, binary.data(), written));
+    out.write(binary.data(), written);
+    if (out) return true;
+
+    // Never leave a half written file behind to be read next launch
+    out.close();
+    std::remove(file.c_str());
+    return false;
+}
+
+std::string ShaderCache::path(const std::string& name) const {
+    return directory + "/" + name + ".bin";
+}
+
+std::string shaderSourceWithDefines(const char* source, const std::string& defines) {
+    std::string text = source;
+    if (defines.empty()) return text;
+
+    std::string lines;
+    std::istringstream list(defines);
+    std::string define;
+    while (list >> define) {
+        size_t equals = define.find('=');
+        if (equals == std::string::npos) lines += "#define " + define + "\n";
+        else lines += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+    }
+
+    // #version has to stay the first statement
+    size_t version = text.find("#version");
+    size_t at = version == std::string::npos ? 0 : text.find('\n', version);
+    if (at == std::string::npos) return text + "\n" + lines;
+    if (version != std::string::npos) ++at;
+    return text.insert(at, lines);
+}
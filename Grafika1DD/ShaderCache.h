@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked shader programs (GL_ARB_get_program_binary).
+// Each program is stored under its name in the cache directory, tagged
+// with a key that hashes its sources, its variant defines and the driver's
+// vendor, renderer and version strings, so an edited shader or an updated
+// driver simply misses. A binary the driver refuses (unknown format, failed
+// link) is deleted and the caller compiles from source as before.
+//
+// Everything runs on the GL thread with the context current.
+class ShaderCache {
+public:
+    explicit ShaderCache(const std::string& directory = "shadercache");
+
+    // Reads the driver strings and checks binary support; call after glewInit.
+    void init();
+    // False when the driver exposes no program binary formats.
+    bool enabled() const { return supported; }
+
+    // Key of a program variant for the current driver.
+    uint64_t programKey(const char* vertexSource, const char* fragmentSource, const std::string& defines) const;
+
+    // A linked program from the cached binary, 0 on a miss or a rejected binary.
+    unsigned int load(const std::string& name, uint64_t key);
+    // Call on a program before glLinkProgram so its binary can be retrieved.
+    void prepare(unsigned int program) const;
+    // Stores the linked program's binary under name.
+    bool save(const std::string& name, uint64_t key, unsigned int program);
+
+private:
+    std::string path(const std::string& name) const;
+
+    std::string directory;
+    std::string driver;         // vendor, renderer and version
+    bool supported = false;
+};
+
+// Source with a #define line per variant define inserted after its #version
+// line. defines is a space separated list of NAME or NAME=VALUE.
+std::string shaderSourceWithDefines(const char* source, const std::string& defines);
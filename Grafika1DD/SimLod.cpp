@@ -0,0 +1,175 @@
+#include "DetMath.h"
+#include "SimLod.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Body height above the ground the reduced tiers hold the car at; the
+    // full model settles within this band, anything outside it (a car thrown
+    // by a collision) is pulled back rather than carried along
+    const float minClearance = 0.3f;
+    const float maxClearance = 0.7f;
+
+    // Writes a level pose moving along the heading at `speed`. Keeps the
+    // height above the terrain and the heading continuous, and spins the
+    // wheels to match, so the full model can pick the car up again.
+    void setPlanarPose(CarState& car, const glm::vec2& pos, float rotation, float speed, float dt,
+        const Terrain& terrain, const CarParams& p) {
+        float clearance = clampf(car.pos.y - terrain.height(car.pos.x, car.pos.z), minClearance, maxClearance);
+        float yawRate = dt > 0.0f ? glm::radians(wrapDegrees(rotation - car.rotation)) / dt : 0.0f;
+
+        setCarHeading(car, car.rotation + wrapDegrees(rotation - car.rotation));
+        float s, c;
+        detSinCos(glm::radians(car.rotation), s, c);
+        car.pos = glm::vec3(pos.x, terrain.height(pos.x, pos.y) + clearance, pos.y);
+        car.velocity = glm::vec3(s, 0.0f, c) * speed;
+        car.angularVelocity = glm::vec3(0.0f, yawRate, 0.0f);
+        car.speed = speed;
+        for (int i = 0; i < 4; ++i) {
+            car.wheelSpin[i] = speed / p.wheelRadius;
+            car.wheelAngle[i] += car.wheelSpin[i] * dt;
+        }
+        car.substeps = 0;
+    }
+
+    // Kinematic bicycle model: the same driver controls and limits as the
+    // full model, but no tyre slip, suspension or pitch and roll. The
+    // surface only changes the rolling resistance.
+    void stepKinematic(CarState& car, const CarInput& input, float dt, const WheelGround* ground,
+        const Terrain& terrain, const CarParams& p) {
+        float throttle = clampf(input.throttle, -1.0f, 1.0f);
+        float steer = clampf(input.steer, -1.0f, 1.0f);
+        float speed = car.speed;
+
+        float targetSteer = steer * p.maxSteer / (1.0f + p.steerSpeedFalloff * std::abs(speed));
+        float maxSteerDelta = p.steerRate * dt;
+        car.steerAngle += clampf(targetSteer - car.steerAngle, -maxSteerDelta, maxSteerDelta);
+
+        // Forces at the contact patches, as totals over the four wheels
+        float force = 0.0f, brake = 0.0f;
+        if (throttle > 0.0f) {
+            if (speed > -1.0f) force = throttle * p.driveTorque * clampf((p.maxSpeed - speed) / (p.maxSpeed * 0.2f), 0.0f, 1.0f);
+            else brake = throttle * p.brakeTorque;
+        }
+        else if (throttle < 0.0f) {
+            float reverseSpeed = p.maxSpeed * 0.5f;
+            if (speed > 1.0f) brake = -throttle * p.brakeTorque;
+            else force = throttle * p.driveTorque * 0.5f * clampf((reverseSpeed + speed) / (reverseSpeed * 0.2f), 0.0f, 1.0f);
+        }
+        else {
+            brake = p.engineBrakeTorque;
+        }
+        force /= p.wheelRadius;
+        float rolling = 0.25f * (ground[0].rollingResistance + ground[1].rollingResistance
+            + ground[2].rollingResistance + ground[3].rollingResistance);
+        float resist = brake / p.wheelRadius + p.rollingResistance * rolling * p.mass * gravity;
+
+        float newSpeed = speed + (force - p.drag * speed * std::abs(speed)) / p.mass * dt;
+        // Brakes and rolling resistance stop the car but never reverse it
+        float slow = resist / p.mass * dt;
+        if (newSpeed > slow) newSpeed -= slow;
+        else if (newSpeed < -slow) newSpeed += slow;
+        else newSpeed = 0.0f;
+
+        float averageSpeed = 0.5f * (speed + newSpeed);
+        float yawRate = averageSpeed * glm::radians(car.steerAngle) / wheelBase;
+        float rotation = car.rotation + glm::degrees(yawRate * dt);
+
+        float s, c;
+        detSinCos(glm::radians(car.rotation + glm::degrees(yawRate * dt) * 0.5f), s, c);
+        glm::vec2 pos = glm::vec2(car.pos.x, car.pos.z) + glm::vec2(s, c) * (averageSpeed * dt);
+        setPlanarPose(car, pos, rotation, newSpeed, dt, terrain, p);
+    }
+
+    // Moves the car along the racing line for dt seconds, keeping its
+    // sideways offset from the line, easing towards the line's target speed.
+    // A driver lifting or braking (for a car ahead) slows it down instead.
+    void followLine(CarState& car, const CarInput& input, float dt, const RacingLine& line, const Terrain& terrain, const CarParams& p) {
+        const int points = line.size();
+        glm::vec2 pos(car.pos.x, car.pos.z);
+
+        int nearest = nearestLinePoint(line, pos, car.trackSegment);
+
+        // Project onto the segment after the nearest point, or the one before
+        auto point = [&](int j) { j = (j % points + points) % points; return glm::vec2(line.x[j], line.z[j]); };
+        int segment = nearest;
+        glm::vec2 a = point(segment), b = point(segment + 1);
+        float t = glm::dot(pos - a, b - a) / std::max(glm::dot(b - a, b - a), 1e-12f);
+        if (t < 0.0f) {
+            segment = nearest - 1;
+            a = point(segment);
+            b = point(segment + 1);
+            t = glm::dot(pos - a, b - a) / std::max(glm::dot(b - a, b - a), 1e-12f);
+        }
+        t = clampf(t, 0.0f, 1.0f);
+
+        glm::vec2 direction = (b - a) / detSqrt(std::max(glm::dot(b - a, b - a), 1e-12f));
+        glm::vec2 side(direction.y, -direction.x);
+        // Cars pushed off the lane are brought back inside it
+        float offset = clampf(glm::dot(pos - (a + (b - a) * t), side), -line.maxOffset, line.maxOffset);
+
+        int index = (segment % points + points) % points;
+        float speed = line.speed[index] + (line.speed[(index + 1) % points] - line.speed[index]) * t;
+        float current = std::max(car.speed, 0.0f);
+        if (input.throttle > 0.0f) speed = 0.5f * (current + speed);
+        else {
+            float brake = input.throttle < 0.0f ? -input.throttle * p.brakeTorque : p.engineBrakeTorque;
+            speed = std::max(current - brake / (p.wheelRadius * p.mass) * dt, 0.0f);
+        }
+
+        // Walk the polyline
+        float remaining = speed * dt;
+        for (int guard = 0; guard < points; ++guard) {
+            float segmentLength = detSqrt(glm::dot(b - a, b - a));
+            float left = (1.0f - t) * segmentLength;
+            if (remaining <= left || segmentLength <= 0.0f) {
+                t += segmentLength > 0.0f ? remaining / segmentLength : 0.0f;
+                break;
+            }
+            remaining -= left;
+            ++segment;
+            a = b;
+            b = point(segment + 1);
+            t = 0.0f;
+        }
+
+        direction = (b - a) / detSqrt(std::max(glm::dot(b - a, b - a), 1e-12f));
+        side = glm::vec2(direction.y, -direction.x);
+        glm::vec2 newPos = a + (b - a) * t + side * offset;
+        float rotation = glm::degrees(detAtan2(direction.x, direction.y));
+        car.steerAngle = 0.0f;
+        setPlanarPose(car, newPos, rotation, speed, dt, terrain, p);
+    }
+}
+
+SimLodTier simLodTier(float distanceSq, const SimLodConfig& config) {
+    if (!config.enabled || distanceSq < config.nearDistance * config.nearDistance) return LOD_NEAR;
+    if (distanceSq < config.farDistance * config.farDistance) return LOD_MID;
+    return LOD_FAR;
+}
+
+void stepCarLod(CarState& car, SimLodTier tier, bool midTick, const CarInput& input, float deltaTime,
+    const WheelGround* ground, const Terrain& terrain, const RacingLine* line, const CarParams& params) {
+    car.lodDebt += deltaTime;
+
+    switch (tier) {
+    case LOD_NEAR:
+        // Catch up on time a reduced-rate tier still owes, then run the full model
+        if (car.lodDebt > deltaTime) stepKinematic(car, input, car.lodDebt - deltaTime, ground, terrain, params);
+        stepCar(car, input, deltaTime, params, ground);
+        car.lodDebt = 0.0f;
+        break;
+    case LOD_MID:
+        if (midTick) {
+            stepKinematic(car, input, car.lodDebt, ground, terrain, params);
+            car.lodDebt = 0.0f;
+        }
+        break;
+    case LOD_FAR:
+        if (line && !line->empty()) followLine(car, input, car.lodDebt, *line, terrain, params);
+        else stepKinematic(car, input, car.lodDebt, ground, terrain, params);
+        car.lodDebt = 0.0f;
+        break;
+    }
+    car.lodTier = tier;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "CarPhysics.h"
+#include "RacingLine.h"
+#include "Terrain.h"
+#include <glm/glm.hpp>
+
+// Simulation level of detail. Cars near a focus car run the full tyre and
+// suspension model every tick; mid-range cars run a kinematic bicycle model
+// every midInterval ticks; far cars slide along the racing line at the
+// line's target speed. Every tier reads and writes the same CarState, and
+// time a reduced-rate tier has not simulated yet is carried in lodDebt, so
+// a car can change tier on any tick without a jump or lost time.
+//
+// Tiers depend only on simulation state (the distance to the nearest
+// human-driven car, not the render camera), so replays stay deterministic.
+enum SimLodTier {
+    LOD_NEAR = 0,
+    LOD_MID = 1,
+    LOD_FAR = 2
+};
+
+struct SimLodConfig {
+    bool enabled = true;
+    float nearDistance = 25.0f;   // full model inside this radius
+    float farDistance = 45.0f;    // racing line extrapolation beyond this
+    int midInterval = 4;          // ticks between mid-tier updates
+};
+
+// Tier for a car at squared distance distanceSq from the nearest focus.
+SimLodTier simLodTier(float distanceSq, const SimLodConfig& config);
+
+// Advances one car by one tick at the given tier. ground is the sampled
+// plane and surface under each wheel (the kinematic model only uses the
+// surface's rolling resistance); line is null for cars without a
+// racing line, which then use the mid-range model when far. midTick says
+// whether this tick is the car's turn for a mid-tier update.
+void stepCarLod(CarState& car, SimLodTier tier, bool midTick, const CarInput& input, float deltaTime,
+    const WheelGround* ground, const Terrain& terrain, const RacingLine* line,
+    const CarParams& params = CarParams());
@@ -0,0 +1,86 @@
+#include "DetMath.h"
+#include "SimState.h"
+#include <atomic>
+#include <cstring>
+
+namespace {
+    std::atomic<uint64_t> versionCounter{ 1 };
+
+    uint64_t nextVersion() {
+        return versionCounter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void copyChanged(SimState& dst, const SimState& src) {
+        std::memcpy(&dst, &src, offsetof(SimState, carVersion));
+        for (int i = 0; i < src.carCount; ++i) {
+            if (dst.carVersion[i] != src.carVersion[i]) {
+                dst.carVersion[i] = src.carVersion[i];
+                dst.cars[i] = src.cars[i];
+            }
+        }
+    }
+}
+
+void initSimState(SimState& state) {
+    std::memset(&state, 0, sizeof(SimState));
+
+    CameraState& camera = state.camera;
+    camera.mode = CHASE;
+    camera.pos = glm::vec3(0.0f, 5.0f, 10.0f);
+    camera.target = glm::vec3(0.0f, 0.0f, 0.0f);
+    camera.angle = 0.0f;
+    camera.orbitalDirection = 1.0f;
+    camera.freecamDistance = 12.0f;
+    camera.freecamYaw = -90.0f;
+    camera.freecamPitch = 0.0f;
+    camera.freecamPanX = 0.0f;
+    camera.freecamPanY = 0.0f;
+
+    EnvironmentState& env = state.env;
+    env.isNight = false;
+    env.timeOfDay = 0.5f;
+    env.headlightsOn = false;
+    env.trackRotation = 0.0f;
+    env.treeSize = 1.0f;
+    env.treeColor = glm::vec3(0.2f, 0.8f, 0.2f);
+    env.treeShapeIsRound = false;
+
+    state.rngState = 0x12345678u;
+    state.tick = 0;
+    state.carCount = 1;
+    for (int i = 0; i < maxCars; ++i) {
+        state.cars[i] = makeCar(glm::vec3(0.0f, 0.5f, 0.0f), 0.0f);
+        state.carVersion[i] = nextVersion();
+    }
+}
+
+CarState& simCarForWrite(SimState& state, int index) {
+    state.carVersion[index] = nextVersion();
+    return state.cars[index];
+}
+
+float simRandom(SimState& state) {
+    uint32_t x = state.rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    state.rngState = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+void simSnapshot(const SimState& src, SimState& dst) {
+    copyChanged(dst, src);
+}
+
+void simRestore(SimState& state, const SimState& snapshot) {
+    copyChanged(state, snapshot);
+}
+
+uint64_t hashSimState(const SimState& state, uint64_t hash) {
+    hash = hashBytes(&state.tick, sizeof(state.tick), hash);
+    hash = hashBytes(&state.rngState, sizeof(state.rngState), hash);
+    for (int i = 0; i < state.carCount; ++i) {
+        hash = hashCarState(state.cars[i], hash);
+    }
+    return hash;
+}
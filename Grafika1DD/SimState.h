@@ -0,0 +1,74 @@
+#pragma once
+#include "CarPhysics.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+const int maxCars = 256;
+const int playerCarIndex = 0;
+
+enum CameraMode { CHASE, COCKPIT, SIDE, ORBITAL, FREECAM };
+
+struct CameraState {
+    CameraMode mode;
+    glm::vec3 pos;
+    glm::vec3 target;
+    float angle;
+    float orbitalDirection;
+    float freecamDistance;
+    float freecamYaw;
+    float freecamPitch;
+    float freecamPanX;
+    float freecamPanY;
+};
+
+struct EnvironmentState {
+    bool isNight;
+    float timeOfDay; // 0 = night, 1 = day
+    bool headlightsOn;
+    float trackRotation;
+    float treeSize;
+    glm::vec3 treeColor;
+    bool treeShapeIsRound;
+};
+
+// The complete simulation state in one trivially copyable block.
+//
+// Everything before carVersion is small and copied whole by a snapshot.
+// Each car slot carries a version stamp that changes on every write made
+// through simCarForWrite(); a snapshot or restore copies only the slots
+// whose stamp differs between source and destination. Stamps come from a
+// process-wide counter, so one baseline can be restored into many branches
+// and each branch still copies only what it changed.
+struct SimState {
+    CameraState camera;
+    EnvironmentState env;
+    uint32_t rngState;
+    int carCount;
+    int aiCarCount;     // the last aiCarCount cars are driven by the AI
+    uint64_t tick;
+
+    uint64_t carVersion[maxCars];
+    CarState cars[maxCars];
+};
+
+static_assert(std::is_trivially_copyable<SimState>::value,
+    "SimState must stay trivially copyable for snapshots");
+
+void initSimState(SimState& state);
+
+// Returns a car for modification and stamps it as changed.
+CarState& simCarForWrite(SimState& state, int index);
+
+// Uniform float in [0, 1) from the state's own generator (replaces rand()).
+float simRandom(SimState& state);
+
+// Copies src into dst, skipping car slots that are already identical.
+// dst must start value-initialised (SimState s{}) or as an earlier copy.
+void simSnapshot(const SimState& src, SimState& dst);
+void simRestore(SimState& state, const SimState& snapshot);
+
+// Hash of everything the simulation advances (cars, RNG, tick). The camera
+// is left out because it follows the frame rate, not the tick.
+uint64_t hashSimState(const SimState& state, uint64_t hash);
@@ -0,0 +1,86 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+// Four lanes of floats. Compiles to SSE2 where available and to plain loops
+// otherwise, so kernels are written once. Only IEEE basic operations are
+// used, so both paths give bit-identical results.
+namespace simd {
+
+#ifdef SIMD_SSE
+    struct F4 {
+        __m128 v;
+        F4() {}
+        F4(__m128 x) : v(x) {}
+        F4(float x) : v(_mm_set1_ps(x)) {}
+    };
+    inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+    inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+    inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+    inline F4 operator/(F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+    inline F4 vmin(F4 a, F4 b) { return _mm_min_ps(a.v, b.v); }
+    inline F4 vmax(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+    inline F4 vabs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    inline F4 vsqrt(F4 a) { return _mm_sqrt_ps(a.v); }
+    inline F4 cmpLe(F4 a, F4 b) { return _mm_cmple_ps(a.v, b.v); }
+    inline F4 cmpLt(F4 a, F4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline F4 cmpGt(F4 a, F4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline F4 cmpGe(F4 a, F4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline F4 maskAnd(F4 a, F4 b) { return _mm_and_ps(a.v, b.v); }
+    inline F4 select(F4 mask, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+    inline int maskBits(F4 mask) { return _mm_movemask_ps(mask.v); }
+    inline F4 load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, F4 a) { _mm_storeu_ps(p, a.v); }
+    // Truncates toward zero; lanes must be within int range.
+    inline void truncToInt(F4 a, int* out) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvttps_epi32(a.v)); }
+    inline F4 toFloat(const int* in) { return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))); }
+#else
+    struct F4 {
+        float v[4];
+        F4() {}
+        F4(float x) { v[0] = v[1] = v[2] = v[3] = x; }
+    };
+    template <typename Op>
+    inline F4 lanes(F4 a, F4 b, Op op) {
+        F4 r;
+        for (int i = 0; i < 4; ++i) r.v[i] = op(a.v[i], b.v[i]);
+        return r;
+    }
+    inline float maskOf(bool b) { uint32_t bits = b ? 0xFFFFFFFFu : 0u; float f; std::memcpy(&f, &bits, 4); return f; }
+    inline bool isSet(float f) { uint32_t bits; std::memcpy(&bits, &f, 4); return bits != 0; }
+    inline F4 operator+(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x + y; }); }
+    inline F4 operator-(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x - y; }); }
+    inline F4 operator*(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x * y; }); }
+    inline F4 operator/(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x / y; }); }
+    inline F4 vmin(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    inline F4 vmax(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    inline F4 vabs(F4 a) { return lanes(a, a, [](float x, float) { return std::fabs(x); }); }
+    inline F4 vsqrt(F4 a) { return lanes(a, a, [](float x, float) { return std::sqrt(x); }); }
+    inline F4 cmpLe(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x <= y); }); }
+    inline F4 cmpLt(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x < y); }); }
+    inline F4 cmpGt(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x > y); }); }
+    inline F4 cmpGe(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x >= y); }); }
+    inline F4 maskAnd(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(isSet(x) && isSet(y)); }); }
+    inline F4 select(F4 mask, F4 a, F4 b) {
+        F4 r;
+        for (int i = 0; i < 4; ++i) r.v[i] = isSet(mask.v[i]) ? a.v[i] : b.v[i];
+        return r;
+    }
+    inline int maskBits(F4 mask) {
+        int bits = 0;
+        for (int i = 0; i < 4; ++i) bits |= isSet(mask.v[i]) ? (1 << i) : 0;
+        return bits;
+    }
+    inline F4 load(const float* p) { F4 r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+    inline void store(float* p, F4 a) { std::memcpy(p, a.v, sizeof(a.v)); }
+    inline void truncToInt(F4 a, int* out) { for (int i = 0; i < 4; ++i) out[i] = (int)a.v[i]; }
+    inline F4 toFloat(const int* in) { F4 r; for (int i = 0; i < 4; ++i) r.v[i] = (float)in[i]; return r; }
+#endif
+
+}
@@ -0,0 +1,130 @@
+#include "DetMath.h"
+#include "Simulation.h"
+#include "AiDriver.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+void updateSimWorld(SimWorld& world, const EnvironmentState& env) {
+    const Scene& scene = world.scene ? *world.scene : defaultScene();
+    bool sameScene = world.built && world.builtScene == &scene;
+    if (sameScene && world.builtTrackRotation == env.trackRotation && world.builtTreeSize == env.treeSize) {
+        return;
+    }
+    if (!sameScene || world.builtTrackRotation != env.trackRotation) {
+        buildTerrain(scene, env, world.terrain);
+        buildRacingLine(env, CarParams(), world.racingLine);
+        world.track.build(world.racingLine);
+    }
+    buildStaticColliders(scene, env, world.staticBoxes);
+    world.collisions.setStaticColliders(world.staticBoxes);
+    buildSurfaceGrid(env, world.staticBoxes, world.terrain, world.surfaces);
+    world.nav.update(world.surfaces);
+    world.recoveryRoutes.clear();
+    buildWorldTriangles(env, world.staticBoxes, &world.terrain, world.triangles);
+    world.bvh.build(world.triangles);
+    world.builtScene = &scene;
+    world.builtTrackRotation = env.trackRotation;
+    world.builtTreeSize = env.treeSize;
+    world.built = true;
+}
+
+void sampleWheelGround(const Terrain& terrain, const SurfaceGrid& surfaces, const SimState& state,
+    WheelGroundBatch& batch) {
+    size_t wheels = (size_t)state.carCount * 4;
+    batch.points.resize(wheels);
+    batch.heights.resize(wheels);
+    batch.normals.resize(wheels);
+    batch.surfaces.resize(wheels);
+    batch.ground.resize(wheels);
+
+    for (int i = 0; i < state.carCount; ++i) {
+        glm::vec3 mounts[4];
+        carWheelMounts(state.cars[i], mounts);
+        for (int w = 0; w < 4; ++w) batch.points[i * 4 + w] = glm::vec2(mounts[w].x, mounts[w].z);
+    }
+    terrain.sample(batch.points.data(), (int)wheels, batch.heights.data(), batch.normals.data());
+    surfaces.sample(batch.points.data(), (int)wheels, batch.surfaces.data());
+    for (size_t w = 0; w < wheels; ++w) {
+        const glm::vec2& p = batch.points[w];
+        const SurfaceMaterial& material = surfaceMaterials[batch.surfaces[w]];
+        batch.ground[w].point = glm::vec3(p.x, batch.heights[w], p.y);
+        batch.ground[w].normal = batch.normals[w];
+        batch.ground[w].grip = material.grip;
+        batch.ground[w].rollingResistance = material.rollingResistance;
+    }
+}
+
+void stepSimulation(SimState& state, SimWorld& world, const CarInput* inputs, float deltaTime) {
+    ++state.tick;
+
+    sampleWheelGround(world.terrain, world.surfaces, state, world.wheels);
+    world.previousPositions.resize(state.carCount);
+    for (int i = 0; i < state.carCount; ++i) world.previousPositions[i] = state.cars[i].pos;
+
+    int driven = state.carCount - state.aiCarCount;
+    world.inputs.resize(state.carCount);
+    std::copy(inputs, inputs + driven, world.inputs.begin());
+    driveAiCars(world.racingLine, state, driven, state.aiCarCount, world.inputs.data() + driven);
+    recoverAiCars(world.nav, world.track, world.racingLine, state, driven, state.aiCarCount,
+        world.inputs.data() + driven, world.recoveryRoutes, world.navSearch);
+
+    // Human-driven cars see full detail around them; with none, car 0 does
+    world.lodFocus.clear();
+    for (int i = 0; i < std::max(driven, std::min(state.carCount, 1)); ++i) {
+        world.lodFocus.push_back(glm::vec2(state.cars[i].pos.x, state.cars[i].pos.z));
+    }
+    world.sensorActive.resize(state.carCount);
+
+    const WheelGround* ground = world.wheels.ground.data();
+    const CarInput* carInputs = world.inputs.data();
+    const int midInterval = std::max(world.lod.midInterval, 1);
+    jobSystem().parallelFor(state.carCount, 16, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            CarState& car = simCarForWrite(state, i);
+            float distanceSq = 3.0e38f;
+            for (const glm::vec2& focus : world.lodFocus) {
+                glm::vec2 d = glm::vec2(car.pos.x, car.pos.z) - focus;
+                distanceSq = std::min(distanceSq, glm::dot(d, d));
+            }
+            SimLodTier tier = simLodTier(distanceSq, world.lod);
+            // Mid-range updates are staggered so each tick does a share of them
+            bool midTick = (state.tick + (uint64_t)i) % (uint64_t)midInterval == 0;
+            const RacingLine* line = i >= driven ? &world.racingLine : nullptr;
+
+            stepCarLod(car, tier, midTick, carInputs[i], deltaTime, ground + i * 4, world.terrain, line);
+            world.sensorActive[i] = tier == LOD_NEAR || (tier == LOD_MID && midTick);
+        }
+    });
+
+    world.collisions.resolve(state, world.previousPositions.data());
+
+    jobSystem().parallelFor(state.carCount, 64, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) updateTrackProgress(world.track, simCarForWrite(state, i), deltaTime);
+    });
+
+    size_t readings = (size_t)state.carCount * world.sensors.rayCount;
+    world.sensorDistances.resize(readings);
+    world.sensorSurfaces.resize(readings);
+    castCarSensors(world.bvh, state.cars, state.carCount, world.sensors,
+        world.sensorDistances.data(), world.sensorSurfaces.data(), world.sensorActive.data());
+}
+
+void stepRace(SimState& state, const SimWorld& world, const RacingLine& line, const CarParams& params,
+    RaceScratch& scratch, float deltaTime) {
+    ++state.tick;
+
+    sampleWheelGround(world.terrain, world.surfaces, state, scratch.wheels);
+    scratch.previousPositions.resize(state.carCount);
+    for (int i = 0; i < state.carCount; ++i) scratch.previousPositions[i] = state.cars[i].pos;
+
+    scratch.inputs.resize(state.carCount);
+    driveAiCars(line, state, 0, state.carCount, scratch.inputs.data(), params);
+    recoverAiCars(world.nav, world.track, line, state, 0, state.carCount, scratch.inputs.data(),
+        scratch.recoveryRoutes, scratch.navSearch, params);
+
+    for (int i = 0; i < state.carCount; ++i) {
+        stepCar(simCarForWrite(state, i), scratch.inputs[i], deltaTime, params, &scratch.wheels.ground[i * 4]);
+    }
+    scratch.collisions.resolve(state, scratch.previousPositions.data());
+    for (int i = 0; i < state.carCount; ++i) updateTrackProgress(world.track, simCarForWrite(state, i), deltaTime);
+}
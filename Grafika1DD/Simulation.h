@@ -0,0 +1,103 @@
+#pragma once
+#include "AiDriver.h"
+#include "Collision.h"
+#include "NavGrid.h"
+#include "RacingLine.h"
+#include "Raycast.h"
+#include "Scene.h"
+#include "SimLod.h"
+#include "SimState.h"
+#include "SurfaceGrid.h"
+#include "Terrain.h"
+#include "TrackProgress.h"
+#include "WorldGeometry.h"
+#include <vector>
+
+// Ground planes and surfaces under every wheel of every car, four per car,
+// sampled with one terrain query and one surface query.
+struct WheelGroundBatch {
+    std::vector<glm::vec2> points;
+    std::vector<float> heights;
+    std::vector<glm::vec3> normals;
+    std::vector<uint8_t> surfaces;
+    std::vector<WheelGround> ground;
+};
+
+void sampleWheelGround(const Terrain& terrain, const SurfaceGrid& surfaces, const SimState& state,
+    WheelGroundBatch& batch);
+
+// Data derived from the scene and the environment toggles: terrain, racing
+// line, track index, surface grid, navigation grid, static colliders, the
+// collision broadphase and the ray BVH.
+// Rebuilt by updateSimWorld() when the layout changes and never part of a
+// snapshot.
+struct SimWorld {
+    // Props to build from, defaultScene() when null. Must outlive the world.
+    const Scene* scene = nullptr;
+
+    Terrain terrain;
+    RacingLine racingLine;
+    TrackIndex track;
+    std::vector<StaticBox> staticBoxes;
+    SurfaceGrid surfaces;
+    NavGrid nav;
+    std::vector<WorldTriangle> triangles;
+    CollisionWorld collisions;
+    RayBvh bvh;
+
+    // Ground under every wheel, sampled once per tick.
+    WheelGroundBatch wheels;
+
+    // Inputs of the last tick for every car, AI drivers included.
+    std::vector<CarInput> inputs;
+
+    // Routes of AI cars driving back onto the track, per car, and scratch
+    // for planning them. The cars' state says which route each follows, so
+    // these are only a cache; cleared with the nav grid.
+    NavSearch navSearch;
+    std::vector<RecoveryRoute> recoveryRoutes;
+
+    // Level of detail by distance to the human-driven cars; sensors are cast
+    // only on ticks where a car runs one of the physical models.
+    SimLodConfig lod;
+    std::vector<glm::vec2> lodFocus;
+    std::vector<uint8_t> sensorActive;
+
+    // Car centres at the start of the tick, for swept collision.
+    std::vector<glm::vec3> previousPositions;
+
+    // Per-car sensor readings from the last tick, sensors.rayCount per car.
+    SensorConfig sensors;
+    std::vector<float> sensorDistances;
+    std::vector<uint8_t> sensorSurfaces;
+
+    bool built = false;
+    const Scene* builtScene = nullptr;
+    float builtTrackRotation = 0.0f;
+    float builtTreeSize = 0.0f;
+};
+
+void updateSimWorld(SimWorld& world, const EnvironmentState& env);
+
+// Advances every car by one tick at its level of detail, resolves
+// collisions, updates lap progress and refreshes the sensor readings.
+// inputs holds one CarInput per car not driven by the AI
+// (state.carCount - state.aiCarCount entries).
+void stepSimulation(SimState& state, SimWorld& world, const CarInput* inputs, float deltaTime);
+
+// What a race run by stepRace() keeps for itself, so races on several
+// threads can share one SimWorld.
+struct RaceScratch {
+    CollisionWorld collisions;      // static colliders set by the caller
+    NavSearch navSearch;
+    std::vector<RecoveryRoute> recoveryRoutes;
+    std::vector<CarInput> inputs;
+    std::vector<glm::vec3> previousPositions;
+    WheelGroundBatch wheels;
+};
+
+// One tick of a race in which the AI drives every car along line with
+// params: the steps of stepSimulation() with every car at full detail and
+// no sensors, all on the calling thread. world is only read.
+void stepRace(SimState& state, const SimWorld& world, const RacingLine& line, const CarParams& params,
+    RaceScratch& scratch, float deltaTime);
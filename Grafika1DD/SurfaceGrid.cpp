@@ -0,0 +1,101 @@
+#include "DetMath.h"
+#include "SurfaceGrid.h"
+#include "Simd.h"
+#include "Terrain.h"
+#include "TrackLayout.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace simd;
+
+namespace {
+    const float surfaceCellSize = 0.5f;
+
+    SurfaceId layoutSurface(const glm::vec2& p) {
+        float x = std::abs(p.x), z = std::abs(p.y);
+        if (x <= trackHalfWidth && z <= trackHalfLength) {
+            bool edge = x > trackHalfWidth - kerbWidth || z > trackHalfLength - kerbWidth;
+            return edge ? SURFACE_KERB : SURFACE_ASPHALT;
+        }
+        if (x <= trackHalfWidth + gravelWidth && z <= trackHalfLength + gravelLength) return SURFACE_GRAVEL;
+        return SURFACE_GRASS;
+    }
+}
+
+void SurfaceGrid::reset(const glm::vec2& origin, float cellSize, int cellsX, int cellsZ) {
+    width = cellsX;
+    depth = cellsZ;
+    corner = origin;
+    cell = cellSize;
+    invCell = 1.0f / cellSize;
+    ids.assign((size_t)cellsX * cellsZ, SURFACE_GRASS);
+}
+
+void SurfaceGrid::sample(const glm::vec2* points, int count, uint8_t* surfacesOut) const {
+    const F4 zero(0.0f), maxX((float)(width - 1)), maxZ((float)(depth - 1));
+    const F4 originX(corner.x), originZ(corner.y), scale(invCell);
+    if (ids.empty()) {
+        std::fill(surfacesOut, surfacesOut + count, (uint8_t)SURFACE_NONE);
+        return;
+    }
+
+    for (int base = 0; base < count; base += 4) {
+        int lanes = std::min(4, count - base);
+        float xs[4], zs[4];
+        for (int k = 0; k < 4; ++k) {
+            const glm::vec2& p = points[base + (k < lanes ? k : 0)];
+            xs[k] = p.x;
+            zs[k] = p.y;
+        }
+        // Clamping keeps the index inside the grid, so there is no bounds branch
+        F4 i = vmin(vmax((load(xs) - originX) * scale, zero), maxX);
+        F4 j = vmin(vmax((load(zs) - originZ) * scale, zero), maxZ);
+        int column[4], row[4];
+        truncToInt(i, column);
+        truncToInt(j, row);
+        for (int k = 0; k < lanes; ++k) surfacesOut[base + k] = ids[(size_t)row[k] * width + column[k]];
+    }
+}
+
+void buildSurfaceGrid(const EnvironmentState& env, const std::vector<StaticBox>& boxes,
+    const Terrain& terrain, SurfaceGrid& grid) {
+    float extentX = terrain.cellsX() * terrain.cellSize();
+    float extentZ = terrain.cellsZ() * terrain.cellSize();
+    int cellsX = (int)std::ceil(extentX / surfaceCellSize);
+    int cellsZ = (int)std::ceil(extentZ / surfaceCellSize);
+    grid.reset(terrain.origin(), surfaceCellSize, cellsX, cellsZ);
+
+    // World to track space is the inverse of renderTrack's rotation
+    float s, c;
+    detSinCos(glm::radians(env.trackRotation), s, c);
+    for (int j = 0; j < cellsZ; ++j) {
+        for (int i = 0; i < cellsX; ++i) {
+            glm::vec2 p = terrain.origin() + (glm::vec2((float)i, (float)j) + 0.5f) * surfaceCellSize;
+            grid.set(i, j, layoutSurface(glm::vec2(p.x * c - p.y * s, p.x * s + p.y * c)));
+        }
+    }
+
+    // Footprints of the static boxes: every cell the rotated box touches,
+    // so thin trunks still mark a cell
+    for (const StaticBox& box : boxes) {
+        float bs, bc;
+        detSinCos(glm::radians(box.rotation), bs, bc);
+        float reach = std::max(box.halfExtents.x, box.halfExtents.z) * 1.4142136f;
+        int i0 = std::max(0, (int)((box.center.x - reach - terrain.origin().x) / surfaceCellSize));
+        int i1 = std::min(cellsX - 1, (int)((box.center.x + reach - terrain.origin().x) / surfaceCellSize));
+        int j0 = std::max(0, (int)((box.center.z - reach - terrain.origin().y) / surfaceCellSize));
+        int j1 = std::min(cellsZ - 1, (int)((box.center.z + reach - terrain.origin().y) / surfaceCellSize));
+        for (int j = j0; j <= j1; ++j) {
+            for (int i = i0; i <= i1; ++i) {
+                glm::vec2 d = terrain.origin() + (glm::vec2((float)i, (float)j) + 0.5f) * surfaceCellSize
+                    - glm::vec2(box.center.x, box.center.z);
+                // Box axes: local x = (c, -s), local z = (s, c)
+                float localX = d.x * bc - d.y * bs, localZ = d.x * bs + d.y * bc;
+                float margin = surfaceCellSize * 0.5f * (std::abs(bc) + std::abs(bs));
+                if (std::abs(localX) <= box.halfExtents.x + margin && std::abs(localZ) <= box.halfExtents.z + margin) {
+                    grid.set(i, j, colliderSurface(box.kind));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "SimState.h"
+#include "WorldGeometry.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// How a surface treats the tyres: multipliers on CarParams::grip and
+// CarParams::rollingResistance.
+struct SurfaceMaterial {
+    float grip;
+    float rollingResistance;
+};
+
+// Indexed by SurfaceId. Walls only matter for a wheel that ends up on top
+// of one.
+const SurfaceMaterial surfaceMaterials[SURFACE_COUNT] = {
+    { 1.0f, 1.0f },     // none
+    { 1.0f, 1.0f },     // asphalt
+    { 0.6f, 4.0f },     // grass
+    { 0.5f, 1.0f },     // barrier
+    { 0.5f, 1.0f },     // building
+    { 0.5f, 1.0f },     // tree
+    { 0.85f, 1.5f },    // kerb
+    { 0.45f, 12.0f }    // gravel
+};
+
+class Terrain;
+
+// One SurfaceId byte per cell over the terrain's area, baked once per
+// layout so wheels never touch the render geometry. A 128 m square at
+// half-metre cells is 64 KB.
+class SurfaceGrid {
+public:
+    void reset(const glm::vec2& origin, float cellSize, int cellsX, int cellsZ);
+    void set(int i, int j, SurfaceId surface) { ids[(size_t)j * width + i] = surface; }
+
+    SurfaceId at(int i, int j) const { return (SurfaceId)ids[(size_t)j * width + i]; }
+
+    bool empty() const { return ids.empty(); }
+    int cellsX() const { return width; }
+    int cellsZ() const { return depth; }
+    float cellSize() const { return cell; }
+    glm::vec2 origin() const { return corner; }
+
+    // Surface for count points, four at a time without branches: points
+    // outside the grid take the nearest edge cell.
+    void sample(const glm::vec2* points, int count, uint8_t* surfacesOut) const;
+
+private:
+    std::vector<uint8_t> ids;
+    int width = 0;
+    int depth = 0;
+    glm::vec2 corner = glm::vec2(0.0f);
+    float cell = 1.0f;
+    float invCell = 1.0f;
+};
+
+// Asphalt, kerbs and gravel from the track layout (rotated by
+// trackRotation), walls under every static box, grass everywhere else.
+void buildSurfaceGrid(const EnvironmentState& env, const std::vector<StaticBox>& boxes,
+    const Terrain& terrain, SurfaceGrid& grid);
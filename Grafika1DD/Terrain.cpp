@@ -0,0 +1,205 @@
+#include "DetMath.h"
+#include "Terrain.h"
+#include "Scene.h"
+#include "Simd.h"
+#include "TrackLayout.h"
+#include <algorithm>
+#include <cmath>
+
+#define STB_PERLIN_IMPLEMENTATION
+#include "stb_perlin.h"
+
+using namespace simd;
+
+namespace {
+    const float terrainHalfSize = 64.0f;
+    const float terrainCellSize = 1.0f;
+    const float hillAmplitude = 4.0f;
+    const float hillScale = 1.0f / 40.0f;
+    const float flattenBlend = 12.0f;
+
+    float smoothStep(float edge0, float edge1, float x) {
+        float t = std::max(0.0f, std::min((x - edge0) / (edge1 - edge0), 1.0f));
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    // Distance from p to an axis-aligned rectangle centred at the origin.
+    float rectDistance(glm::vec2 p, glm::vec2 half) {
+        glm::vec2 d = glm::max(glm::abs(p) - half, glm::vec2(0.0f));
+        return detSqrt(d.x * d.x + d.y * d.y);
+    }
+}
+
+void Terrain::reset(const glm::vec2& origin, float cellSize, int cellsX, int cellsZ) {
+    tilesX = std::max(1, (cellsX + tileCells - 1) / tileCells);
+    tilesZ = std::max(1, (cellsZ + tileCells - 1) / tileCells);
+    heights.assign((size_t)tilesX * tilesZ * tileStride * tileStride, 0.0f);
+    corner = origin;
+    cell = cellSize;
+    invCell = 1.0f / cellSize;
+    ++version;
+}
+
+void Terrain::setVertex(int i, int j, float height) {
+    // A vertex on a tile border lives in up to four tiles.
+    for (int tz = j / tileCells; tz >= 0 && tz >= j / tileCells - 1; --tz) {
+        int lz = j - tz * tileCells;
+        if (tz >= tilesZ || lz > tileCells) continue;
+        for (int tx = i / tileCells; tx >= 0 && tx >= i / tileCells - 1; --tx) {
+            int lx = i - tx * tileCells;
+            if (tx >= tilesX || lx > tileCells) continue;
+            heights[((size_t)tz * tilesX + tx) * tileStride * tileStride + lz * tileStride + lx] = height;
+        }
+    }
+}
+
+float Terrain::vertex(int i, int j) const {
+    int tx = std::min(i / tileCells, tilesX - 1);
+    int tz = std::min(j / tileCells, tilesZ - 1);
+    int lx = i - tx * tileCells;
+    int lz = j - tz * tileCells;
+    return heights[((size_t)tz * tilesX + tx) * tileStride * tileStride + lz * tileStride + lx];
+}
+
+float Terrain::height(float x, float z) const {
+    glm::vec2 p(x, z);
+    float h;
+    glm::vec3 n;
+    sample(&p, 1, &h, &n);
+    return h;
+}
+
+glm::vec3 Terrain::normal(float x, float z) const {
+    glm::vec2 p(x, z);
+    float h;
+    glm::vec3 n;
+    sample(&p, 1, &h, &n);
+    return n;
+}
+
+void Terrain::sample(const glm::vec2* points, int count, float* heightsOut, glm::vec3* normalsOut) const {
+    if (heights.empty()) {
+        for (int i = 0; i < count; ++i) {
+            if (heightsOut) heightsOut[i] = 0.0f;
+            if (normalsOut) normalsOut[i] = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        return;
+    }
+
+    const F4 maxX((float)cellsX() - 1e-3f), maxZ((float)cellsZ() - 1e-3f);
+    const F4 zero(0.0f), one(1.0f), scale(invCell);
+
+    for (int first = 0; first < count; first += 4) {
+        int n = std::min(4, count - first);
+
+        // Grid coordinates, clamped so the edge cells extend outwards
+        float xs[4], zs[4];
+        for (int i = 0; i < 4; ++i) {
+            const glm::vec2& p = points[first + (i < n ? i : 0)];
+            xs[i] = p.x;
+            zs[i] = p.y;
+        }
+        F4 gx = vmin(vmax((load(xs) - F4(corner.x)) * scale, zero), maxX);
+        F4 gz = vmin(vmax((load(zs) - F4(corner.y)) * scale, zero), maxZ);
+        int ix[4], iz[4];
+        truncToInt(gx, ix);
+        truncToInt(gz, iz);
+        F4 tx = gx - toFloat(ix);
+        F4 tz = gz - toFloat(iz);
+
+        float c00[4], c10[4], c01[4], c11[4];
+        for (int i = 0; i < 4; ++i) {
+            int tileX = ix[i] / tileCells, tileZ = iz[i] / tileCells;
+            const float* tile = &heights[((size_t)tileZ * tilesX + tileX) * tileStride * tileStride];
+            const float* h = tile + (iz[i] - tileZ * tileCells) * tileStride + (ix[i] - tileX * tileCells);
+            c00[i] = h[0];
+            c10[i] = h[1];
+            c01[i] = h[tileStride];
+            c11[i] = h[tileStride + 1];
+        }
+        F4 h00 = load(c00), h10 = load(c10), h01 = load(c01), h11 = load(c11);
+
+        F4 dx0 = h10 - h00, dx1 = h11 - h01;
+        F4 h0 = h00 + dx0 * tx;
+        F4 h1 = h01 + dx1 * tx;
+        F4 h = h0 + (h1 - h0) * tz;
+
+        // Gradient of the bilinear patch
+        F4 slopeX = (dx0 + (dx1 - dx0) * tz) * scale;
+        F4 slopeZ = (h1 - h0) * scale;
+        F4 invLen = one / vsqrt(slopeX * slopeX + slopeZ * slopeZ + one);
+
+        float hs[4], nx[4], ny[4], nz[4];
+        store(hs, h);
+        store(nx, (zero - slopeX) * invLen);
+        store(ny, invLen);
+        store(nz, (zero - slopeZ) * invLen);
+        for (int i = 0; i < n; ++i) {
+            if (heightsOut) heightsOut[first + i] = hs[i];
+            if (normalsOut) normalsOut[first + i] = glm::vec3(nx[i], ny[i], nz[i]);
+        }
+    }
+}
+
+void buildTerrain(const Scene& scene, const EnvironmentState& env, Terrain& terrain) {
+    int cells = (int)(terrainHalfSize * 2.0f / terrainCellSize);
+    terrain.reset(glm::vec2(-terrainHalfSize), terrainCellSize, cells, cells);
+
+    float s, c;
+    detSinCos(glm::radians(env.trackRotation), s, c);
+    const glm::vec2 trackHalf(barrierOffset + barrierThickness, barrierLength * 0.5f);
+
+    // Distance from every vertex to the nearest thing that must sit on flat
+    // ground. Beyond flattenBlend the hills are untouched, so each prop only
+    // visits the vertices within that of its rectangle.
+    int verticesX = terrain.cellsX() + 1, verticesZ = terrain.cellsZ() + 1;
+    std::vector<float> distances((size_t)verticesX * verticesZ);
+    for (int j = 0; j < verticesZ; ++j) {
+        for (int i = 0; i < verticesX; ++i) {
+            float x = terrain.origin().x + i * terrain.cellSize();
+            float z = terrain.origin().y + j * terrain.cellSize();
+            glm::vec2 trackLocal(x * c - z * s, x * s + z * c);
+            distances[(size_t)j * verticesX + i] = rectDistance(trackLocal, trackHalf);
+        }
+    }
+    for (const SceneCollider& prop : scene.colliders) {
+        if (prop.flattenHalf.x <= 0.0f && prop.flattenHalf.y <= 0.0f) continue;
+        glm::vec2 center(prop.center.x, prop.center.z);
+        float rotation = prop.yaw;
+        if (prop.space == SPACE_TRACK) {
+            center = glm::vec2(prop.center.x * c + prop.center.z * s, -prop.center.x * s + prop.center.z * c);
+            rotation += env.trackRotation;
+        }
+        float ps = 0.0f, pc = 1.0f;
+        if (rotation != 0.0f) detSinCos(glm::radians(rotation), ps, pc);
+        glm::vec2 reach(std::fabs(pc) * prop.flattenHalf.x + std::fabs(ps) * prop.flattenHalf.y,
+            std::fabs(ps) * prop.flattenHalf.x + std::fabs(pc) * prop.flattenHalf.y);
+        reach += glm::vec2(flattenBlend);
+
+        float inv = 1.0f / terrain.cellSize();
+        int i0 = std::max(0, (int)std::floor((center.x - reach.x - terrain.origin().x) * inv));
+        int i1 = std::min(verticesX - 1, (int)std::ceil((center.x + reach.x - terrain.origin().x) * inv));
+        int j0 = std::max(0, (int)std::floor((center.y - reach.y - terrain.origin().y) * inv));
+        int j1 = std::min(verticesZ - 1, (int)std::ceil((center.y + reach.y - terrain.origin().y) * inv));
+        for (int j = j0; j <= j1; ++j) {
+            for (int i = i0; i <= i1; ++i) {
+                float dx = terrain.origin().x + i * terrain.cellSize() - center.x;
+                float dz = terrain.origin().y + j * terrain.cellSize() - center.y;
+                glm::vec2 local = rotation != 0.0f ? glm::vec2(dx * pc - dz * ps, dx * ps + dz * pc) : glm::vec2(dx, dz);
+                float& distance = distances[(size_t)j * verticesX + i];
+                distance = std::min(distance, rectDistance(local, prop.flattenHalf));
+            }
+        }
+    }
+
+    for (int j = 0; j < verticesZ; ++j) {
+        for (int i = 0; i < verticesX; ++i) {
+            float x = terrain.origin().x + i * terrain.cellSize();
+            float z = terrain.origin().y + j * terrain.cellSize();
+            float distance = distances[(size_t)j * verticesX + i];
+
+            float hills = stb_perlin_fbm_noise3(x * hillScale, 0.5f, z * hillScale, 2.0f, 0.5f, 4) * hillAmplitude;
+            terrain.setVertex(i, j, hills * smoothStep(0.0f, flattenBlend, distance));
+        }
+    }
+}
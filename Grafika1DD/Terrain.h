@@ -0,0 +1,51 @@
+#pragma once
+#include "SimState.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Scene;
+
+// Heightfield on a regular grid, stored as square tiles. Each tile keeps one
+// extra row and column copied from its neighbours, so a bilinear lookup
+// reads four floats from one small contiguous block (17 x 17 floats, about
+// 1 KB) no matter where the point falls.
+class Terrain {
+public:
+    static const int tileCells = 16;
+    static const int tileStride = tileCells + 1;
+
+    // Allocates a flat grid; the cell counts are rounded up to whole tiles.
+    void reset(const glm::vec2& origin, float cellSize, int cellsX, int cellsZ);
+    // Sets the height of grid vertex (i, j), including its apron copies.
+    void setVertex(int i, int j, float height);
+    float vertex(int i, int j) const;
+
+    bool empty() const { return heights.empty(); }
+    int cellsX() const { return tilesX * tileCells; }
+    int cellsZ() const { return tilesZ * tileCells; }
+    float cellSize() const { return cell; }
+    glm::vec2 origin() const { return corner; }
+    // Changes on every reset, so renderers know when to rebuild their mesh.
+    unsigned int revision() const { return version; }
+
+    // Bilinear height and the normal of the bilinear patch. Points outside
+    // the grid take the height of the nearest edge.
+    float height(float x, float z) const;
+    glm::vec3 normal(float x, float z) const;
+
+    // Height and normal for count points, four at a time with SIMD.
+    void sample(const glm::vec2* points, int count, float* heightsOut, glm::vec3* normalsOut) const;
+
+private:
+    std::vector<float> heights;
+    int tilesX = 0;
+    int tilesZ = 0;
+    glm::vec2 corner = glm::vec2(0.0f);
+    float cell = 1.0f;
+    float invCell = 1.0f;
+    unsigned int version = 0;
+};
+
+// Rolling hills around the circuit, flattened to y = 0 under the track
+// (rotated by trackRotation) and around the scene's props that ask for it.
+void buildTerrain(const Scene& scene, const EnvironmentState& env, Terrain& terrain);
@@ -6,9 +6,31 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "AiDriver.h"
+#include "AssetPack.h"
+#include "CarPhysics.h"
+#include "DetMath.h"
+#include "FileWatcher.h"
+#include "FrameCapture.h"
+#include "MeshImporter.h"
+#include "ParamSweep.h"
+#include "Scene.h"
+#include "ShaderCache.h"
+#include "SimState.h"
+#include "Simulation.h"
+#include "TextureBaker.h"
+#include "TextureStreamer.h"
+#include "TrackLayout.h"
+#include "WorldGeometry.h"
+#include <algorithm>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <ctime>
 
 // Shader sources
 const char* vertexShaderSource = R"(
@@ -16,6 +38,7 @@ const char* vertexShaderSource = R"(
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 4) in mat4 aInstanceModel;
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -24,10 +47,16 @@ out vec2 TexCoord;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
+uniform vec3 instanceScale;
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    // Instanced props: model places the batch, the instance matrix the prop
+    mat4 world = instanced ? model * aInstanceModel * mat4(vec4(instanceScale.x, 0.0, 0.0, 0.0),
+        vec4(0.0, instanceScale.y, 0.0, 0.0), vec4(0.0, 0.0, instanceScale.z, 0.0), vec4(0.0, 0.0, 0.0, 1.0))
+        : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(world))) * aNormal;
     TexCoord = aTexCoord;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -48,7 +77,9 @@ uniform vec3 viewPos;
 uniform vec3 objectColor;
 uniform float lightIntensity;
 uniform bool useTexture;
-uniform sampler2D ourTexture;
+uniform sampler2DArray sceneTextures;
+uniform float textureLayer;
+uniform float textureMinLevel;      // finest level streamed in for the layer
 
 // Nowe uniformy
 uniform vec3 emissiveColor;
@@ -56,7 +87,14 @@ uniform vec3 spotDir;
 uniform float spotCutOff;
 
 void main() {
-    vec3 baseColor = useTexture ? texture(ourTexture, TexCoord).rgb : objectColor;
+    // The usual level for the pixel's footprint, but none finer than is resident
+    vec3 baseColor = objectColor;
+    if (useTexture && textureLayer >= 0.0) {
+        vec2 texels = TexCoord * vec2(textureSize(sceneTextures, 0).xy);
+        vec2 dx = dFdx(texels), dy = dFdy(texels);
+        float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+        baseColor = textureLod(sceneTextures, vec3(TexCoord, textureLayer), max(lod, textureMinLevel)).rgb;
+    }
 
     // ambient
     float ambientStrength = 0.3;
@@ -90,33 +128,41 @@ void main() {
 // Global variables
 GLFWwindow* window;
 unsigned int shaderProgram;
+ShaderCache shaderCache;
+// Variant defines of the scene program, see shaderSourceWithDefines
+const char* sceneShaderDefines = "";
+// Used instead of the sources above when present, and reloaded when saved
+const char* vertexShaderPath = "shaders/scene.vert";
+const char* fragmentShaderPath = "shaders/scene.frag";
+// Shaders, textures and the scene file are reloaded when they change on disk
+FileWatcher fileWatcher;
+// F12 screenshots and F10 videos of the window, encoded in the background
+FrameCapture frameCapture;
+// Playback rate written into recorded videos
+const int captureVideoFps = 60;
 unsigned int VBO, VAO, EBO;
 int SCR_WIDTH = 1200;
 int SCR_HEIGHT = 800;
+// Vertical, in degrees
+const float fieldOfView = 45.0f;
+
+// Simulation state: cars, camera, environment toggles (see SimState.h)
+SimState sim;
+SimState quickSave{};
+SimWorld simWorld;
+
+const CarState& playerCar() { return sim.cars[playerCarIndex]; }
 
-// Camera system
-enum CameraMode { CHASE, COCKPIT, SIDE, ORBITAL, FREECAM };
-CameraMode currentCamera = CHASE;
-glm::vec3 cameraPos = glm::vec3(0.0f, 5.0f, 10.0f);
-glm::vec3 cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
-float cameraAngle = 0.0f;
-float orbitalDirection = 1.0f;
-
-// Car physics
-glm::vec3 carPos = glm::vec3(0.0f, 0.5f, 0.0f);
-float carRotation = 0.0f;
-float carSpeed = 0.0f;
-float wheelRotation = 0.0f;
-float steerAngle = 0.0f;
-
-// Environment
-bool isNight = false;
-float timeOfDay = 0.5f; // 0 = night, 1 = day
-bool headlightsOn = false;
-float trackRotation = 0.0f;
-float treeSize = 1.0f;
-glm::vec3 treeColor = glm::vec3(0.2f, 0.8f, 0.2f);
-bool treeShapeIsRound = false;
+// Deterministic mode: fixed ticks, inputs recorded for lockstep replay
+bool deterministicMode = false;
+float tickAccumulator = 0.0f;
+const int maxTicksPerFrame = 8;
+SimState recordStart{};
+std::vector<CarInput> recordedInputs;
+uint64_t stateHash = hashSeed;
+
+// AI cars added by the O key; the loop holds about a dozen in single file
+const int aiGridSize = 11;
 
 // Input
 bool keys[1024];
@@ -127,19 +173,37 @@ float mouseYaw = -90.0f;
 float mousePitch = 0.0f;
 
 // Texture & mouse
-unsigned int textureGround, textureTrack, textureCar, textureBuilding;
+AssetPack assetPack;
+// Loaded from here when present, loose files otherwise (see runPack)
+const char* assetPackPath = "assets.pak";
+TextureStreamer textureStreamer;
+TextureHandle textureGround, textureTrack, textureCar;
+// GL time per frame spent uploading streamed textures
+const double textureUploadBudgetMs = 1.0;
+// Texture array storage; finer levels than fit are not streamed in
+const size_t textureMemoryBudget = 32u << 20;
+// Metres between repeats of the ground texture
+const float terrainTextureRepeat = 5.0f;
+// Layer of the scene texture array the next textured draw samples
+int activeTextureLayer = -1;
+float activeTextureMinLevel = 0.0f;
+
+// Props, colliders and car lights (see Scene.h); --scene picks another file
+Scene scene;
+const char* scenePath = "scenes/default.scene";
+std::vector<TextureHandle> sceneTextureHandles;     // per Scene::textures entry
+std::vector<std::pair<std::string, TextureHandle>> loadedTextures;
+
+// Imported car body; the cube body is drawn while there is none
+const char* carModelPath = "models/car.obj";
+GpuMesh carMesh;
+glm::mat4 carMeshFit(1.0f);     // model space to the 2 x 0.8 x 4 m body box
 float mouseSensitivity = 0.1f;
 bool mouseControlEnabled = false;
 float cameraDistance = 12.0f;  // dystans kamery od obiektu
 float cameraPanX = 0.0f;       // przesunicie w poziomie
 float cameraPanY = 0.0f;       // przesunicie w pionie
 
-float freecamDistance = 12.0f;
-float freecamYaw = -90.0f;
-float freecamPitch = 0.0f;
-float freecamPanX = 0.0f;
-float freecamPanY = 0.0f;
-
 bool leftMousePressed = false;
 bool rightMousePressed = false;
 
@@ -238,11 +302,11 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
-    if (!mouseControlEnabled || currentCamera != FREECAM) return;
+    if (!mouseControlEnabled || sim.camera.mode != FREECAM) return;
 
-    freecamDistance -= yoffset * 0.5f;
-    if (freecamDistance < 2.0f) freecamDistance = 2.0f;
-    if (freecamDistance > 50.0f) freecamDistance = 50.0f;
+    sim.camera.freecamDistance -= yoffset * 0.5f;
+    if (sim.camera.freecamDistance < 2.0f) sim.camera.freecamDistance = 2.0f;
+    if (sim.camera.freecamDistance > 50.0f) sim.camera.freecamDistance = 50.0f;
 }
 
 // Shader compilation with better error handling
@@ -278,51 +342,99 @@ unsigned int compileShader(unsigned int type, const char* source) {
     return shader;
 }
 
-void initShaders() {
-    // Check if OpenGL context is available
-    if (!glfwGetCurrentContext()) {
-        std::cout << "ERROR: No OpenGL context available for shader initialization!" << std::endl;
-        return;
+// The scene program from the given sources, through the shader cache. 0 when
+// a shader does not compile or the program does not link.
+unsigned int buildSceneProgram(const std::string& vertexSource, const std::string& fragmentSource) {
+    // A cached binary skips compiling and linking entirely
+    auto start = std::chrono::steady_clock::now();
+    uint64_t key = shaderCache.programKey(vertexSource.c_str(), fragmentSource.c_str(), sceneShaderDefines);
+    unsigned int program = shaderCache.load("scene", key);
+    if (program != 0) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Shader program loaded from cache (" << ms << " ms)" << std::endl;
+        return program;
     }
 
-    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+    std::string vertexDefined = shaderSourceWithDefines(vertexSource.c_str(), sceneShaderDefines);
+    std::string fragmentDefined = shaderSourceWithDefines(fragmentSource.c_str(), sceneShaderDefines);
+    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexDefined.c_str());
+    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentDefined.c_str());
 
     if (vertexShader == 0 || fragmentShader == 0) {
         std::cout << "ERROR: Failed to compile shaders!" << std::endl;
         if (vertexShader != 0) glDeleteShader(vertexShader);
         if (fragmentShader != 0) glDeleteShader(fragmentShader);
-        return;
+        return 0;
     }
 
-    shaderProgram = glCreateProgram();
-    if (shaderProgram == 0) {
+    program = glCreateProgram();
+    if (program == 0) {
         std::cout << "ERROR: Failed to create shader program!" << std::endl;
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
-        return;
+        return 0;
     }
 
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    shaderCache.prepare(program);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
 
     // Check linking status
     int success;
     char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
         std::cout << "ERROR: Shader program linking failed!" << std::endl;
         std::cout << "Link error log: " << infoLog << std::endl;
+        glDeleteProgram(program);
+        program = 0;
     }
     else {
-        std::cout << "Shaders compiled and linked successfully!" << std::endl;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Shaders compiled and linked successfully! (" << ms << " ms)" << std::endl;
+        shaderCache.save("scene", key, program);
     }
 
     // Clean up individual shaders (they're now part of the program)
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+    return program;
+}
+
+// A shader file overrides the built-in source, so lighting can be tuned
+// while the simulator runs
+std::string shaderSource(const char* path, const char* builtIn) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return builtIn;
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void initShaders() {
+    // Check if OpenGL context is available
+    if (!glfwGetCurrentContext()) {
+        std::cout << "ERROR: No OpenGL context available for shader initialization!" << std::endl;
+        return;
+    }
+
+    shaderCache.init();
+    shaderProgram = buildSceneProgram(shaderSource(vertexShaderPath, vertexShaderSource),
+        shaderSource(fragmentShaderPath, fragmentShaderSource));
+    fileWatcher.watch(vertexShaderPath);
+    fileWatcher.watch(fragmentShaderPath);
+}
+
+// Swapped in only when the edited sources build; otherwise the old program stays
+void reloadShaders() {
+    unsigned int program = buildSceneProgram(shaderSource(vertexShaderPath, vertexShaderSource),
+        shaderSource(fragmentShaderPath, fragmentShaderSource));
+    if (program == 0) {
+        std::cout << "Shader reload failed, keeping the previous program" << std::endl;
+        return;
+    }
+    glDeleteProgram(shaderProgram);
+    shaderProgram = program;
 }
 
 // Generate basic geometries
@@ -427,6 +539,8 @@ void setUniforms(const glm::mat4& model,
     bool useTexture ,
     const glm::vec3& emissiveColor)
 {
+    const CarState& car = playerCar();
+
     // Transformacje
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"),
         1, GL_FALSE, glm::value_ptr(model));
@@ -446,23 +560,23 @@ void setUniforms(const glm::mat4& model,
         1, glm::value_ptr(emissiveColor));
 
     // wiato globalne (dzie/noc) + ewentualnie spotlight
-    glm::vec3 lightPos = isNight ? glm::vec3(0, 10, 0) : glm::vec3(10, 20, 10);
-    glm::vec3 lightCol = isNight ? glm::vec3(0.3f, 0.3f, 0.5f)
+    glm::vec3 lightPos = sim.env.isNight ? glm::vec3(0, 10, 0) : glm::vec3(10, 20, 10);
+    glm::vec3 lightCol = sim.env.isNight ? glm::vec3(0.3f, 0.3f, 0.5f)
         : glm::vec3(1.0f, 1.0f, 0.9f);
-    float intensity = isNight ? 0.6f : 3.0f;
+    float intensity = sim.env.isNight ? 0.6f : 3.0f;
 
-    if (headlightsOn) {
-        lightPos = carPos + glm::vec3(
-            1.5f * sin(glm::radians(carRotation)), 0.8f,
-            1.5f * cos(glm::radians(carRotation))
+    if (sim.env.headlightsOn) {
+        lightPos = car.pos + glm::vec3(
+            1.5f * sin(glm::radians(car.rotation)), 0.8f,
+            1.5f * cos(glm::radians(car.rotation))
         );
         lightCol = glm::vec3(1.0f, 1.0f, 0.9f);
         intensity = 2.0f;
 
         // Spotlight
         glm::vec3 forward = glm::vec3(
-            sin(glm::radians(carRotation)), 0.0f,
-            cos(glm::radians(carRotation))
+            sin(glm::radians(car.rotation)), 0.0f,
+            cos(glm::radians(car.rotation))
         );
         glUniform3fv(glGetUniformLocation(shaderProgram, "spotDir"),
             1, glm::value_ptr(forward));
@@ -480,10 +594,70 @@ void setUniforms(const glm::mat4& model,
     glUniform3fv(glGetUniformLocation(shaderProgram, "lightColor"),
         1, glm::value_ptr(lightCol));
     glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"),
-        1, glm::value_ptr(cameraPos));
+        1, glm::value_ptr(sim.camera.pos));
     glUniform1f(glGetUniformLocation(shaderProgram, "lightIntensity"),
         intensity);
-    glUniform1i(glGetUniformLocation(shaderProgram, "ourTexture"), 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "sceneTextures"), 0);
+    glUniform1f(glGetUniformLocation(shaderProgram, "textureLayer"), (float)activeTextureLayer);
+    glUniform1f(glGetUniformLocation(shaderProgram, "textureMinLevel"), activeTextureMinLevel);
+}
+
+// Picks the scene texture for the textured draws that follow
+void useSceneTexture(TextureHandle handle) {
+    activeTextureLayer = textureStreamer.layer(handle);
+    activeTextureMinLevel = textureStreamer.minLevel(handle);
+}
+
+// Distance from point to the nearest point of a box
+float distanceToBox(const glm::vec3& point, const glm::vec3& center, const glm::vec3& halfExtents) {
+    return glm::length(glm::max(glm::abs(point - center) - halfExtents, glm::vec3(0.0f)));
+}
+
+// Asks for the mip level a texture repeated every metresPerRepeat needs at
+// distance from the camera, from how many texels land on one pixel
+void requestTextureDetail(TextureHandle handle, float metresPerRepeat, float distance) {
+    float pixelsPerMetre = SCR_HEIGHT / (2.0f * std::tan(glm::radians(fieldOfView) * 0.5f) * std::max(distance, 0.1f));
+    float texelsPerPixel = textureStreamer.textureSize() / (metresPerRepeat * pixelsPerMetre);
+    textureStreamer.request(handle, TextureStreamer::levelFor(texelsPerPixel));
+}
+
+// Tells the streamer how close the camera is to every textured surface, so
+// the levels it needs get streamed in and the rest can be freed
+void requestTextureDetails() {
+    const glm::vec3& eye = sim.camera.pos;
+    glm::mat4 trackModel = glm::rotate(glm::mat4(1.0f), glm::radians(sim.env.trackRotation), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec3 trackEye = glm::vec3(glm::inverse(trackModel) * glm::vec4(eye, 1.0f));
+
+    const Terrain& terrain = simWorld.terrain;
+    if (!terrain.empty()) {
+        glm::vec2 half = 0.5f * terrain.cellSize() * glm::vec2(terrain.cellsX(), terrain.cellsZ());
+        glm::vec2 center = terrain.origin() + half;
+        requestTextureDetail(textureGround, terrainTextureRepeat,
+            distanceToBox(eye, glm::vec3(center.x, 0.0f, center.y), glm::vec3(half.x, 0.0f, half.y)));
+    }
+
+    // The asphalt texture is stretched once over the whole surface
+    requestTextureDetail(textureTrack, 2.0f * std::min(trackHalfWidth, trackHalfLength),
+        distanceToBox(trackEye, glm::vec3(0.0f), glm::vec3(trackHalfWidth, 0.05f, trackHalfLength)));
+
+    for (int i = 0; i < sim.carCount; ++i) {
+        requestTextureDetail(textureCar, 2.0f, std::max(0.0f, glm::length(sim.cars[i].pos - eye) - 2.0f));
+    }
+
+    // Props are unit meshes stretched by their instance matrix, one repeat per face
+    for (const SceneBatch& batch : scene.batches) {
+        int texture = scene.materials[batch.material].texture;
+        if (texture < 0) continue;
+        const glm::vec3& from = batch.space == SPACE_TRACK ? trackEye : eye;
+        for (uint32_t i = batch.first; i < batch.first + batch.count; ++i) {
+            const glm::mat4& instance = scene.instances[i];
+            glm::vec3 size(glm::length(glm::vec3(instance[0])), glm::length(glm::vec3(instance[1])),
+                glm::length(glm::vec3(instance[2])));
+            float radius = 0.5f * glm::length(size);
+            float distance = std::max(0.0f, glm::length(glm::vec3(instance[3]) - from) - radius);
+            requestTextureDetail(sceneTextureHandles[texture], std::min(size.x, std::min(size.y, size.z)), distance);
+        }
+    }
 }
 
 void renderCylinder(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
@@ -522,27 +696,6 @@ void renderCylinder(const glm::mat4& model, const glm::mat4& view, const glm::ma
     glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 }
 
-unsigned int createSimpleTexture(int width, int height, unsigned char r, unsigned char g, unsigned char b) {
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    // Utwrz prost tekstur jednolitego koloru
-    std::vector<unsigned char> data(width * height * 3);
-    for (int i = 0; i < width * height * 3; i += 3) {
-        data[i] = r;     // R
-        data[i + 1] = g; // G
-        data[i + 2] = b; // B
-    }
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    return texture;
-}
 
 
 
@@ -584,18 +737,198 @@ void renderCube(const glm::mat4& model,
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 }
 
-void renderCar(const glm::mat4& view, const glm::mat4& projection) {
+void renderMesh(const GpuMesh& mesh, const glm::mat4& model, const glm::mat4& view,
+    const glm::mat4& projection, const glm::vec3& color, bool useTexture = false) {
+    setUniforms(model, view, projection, color, useTexture);
+
+    glBindVertexArray(mesh.vao);
+    glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+}
+
+// Scene props are drawn instanced: one VAO per primitive, all sharing the
+// instance buffer, whose mat4 (attributes 4-7) advances once per instance
+struct PropGeometry {
+    unsigned int vao = 0, vbo = 0, ebo = 0;
+    int count = 0;      // indices, or vertices when there is no ebo
+};
+PropGeometry propGeometry[PROP_MESH_COUNT];
+unsigned int propInstanceVBO = 0;
+
+void createPropGeometry() {
+    glGenBuffers(1, &propInstanceVBO);
+    std::vector<float> vertices[PROP_MESH_COUNT] = { generateCube(), generateCylinder(32), generateCone(32) };
+    for (int mesh = 0; mesh < (int)PROP_MESH_COUNT; ++mesh) {
+        PropGeometry& geometry = propGeometry[mesh];
+        glGenVertexArrays(1, &geometry.vao);
+        glGenBuffers(1, &geometry.vbo);
+        glBindVertexArray(geometry.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, geometry.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices[mesh].size() * sizeof(float), vertices[mesh].data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        if (mesh == PROP_CUBE) {
+            auto indices = generateCubeIndices();
+            glGenBuffers(1, &geometry.ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+            geometry.count = (int)indices.size();
+        }
+        else {
+            geometry.count = (int)(vertices[mesh].size() / 8);
+        }
+        for (int column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(4 + column);
+            glVertexAttribDivisor(4 + column, 1);
+        }
+    }
+    glBindVertexArray(0);
+}
+
+void deletePropGeometry() {
+    for (PropGeometry& geometry : propGeometry) {
+        glDeleteVertexArrays(1, &geometry.vao);
+        glDeleteBuffers(1, &geometry.vbo);
+        if (geometry.ebo) glDeleteBuffers(1, &geometry.ebo);
+        geometry = PropGeometry();
+    }
+    glDeleteBuffers(1, &propInstanceVBO);
+    propInstanceVBO = 0;
+}
+
+// The compiled scene keeps instances grouped by batch, so this is one copy
+void uploadSceneInstances() {
+    glBindBuffer(GL_ARRAY_BUFFER, propInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, scene.instances.size() * sizeof(glm::mat4), scene.instances.data(), GL_STATIC_DRAW);
+}
+
+void renderSceneProps(const glm::mat4& view, const glm::mat4& projection) {
+    glm::mat4 trackModel = glm::rotate(glm::mat4(1.0f), glm::radians(sim.env.trackRotation), glm::vec3(0.0f, 1.0f, 0.0f));
+    glUniform1i(glGetUniformLocation(shaderProgram, "instanced"), 1);
+
+    for (const SceneBatch& batch : scene.batches) {
+        if (batch.count == 0) continue;
+        const SceneMaterial& material = scene.materials[batch.material];
+        bool textured = material.texture >= 0 && textureStreamer.layer(sceneTextureHandles[material.texture]) >= 0;
+        if (textured) useSceneTexture(sceneTextureHandles[material.texture]);
+        glm::vec3 color = (material.flags & MATERIAL_TINT_TREE) ? sim.env.treeColor : material.color;
+
+        // Trees follow the size and shape toggles
+        glm::vec3 scale(1.0f);
+        if (batch.tag == TAG_TRUNK) scale = glm::vec3(sim.env.treeSize);
+        if (batch.tag == TAG_CROWN) scale = (sim.env.treeShapeIsRound ? glm::vec3(1.0f) : tallCrownStretch) * sim.env.treeSize;
+
+        setUniforms(batch.space == SPACE_TRACK ? trackModel : glm::mat4(1.0f), view, projection,
+            color, textured, material.emissive);
+        glUniform3fv(glGetUniformLocation(shaderProgram, "instanceScale"), 1, glm::value_ptr(scale));
+
+        const PropGeometry& geometry = propGeometry[batch.mesh];
+        glBindVertexArray(geometry.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, propInstanceVBO);
+        for (int column = 0; column < 4; ++column) {
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void*)(batch.first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+        }
+        if (geometry.ebo)
+            glDrawElementsInstanced(GL_TRIANGLES, geometry.count, GL_UNSIGNED_INT, 0, batch.count);
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, 0, geometry.count, batch.count);
+    }
+    glUniform1i(glGetUniformLocation(shaderProgram, "instanced"), 0);
+}
+
+// Terrain mesh straight from the heightfield grid, texture repeated every terrainTextureRepeat
+void generateTerrain(const Terrain& terrain, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+    int verticesX = terrain.cellsX() + 1, verticesZ = terrain.cellsZ() + 1;
+    vertices.clear();
+    indices.clear();
+    vertices.reserve((size_t)verticesX * verticesZ * 8);
+    indices.reserve((size_t)terrain.cellsX() * terrain.cellsZ() * 6);
+
+    for (int j = 0; j < verticesZ; ++j) {
+        for (int i = 0; i < verticesX; ++i) {
+            float x = terrain.origin().x + i * terrain.cellSize();
+            float z = terrain.origin().y + j * terrain.cellSize();
+            float y = terrain.vertex(i, j);
+            glm::vec3 normal = terrain.normal(x, z);
+            vertices.insert(vertices.end(), { x, y, z, normal.x, normal.y, normal.z, x / terrainTextureRepeat, z / terrainTextureRepeat });
+        }
+    }
+    for (int j = 0; j < terrain.cellsZ(); ++j) {
+        for (int i = 0; i < terrain.cellsX(); ++i) {
+            unsigned int a = j * verticesX + i, b = a + 1, c = a + verticesX, d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+}
+
+void renderTerrain(const Terrain& terrain, const glm::mat4& model, const glm::mat4& view,
+    const glm::mat4& projection, const glm::vec3& color) {
+    static unsigned int terrainVAO = 0, terrainVBO, terrainEBO;
+    static unsigned int builtRevision = 0;
+    static int indexCount = 0;
+
+    if (terrain.empty()) return;
+
+    if (terrainVAO == 0) {
+        glGenVertexArrays(1, &terrainVAO);
+        glGenBuffers(1, &terrainVBO);
+        glGenBuffers(1, &terrainEBO);
+
+        glBindVertexArray(terrainVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+
+    // Re-upload whenever the heightfield was rebuilt (track rotation changed)
+    if (builtRevision != terrain.revision()) {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        generateTerrain(terrain, vertices, indices);
+
+        glBindVertexArray(terrainVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        indexCount = (int)indices.size();
+        builtRevision = terrain.revision();
+    }
+
+    setUniforms(model, view, projection, color, true);
+
+    glBindVertexArray(terrainVAO);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+}
+
+void renderCar(const CarState& car, const glm::vec3& bodyColor, bool braking,
+    const glm::mat4& view, const glm::mat4& projection) {
+
     // 1) wsplna transformacja karoserii
-    glm::mat4 carModel = glm::translate(glm::mat4(1.0f), carPos);
-    carModel = glm::rotate(carModel, glm::radians(carRotation),
-        glm::vec3(0, 1, 0));
+    glm::mat4 carModel = glm::translate(glm::mat4(1.0f), car.pos);
+    carModel = carModel * glm::mat4_cast(car.orientation);
 
     // === 2) Karoseria z tekstur ===
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureCar);
-    glm::mat4 body = glm::scale(carModel, glm::vec3(2.0f, 0.8f, 4.0f));
-    renderCube(body, view, projection,
-        glm::vec3(0.8f, 0.2f, 0.2f), true);
+    useSceneTexture(textureCar);
+    if (carMesh.indexCount > 0) {
+        renderMesh(carMesh, carModel * carMeshFit, view, projection, bodyColor, true);
+    }
+    else {
+        glm::mat4 body = glm::scale(carModel, glm::vec3(2.0f, 0.8f, 4.0f));
+        renderCube(body, view, projection,
+            bodyColor, true);
+    }
 
     // === 3) Spoiler z tyu ===
     {
@@ -607,85 +940,42 @@ void renderCar(const glm::mat4& view, const glm::mat4& projection) {
             glm::vec3(0.1f, 0.1f, 0.1f));
     }
 
-    // === 4) Stoki-reflektory ===
-    {
-        // 1) Bazowa macierz auta: translate + obrt Y
-        glm::mat4 base = glm::translate(glm::mat4(1.0f), carPos);
-        base = glm::rotate(base,
-            glm::radians(carRotation),
-            glm::vec3(0, 1, 0));
-
-        // 2) Offsets po bokach (x), wysoko (y), gboko (z)
-        glm::vec3 offsets[2] = {
-            glm::vec3(-0.5f, 0, 2.1f),   // lewy reflektor
-            glm::vec3(0.5f, 0, 2.1f)    // prawy reflektor
-        };
-        float inwardDeg = 15.0f;
-
-        glm::vec3 offCol(0.2f, 0.2f, 0.2f),  // przygaszony
-            onCol(1.0f, 1.0f, 0.9f);  // jasny
-        glm::vec3 offEm = offCol * 0.2f,     // saba emisja
-            onEm = onCol * 4.0f;     // mocna emisja
-
-        for (int i = 0; i < 2; ++i) {
-            glm::mat4 M = base;
-
-            M = glm::translate(M, offsets[i]);
-
-            M = glm::rotate(M,
-                glm::radians(270.0f),
-                glm::vec3(1, 0, 0));
-
-            float zA = glm::radians((i == 0) ? -inwardDeg : +inwardDeg);
-            M = glm::rotate(M, zA, glm::vec3(0, 0, 1));
-
-            M = glm::scale(M, glm::vec3(0.3f, 1.5f, 0.3f));
-
-            bool on = headlightsOn;
-            glm::vec3 col = on ? onCol : offCol;
-            glm::vec3 emi = on ? onEm : offEm;
-
-            renderCone(M, view, projection,
-                col,    // objectColor
-                16,     // segments
-                emi);   // emissiveColor
+    // === 4) Headlights and stop lights from the scene ===
+    for (const SceneLight& light : scene.lights) {
+        glm::mat4 M = glm::translate(carModel, light.offset);
+        bool on;
+        if (light.kind == LIGHT_HEADLIGHT) {
+            // Cone turned to point forward, then in towards the centre line
+            M = glm::rotate(M, glm::radians(270.0f), glm::vec3(1, 0, 0));
+            M = glm::rotate(M, glm::radians(light.yaw), glm::vec3(0, 0, 1));
+            on = sim.env.headlightsOn;
         }
-    }
-
-    // === 5) Tylne wiata stopu ===
-    {
-        glm::vec3 tailOffs[2] = {
-            glm::vec3(-0.5f, 0.2f, -2.0f),
-            glm::vec3(0.5f, 0.2f, -2.0f)
-        };
-
-        bool braking = keys[GLFW_KEY_S];
-        // kolor i emissive w jednym
-        glm::vec3 baseCol = braking
-            ? glm::vec3(1.0f, 0.0f, 0.0f)
-            : glm::vec3(0.3f, 0.0f, 0.0f);
-        glm::vec3 emissiveCol = baseCol * (braking ? 3.0f : 1.0f);
-
-        for (auto& off : tailOffs) {
-            glm::mat4 tM = glm::translate(carModel, off);
-            tM = glm::scale(tM, glm::vec3(0.2f, 0.2f, 0.1f));
-
-            // teraz z emissiveCol w ostatnim argumencie
-            renderCube(tM, view, projection,
-                baseCol,        // objectColor
-                false,          // useTexture
-                emissiveCol);   // emissiveColor
+        else {
+            M = glm::rotate(M, glm::radians(light.yaw), glm::vec3(0, 1, 0));
+            on = braking;
         }
+        M = glm::scale(M, light.scale);
+
+        glm::vec3 col = on ? light.onColor : light.offColor;
+        glm::vec3 emi = col * (on ? light.onGlow : light.offGlow);
+        if (light.kind == LIGHT_HEADLIGHT)
+            renderCone(M, view, projection, col, 16, emi);
+        else
+            renderCube(M, view, projection, col, false, emi);
     }
-    // === 6) Koa ===
+
+    // === 5) Koa ===
     {
-        glm::vec3 wheelPos[4] = {
-            {-1.2f,0,1.5f},{1.2f,0,1.5f},
-            {-1.2f,0,-1.5f},{1.2f,0,-1.5f}
-        };
+        const CarParams params;
         for (int i = 0; i < 4; ++i) {
-            glm::mat4 wM = glm::translate(carModel, wheelPos[i]);
-            wM = glm::rotate(wM, wheelRotation,
+            // Wheel centre sits at the end of the current spring length
+            float drop = params.suspensionLength - std::min(car.compression[i], params.suspensionLength);
+            glm::mat4 wM = glm::translate(carModel, wheelPositions[i] - glm::vec3(0.0f, drop, 0.0f));
+            if (i < frontWheelCount) {
+                wM = glm::rotate(wM, glm::radians(car.steerAngle),
+                    glm::vec3(0, 1, 0));
+            }
+            wM = glm::rotate(wM, car.wheelAngle[i],
                 glm::vec3(1, 0, 0));
             wM = glm::rotate(wM, glm::radians(90.0f),
                 glm::vec3(0, 0, 1));
@@ -699,182 +989,276 @@ void renderCar(const glm::mat4& view, const glm::mat4& projection) {
 
 void renderTrack(const glm::mat4& view, const glm::mat4& projection) {
     glm::mat4 trackModel = glm::mat4(1.0f);
-    trackModel = glm::rotate(trackModel, glm::radians(trackRotation), glm::vec3(0.0f, 1.0f, 0.0f));
+    trackModel = glm::rotate(trackModel, glm::radians(sim.env.trackRotation), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // The flattened ground under the track is at height 0, where the wheels
+    // touch it, so the gravel and asphalt tops sit flush at 0. The terrain is
+    // pushed furthest back in depth, the gravel less, the asphalt not at all.
+
+    // Gravel run-off under the asphalt, the same area the surface grid bakes
+    glm::mat4 gravelModel = glm::translate(trackModel, glm::vec3(0.0f, -0.03f, 0.0f));
+    gravelModel = glm::scale(gravelModel, glm::vec3((trackHalfWidth + gravelWidth) * 2.0f, 0.06f,
+        (trackHalfLength + gravelLength) * 2.0f));
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.0f, 1.0f);
+    renderCube(gravelModel, view, projection, glm::vec3(0.75f, 0.68f, 0.5f));
+    glDisable(GL_POLYGON_OFFSET_FILL);
 
     // === Gwna powierzchnia toru z tekstur ===
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureTrack);
+    useSceneTexture(textureTrack);
 
     glm::mat4 surfaceModel = trackModel;
-    surfaceModel = glm::translate(surfaceModel, glm::vec3(0.0f, 0.0f, 0.0f));
-    surfaceModel = glm::scale(surfaceModel, glm::vec3(20.0f, 0.1f, 40.0f));
+    surfaceModel = glm::translate(surfaceModel, glm::vec3(0.0f, -0.05f, 0.0f));
+    surfaceModel = glm::scale(surfaceModel, glm::vec3(trackHalfWidth * 2.0f, 0.1f, trackHalfLength * 2.0f));
     renderCube(surfaceModel, view, projection, glm::vec3(0.3f, 0.3f, 0.3f), true);
 
-    // === Bariery bez tekstur ===
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Kerbs along every edge of the asphalt, 1 cm above it
     for (int i = -1; i <= 1; i += 2) {
-        glm::mat4 barrierModel = trackModel;
-        barrierModel = glm::translate(barrierModel, glm::vec3(i * 11.0f, 0.5f, 0.0f));
-        barrierModel = glm::scale(barrierModel, glm::vec3(0.5f, 1.0f, 42.0f));
-        renderCube(barrierModel, view, projection, glm::vec3(0.9f, 0.9f, 0.9f));
+        glm::mat4 sideKerb = glm::translate(trackModel, glm::vec3(i * (trackHalfWidth - kerbWidth * 0.5f), -0.045f, 0.0f));
+        sideKerb = glm::scale(sideKerb, glm::vec3(kerbWidth, 0.11f, trackHalfLength * 2.0f));
+        renderCube(sideKerb, view, projection, glm::vec3(0.8f, 0.15f, 0.15f));
+
+        glm::mat4 endKerb = glm::translate(trackModel, glm::vec3(0.0f, -0.045f, i * (trackHalfLength - kerbWidth * 0.5f)));
+        endKerb = glm::scale(endKerb, glm::vec3(trackHalfWidth * 2.0f, 0.11f, kerbWidth));
+        renderCube(endKerb, view, projection, glm::vec3(0.8f, 0.15f, 0.15f));
     }
 }
 
 void renderEnvironment(const glm::mat4& view, const glm::mat4& projection) {
     // === Ground/grass z tekstur ===
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureGround);
-
-    glm::mat4 groundModel = glm::mat4(1.0f);
-    groundModel = glm::translate(groundModel, glm::vec3(0.0f, -0.1f, 0.0f));
-    groundModel = glm::scale(groundModel, glm::vec3(100.0f, 0.1f, 100.0f));
-
-    renderCube(groundModel, view, projection, glm::vec3(0.2f, 0.6f, 0.2f), true);
+    useSceneTexture(textureGround);
 
-    // === Trees (bez tekstur) ===
-    glBindTexture(GL_TEXTURE_2D, 0); // Wycz tekstury
+    // At the height the physics uses; depth offset keeps the track flush with it on top
+    updateSimWorld(simWorld, sim.env);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 2.0f);
+    renderTerrain(simWorld.terrain, glm::mat4(1.0f), view, projection, glm::vec3(0.2f, 0.6f, 0.2f));
+    glDisable(GL_POLYGON_OFFSET_FILL);
 
-    glm::vec3 treePositions[] = {
-        glm::vec3(-15.0f, 0.0f, -15.0f),
-        glm::vec3(15.0f, 0.0f, -15.0f),
-        glm::vec3(-15.0f, 0.0f, 15.0f),
-        glm::vec3(15.0f, 0.0f, 15.0f),
-        glm::vec3(-25.0f, 0.0f, 0.0f),
-        glm::vec3(25.0f, 0.0f, 0.0f)
-    };
-
-    for (const auto& pos : treePositions) {
-        // Tree trunk
-        glm::mat4 trunkModel = glm::mat4(1.0f);
-        trunkModel = glm::translate(trunkModel, pos + glm::vec3(0.0f, 1.0f, 0.0f));
-        trunkModel = glm::scale(trunkModel, glm::vec3(0.3f, 2.0f, 0.3f) * treeSize);
-        renderCube(trunkModel, view, projection, glm::vec3(0.4f, 0.2f, 0.1f));
-
-        // Tree crown
-        glm::mat4 crownModel = glm::mat4(1.0f);
-        crownModel = glm::translate(crownModel, pos + glm::vec3(0.0f, 2.5f, 0.0f));
-        if (treeShapeIsRound) {
-            crownModel = glm::scale(crownModel, glm::vec3(1.5f, 1.5f, 1.5f) * treeSize);
-        }
-        else {
-            crownModel = glm::scale(crownModel, glm::vec3(1.2f, 2.0f, 1.2f) * treeSize);
-        }
-        renderCube(crownModel, view, projection, treeColor);
-    }
-
-    // === Buildings/Tribunes z tekstur ===
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureBuilding);
-
-    glm::vec3 buildingPositions[] = {
-        glm::vec3(0.0f, 0.0f, -30.0f),
-        glm::vec3(-20.0f, 0.0f, -25.0f),
-        glm::vec3(20.0f, 0.0f, -25.0f)
-    };
-
-    for (const auto& pos : buildingPositions) {
-        glm::mat4 buildingModel = glm::mat4(1.0f);
-        buildingModel = glm::translate(buildingModel, pos + glm::vec3(0.0f, 3.0f, 0.0f));
-        buildingModel = glm::scale(buildingModel, glm::vec3(8.0f, 6.0f, 4.0f));
-        renderCube(buildingModel, view, projection, glm::vec3(0.7f, 0.7f, 0.8f), true);
-    }
+    // Barriers, trees and grandstands all come from the scene
+    renderSceneProps(view, projection);
 }
 
 void updateCamera() {
-    switch (currentCamera) {
+    CameraState& camera = sim.camera;
+    const CarState& car = playerCar();
+
+    switch (camera.mode) {
     case CHASE:
-        cameraPos = carPos + glm::vec3(
-            -8.0f * sin(glm::radians(carRotation)),
+        camera.pos = car.pos + glm::vec3(
+            -8.0f * sin(glm::radians(car.rotation)),
             4.0f,
-            -8.0f * cos(glm::radians(carRotation))
+            -8.0f * cos(glm::radians(car.rotation))
         );
-        cameraTarget = carPos;
+        camera.target = car.pos;
         break;
 
     case COCKPIT:
-        cameraPos = carPos + glm::vec3(0.0f, 1.2f, 0.0f);
-        cameraTarget = carPos + glm::vec3(
-            10.0f * sin(glm::radians(carRotation)),
+        camera.pos = car.pos + glm::vec3(0.0f, 1.2f, 0.0f);
+        camera.target = car.pos + glm::vec3(
+            10.0f * sin(glm::radians(car.rotation)),
             1.2f,
-            10.0f * cos(glm::radians(carRotation))
+            10.0f * cos(glm::radians(car.rotation))
         );
         break;
 
     case SIDE:
-        cameraPos = glm::vec3(15.0f, 5.0f, carPos.z);
-        cameraTarget = carPos;
+        camera.pos = glm::vec3(15.0f, 5.0f, car.pos.z);
+        camera.target = car.pos;
         break;
 
     case ORBITAL:
-        cameraAngle += 0.05f * orbitalDirection;
-        if (cameraAngle > 360.0f) cameraAngle -= 360.0f;
-        cameraPos = carPos + glm::vec3(
-            12.0f * cos(glm::radians(cameraAngle)),
+        camera.angle += 0.05f * camera.orbitalDirection;
+        if (camera.angle > 360.0f) camera.angle -= 360.0f;
+        camera.pos = car.pos + glm::vec3(
+            12.0f * cos(glm::radians(camera.angle)),
             6.0f,
-            12.0f * sin(glm::radians(cameraAngle))
+            12.0f * sin(glm::radians(camera.angle))
         );
-        cameraTarget = carPos;
+        camera.target = car.pos;
         break;
 
     case FREECAM:
     
-        float radius = freecamDistance;
-        float yawRad = glm::radians(freecamYaw);
-        float pitchRad = glm::radians(freecamPitch);
+        float radius = camera.freecamDistance;
+        float yawRad = glm::radians(camera.freecamYaw);
+        float pitchRad = glm::radians(camera.freecamPitch);
 
-        cameraPos.x = carPos.x + radius * cos(pitchRad) * cos(yawRad) + freecamPanX;
-        cameraPos.y = carPos.y + radius * sin(pitchRad) + freecamPanY;
-        cameraPos.z = carPos.z + radius * cos(pitchRad) * sin(yawRad);
+        camera.pos.x = car.pos.x + radius * cos(pitchRad) * cos(yawRad) + camera.freecamPanX;
+        camera.pos.y = car.pos.y + radius * sin(pitchRad) + camera.freecamPanY;
+        camera.pos.z = car.pos.z + radius * cos(pitchRad) * sin(yawRad);
 
-        cameraTarget = carPos + glm::vec3(freecamPanX, freecamPanY, 0.0f);
+        camera.target = car.pos + glm::vec3(camera.freecamPanX, camera.freecamPanY, 0.0f);
         break;
     }
 }
 
-void updateCarPhysics(float deltaTime) {
-    const float maxSpeed = 15.0f;
-    const float acceleration = 8.0f;
-    const float deceleration = 5.0f;
-    const float turnSpeed = 90.0f;
+CarInput readCarInput() {
+    CarInput input;
+    input.throttle = keys[GLFW_KEY_W] ? 1.0f : (keys[GLFW_KEY_S] ? -1.0f : 0.0f);
+    input.steer = (keys[GLFW_KEY_A] ? 1.0f : 0.0f) - (keys[GLFW_KEY_D] ? 1.0f : 0.0f);
+    return input;
+}
 
-    // Forward/backward movement
-    if (keys[GLFW_KEY_W]) {
-        carSpeed = std::min(carSpeed + acceleration * deltaTime, maxSpeed);
-    }
-    else if (keys[GLFW_KEY_S]) {
-        carSpeed = std::max(carSpeed - acceleration * deltaTime, -maxSpeed * 0.5f);
+// Prints the player's lap time when a lap was completed this tick
+void reportPlayerLap(int previousLap) {
+    const CarState& car = playerCar();
+    if (car.lap == previousLap) return;
+    if (car.lastLapTime > 0.0f && car.lap > 1) {
+        std::cout << "Lap " << car.lap - 1 << ": " << car.lastLapTime << " s (best " << car.bestLapTime << " s)" << std::endl;
     }
     else {
-        // Natural deceleration
-        if (carSpeed > 0) {
-            carSpeed = std::max(0.0f, carSpeed - deceleration * deltaTime);
-        }
-        else if (carSpeed < 0) {
-            carSpeed = std::min(0.0f, carSpeed + deceleration * deltaTime);
-        }
+        std::cout << "Lap " << car.lap << " started" << std::endl;
     }
+}
 
-    // Steering
-    if (keys[GLFW_KEY_A] && std::abs(carSpeed) > 0.1f) {
-        carRotation += turnSpeed * deltaTime * (carSpeed / maxSpeed);
+// Cars ordered by distance covered, with their lap times
+void printLeaderboard() {
+    std::vector<int> order;
+    for (int i = 0; i < sim.carCount; ++i) order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [](int a, int b) {
+        return raceDistance(simWorld.track, sim.cars[a]) > raceDistance(simWorld.track, sim.cars[b]);
+    });
+    std::cout << "\n=== LEADERBOARD ===" << std::endl;
+    for (int place = 0; place < (int)order.size(); ++place) {
+        const CarState& car = sim.cars[order[place]];
+        std::cout << place + 1 << ". car " << order[place] << (order[place] == playerCarIndex ? " (you)" : "")
+            << "  lap " << car.lap << " sector " << car.trackSector + 1
+            << "  last " << car.lastLapTime << " s  best " << car.bestLapTime << " s"
+            << (outsideTrackLimits(simWorld.track, car) ? "  off track" : "") << std::endl;
     }
-    if (keys[GLFW_KEY_D] && std::abs(carSpeed) > 0.1f) {
-        carRotation -= turnSpeed * deltaTime * (carSpeed / maxSpeed);
+}
+
+void updateCarPhysics(float deltaTime) {
+    updateSimWorld(simWorld, sim.env);
+    CarInput input = readCarInput();
+    int previousLap = playerCar().lap;
+    stepSimulation(sim, simWorld, &input, deltaTime);
+    reportPlayerLap(previousLap);
+
+    // Reset car position
+    if (keys[GLFW_KEY_R]) {
+        resetCar(simCarForWrite(sim, playerCarIndex));
     }
+}
 
-    // Update position
-    carPos.x += carSpeed * sin(glm::radians(carRotation)) * deltaTime;
-    carPos.z += carSpeed * cos(glm::radians(carRotation)) * deltaTime;
+// Starts a new recording from the current car state. Called whenever the
+// car is changed outside of stepCar (reset, rotate in place).
+void startRecording() {
+    simSnapshot(sim, recordStart);
+    recordedInputs.clear();
+    stateHash = hashSeed;
+    tickAccumulator = 0.0f;
+}
 
-    // Wheel rotation
-    wheelRotation += carSpeed * deltaTime * 2.0f;
+void deterministicTick() {
+    updateSimWorld(simWorld, sim.env);
+    CarInput input = readCarInput();
+    int previousLap = playerCar().lap;
+    stepSimulation(sim, simWorld, &input, fixedTimeStep);
+    reportPlayerLap(previousLap);
+    recordedInputs.push_back(input);
+    stateHash = hashSimState(sim, stateHash);
 
-    // Reset car position
     if (keys[GLFW_KEY_R]) {
-        carPos = glm::vec3(0.0f, 0.5f, 0.0f);
-        carRotation = 0.0f;
-        carSpeed = 0.0f;
+        resetCar(simCarForWrite(sim, playerCarIndex));
+        startRecording();
+    }
+}
+
+void updateDeterministic(float deltaTime) {
+    tickAccumulator += deltaTime;
+    int ticks = 0;
+    while (tickAccumulator >= fixedTimeStep && ticks < maxTicksPerFrame) {
+        deterministicTick();
+        tickAccumulator -= fixedTimeStep;
+        ++ticks;
+    }
+    // Drop the backlog after a long stall instead of spiralling
+    if (ticks == maxTicksPerFrame) tickAccumulator = 0.0f;
+}
+
+// Replays the recorded inputs from the recorded start state and compares the
+// per-tick hash chain with the live run.
+void verifyReplay() {
+    static SimState replay{};
+    simRestore(replay, recordStart);
+    SimWorld replayWorld;
+    replayWorld.scene = simWorld.scene;
+    updateSimWorld(replayWorld, replay.env);
+
+    uint64_t hash = hashSeed;
+    for (const CarInput& input : recordedInputs) {
+        stepSimulation(replay, replayWorld, &input, fixedTimeStep);
+        hash = hashSimState(replay, hash);
+    }
+    std::cout << "Replay of " << recordedInputs.size() << " ticks: hash " << std::hex << hash
+        << (hash == stateHash ? " matches" : " DOES NOT match") << " live hash " << stateHash
+        << std::dec << std::endl;
+}
+
+// Fills the grid with AI cars following the racing line, or clears it
+void toggleAiGrid() {
+    if (sim.aiCarCount > 0) {
+        removeAiCars(sim);
+        std::cout << "AI cars removed" << std::endl;
+        return;
+    }
+    updateSimWorld(simWorld, sim.env);
+    spawnAiGrid(sim, simWorld.racingLine, aiGridSize);
+    std::cout << sim.aiCarCount << " AI cars on the grid" << std::endl;
+}
+
+// Captures are named after when they were taken: capture-20240131-184502-1.png
+std::string captureFileName(const char* extension) {
+    static int count = 0;
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    return std::string("capture-") + stamp + "-" + std::to_string(++count) + extension;
+}
+
+void toggleVideoCapture() {
+    if (frameCapture.recording()) {
+        frameCapture.stopVideo();
+        std::cout << "Video stopped: " << frameCapture.framesCaptured() << " frames, "
+            << frameCapture.framesDropped() << " dropped, "
+            << frameCapture.averageFrameMs() << " ms per frame on the main thread" << std::endl;
+        return;
+    }
+    std::string path = captureFileName(".y4m");
+    if (frameCapture.startVideo(path, SCR_WIDTH, SCR_HEIGHT, captureVideoFps))
+        std::cout << "Recording video: " << path << " (F10 to stop)" << std::endl;
+    else
+        std::cout << "Failed to create video file: " << path << std::endl;
+}
+
+// Quick save / load of the whole simulation state
+void saveSnapshot() {
+    auto start = std::chrono::high_resolution_clock::now();
+    simSnapshot(sim, quickSave);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Snapshot taken at tick " << sim.tick << " in "
+        << std::chrono::duration<double, std::micro>(end - start).count() << " us" << std::endl;
+}
+
+void loadSnapshot() {
+    if (quickSave.carCount == 0) {
+        std::cout << "No snapshot to restore" << std::endl;
+        return;
     }
+    auto start = std::chrono::high_resolution_clock::now();
+    simRestore(sim, quickSave);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Restored tick " << sim.tick << " in "
+        << std::chrono::duration<double, std::micro>(end - start).count() << " us" << std::endl;
+    if (deterministicMode) startRecording();
 }
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -887,37 +1271,67 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
         if (action == GLFW_PRESS) {
             switch (key) {
-            case GLFW_KEY_1: currentCamera = CHASE; break;
-            case GLFW_KEY_2: currentCamera = COCKPIT; break;
-            case GLFW_KEY_3: currentCamera = SIDE; break;
+            case GLFW_KEY_1: sim.camera.mode = CHASE; break;
+            case GLFW_KEY_2: sim.camera.mode = COCKPIT; break;
+            case GLFW_KEY_3: sim.camera.mode = SIDE; break;
             case GLFW_KEY_4:
-                if (currentCamera == ORBITAL)
-                    orbitalDirection *= -1.0f; // zmiana kierunku
+                if (sim.camera.mode == ORBITAL)
+                    sim.camera.orbitalDirection *= -1.0f; // zmiana kierunku
                 else
-                    currentCamera = ORBITAL;
+                    sim.camera.mode = ORBITAL;
                 break;
             case GLFW_KEY_5:
-                currentCamera = FREECAM;
+                sim.camera.mode = FREECAM;
                 break;
-            case GLFW_KEY_L: headlightsOn = !headlightsOn; break;
+            case GLFW_KEY_L: sim.env.headlightsOn = !sim.env.headlightsOn; break;
             case GLFW_KEY_N:
-                isNight = !isNight;
-                timeOfDay = isNight ? 0.0f : 1.0f;
+                sim.env.isNight = !sim.env.isNight;
+                sim.env.timeOfDay = sim.env.isNight ? 0.0f : 1.0f;
+                break;
+            case GLFW_KEY_T:
+                sim.env.trackRotation += 15.0f;
+                if (deterministicMode) startRecording();
+                break;
+            case GLFW_KEY_Y:
+                sim.env.trackRotation += 45.0f;
+                if (deterministicMode) startRecording();
                 break;
-            case GLFW_KEY_T: trackRotation += 15.0f; break;
-            case GLFW_KEY_Y: trackRotation += 45.0f; break;
             case GLFW_KEY_G:
-                treeColor = glm::vec3(
-                    static_cast<float>(rand()) / RAND_MAX,
-                    static_cast<float>(rand()) / RAND_MAX,
-                    static_cast<float>(rand()) / RAND_MAX
-                );
+                sim.env.treeColor = glm::vec3(simRandom(sim), simRandom(sim), simRandom(sim));
+                if (deterministicMode) startRecording();
                 break;
             case GLFW_KEY_H:
-                treeSize = (treeSize > 1.5f) ? 0.5f : treeSize + 0.3f;
+                sim.env.treeSize = (sim.env.treeSize > 1.5f) ? 0.5f : sim.env.treeSize + 0.3f;
+                if (deterministicMode) startRecording();
+                break;
+            case GLFW_KEY_J: sim.env.treeShapeIsRound = !sim.env.treeShapeIsRound; break;
+            case GLFW_KEY_U:
+                setCarHeading(simCarForWrite(sim, playerCarIndex), playerCar().rotation + 90.0f);
+                if (deterministicMode) startRecording();
+                break;
+            case GLFW_KEY_O:
+                toggleAiGrid();
+                if (deterministicMode) startRecording();
+                break;
+            case GLFW_KEY_K: printLeaderboard(); break;
+            case GLFW_KEY_P:
+                deterministicMode = !deterministicMode;
+                if (deterministicMode) {
+                    startRecording();
+                    std::cout << "Deterministic mode ON (" << 1.0f / fixedTimeStep << " Hz fixed tick)" << std::endl;
+                }
+                else {
+                    std::cout << "Deterministic mode OFF after " << recordedInputs.size()
+                        << " ticks, state hash " << std::hex << stateHash << std::dec << std::endl;
+                }
+                break;
+            case GLFW_KEY_F5: saveSnapshot(); break;
+            case GLFW_KEY_F9: loadSnapshot(); break;
+            case GLFW_KEY_F10: toggleVideoCapture(); break;
+            case GLFW_KEY_F12: frameCapture.screenshot(captureFileName(".png")); break;
+            case GLFW_KEY_V:
+                if (deterministicMode || !recordedInputs.empty()) verifyReplay();
                 break;
-            case GLFW_KEY_J: treeShapeIsRound = !treeShapeIsRound; break;
-            case GLFW_KEY_U: carRotation += 90.0f; break;
             case GLFW_KEY_M:
                 mouseControlEnabled = !mouseControlEnabled;  // NOWE: wcz/wycz mysz
                 if (mouseControlEnabled) {
@@ -935,7 +1349,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
-    if (!mouseControlEnabled || currentCamera != FREECAM) return;
+    if (!mouseControlEnabled || sim.camera.mode != FREECAM) return;
 
     if (firstMouse) {
         lastX = xpos;
@@ -952,17 +1366,17 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     yoffset *= mouseSensitivity;
 
     if (leftMousePressed) {
-        freecamYaw += xoffset * 2.0f;
-        freecamPitch += yoffset * 2.0f;
+        sim.camera.freecamYaw += xoffset * 2.0f;
+        sim.camera.freecamPitch += yoffset * 2.0f;
 
         // ograniczenia pitch
-        if (freecamPitch > 89.0f) freecamPitch = 89.0f;
-        if (freecamPitch < -89.0f) freecamPitch = -89.0f;
+        if (sim.camera.freecamPitch > 89.0f) sim.camera.freecamPitch = 89.0f;
+        if (sim.camera.freecamPitch < -89.0f) sim.camera.freecamPitch = -89.0f;
     }
 
     if (rightMousePressed) {
-        freecamPanX += xoffset * 0.05f;
-        freecamPanY += yoffset * 0.05f;
+        sim.camera.freecamPanX += xoffset * 0.05f;
+        sim.camera.freecamPanY += yoffset * 0.05f;
     }
 }
 
@@ -974,63 +1388,188 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
 
 
 
-unsigned int loadTexture(const char* path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+// Streams a texture and watches the image and its baked file for edits.
+// A path already loaded gets its existing handle back.
+TextureHandle loadTexture(const std::string& path, unsigned char r, unsigned char g, unsigned char b) {
+    for (const auto& loaded : loadedTextures) {
+        if (loaded.first == path) return loaded.second;
+    }
+    TextureHandle handle = textureStreamer.load(path.c_str(), r, g, b);
+    if (handle < 0) {
+        std::cout << "No free texture layer for " << path << ", drawing it untextured" << std::endl;
+        return handle;
+    }
+    loadedTextures.emplace_back(path, handle);
+    fileWatcher.watch(path);
+    fileWatcher.watch(bakedTexturePath(path));
+    return handle;
+}
 
-    int width, height, nrChannels;
+void initTextures() {
+    int maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    std::cout << "Max texture size supported: " << maxTextureSize << std::endl;
 
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (!data) {
-        std::cout << "Failed to load texture at path: " << path << std::endl;
-        return 0;
-    }
-    else {
-        std::cout << "Texture loaded: " << path << " (" << width << "x" << height << ", " << nrChannels << " channels)" << std::endl;
+    if (assetPack.open(assetPackPath)) {
+        std::cout << "Asset pack: " << assetPackPath << " (" << assetPack.count() << " assets)" << std::endl;
+        textureStreamer.setAssetPack(&assetPack);
     }
+    textureStreamer.setMemoryBudget(textureMemoryBudget);
+
+    // Decoded in the background; until then each shows a flat colour close to the image
+    textureStreamer.setFinishedCallback([](const std::string& path, TextureStatus status, int width, int height) {
+        if (status == TEXTURE_RESIDENT)
+            std::cout << "Loaded texture: " << path << " (" << width << "x" << height << ")" << std::endl;
+        else
+            std::cout << "Failed to load texture at path: " << path << std::endl;
+    });
+    textureGround = loadTexture("textures/grass.jpg", 70, 110, 45);
+    textureTrack = loadTexture("textures/asphalt.jpg", 70, 70, 75);
+    textureCar = loadTexture("textures/car.jpg", 150, 150, 150);
+}
 
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    else {
-        std::cout << "Unsupported texture format: " << nrChannels << " channels" << std::endl;
-        stbi_image_free(data);
-        return 0;
+// Points the physics and the renderer at the contents of scene
+void useScene() {
+    simWorld.scene = &scene;
+    simWorld.built = false;
+
+    // Textures only the previous scene used give their layers back first
+    for (size_t i = 0; i < loadedTextures.size();) {
+        TextureHandle handle = loadedTextures[i].second;
+        bool builtIn = handle == textureGround || handle == textureTrack || handle == textureCar;
+        bool used = std::find(scene.textures.begin(), scene.textures.end(), loadedTextures[i].first) != scene.textures.end();
+        if (builtIn || used) {
+            ++i;
+            continue;
+        }
+        textureStreamer.release(handle);
+        loadedTextures.erase(loadedTextures.begin() + i);
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cout << "OpenGL error after glTexImage2D: " << error << std::endl;
+    // Each texture shows the colour of the first material using it until it streams in
+    sceneTextureHandles.clear();
+    for (size_t i = 0; i < scene.textures.size(); ++i) {
+        glm::vec3 color(0.5f);
+        for (const SceneMaterial& material : scene.materials) {
+            if (material.texture == (int32_t)i) {
+                color = material.color;
+                break;
+            }
+        }
+        sceneTextureHandles.push_back(loadTexture(scene.textures[i],
+            (unsigned char)(color.r * 255.0f), (unsigned char)(color.g * 255.0f), (unsigned char)(color.b * 255.0f)));
     }
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 
+    if (!propInstanceVBO) createPropGeometry();
+    uploadSceneInstances();
+}
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+// Needs the asset pack open and the texture streamer started
+void initScene() {
+    SceneLoadStats stats;
+    std::string error;
+    AssetView packed = assetPack.isOpen() ? assetPack.find(compiledScenePath(scenePath)) : AssetView();
+    if (packed && readCompiledScene(packed.data, packed.size, scene)) {
+        std::cout << "Scene: " << scenePath << " from the asset pack, " << scene.instances.size() << " props" << std::endl;
+    }
+    else if (loadScene(scenePath, scene, stats, error)) {
+        std::cout << "Scene: " << scenePath << ", " << stats.props << " props, "
+            << (stats.compiled ? "compiled" : "parsed") << " in " << stats.loadMs << " ms" << std::endl;
+    }
+    else {
+        std::cout << "No scene (" << error << "), using the built-in layout" << std::endl;
+        scene = defaultScene();
+    }
+    fileWatcher.watch(scenePath);
+    useScene();
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// A changed scene file is parsed (or read compiled) on its own thread and
+// swapped in between frames; one that fails to load leaves the scene as is.
+struct SceneReload {
+    bool ok;
+    Scene scene;
+    SceneLoadStats stats;
+    std::string error;
+};
+std::future<SceneReload> sceneReload;
+bool sceneReloadAgain = false;
+
+void startSceneReload() {
+    if (sceneReload.valid()) {
+        sceneReloadAgain = true;
+        return;
+    }
+    std::string path = scenePath;
+    sceneReload = std::async(std::launch::async, [path] {
+        SceneReload result;
+        result.ok = loadScene(path, result.scene, result.stats, result.error);
+        return result;
+    });
+}
 
-    std::cout << "Loaded texture: " << path << " (" << width << "x" << height << ", " << nrChannels << " channels)" << std::endl;
+void finishSceneReload() {
+    if (!sceneReload.valid() || sceneReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+    SceneReload result = sceneReload.get();
+    if (result.ok) {
+        scene = std::move(result.scene);
+        useScene();
+        std::cout << "Reloaded scene: " << scenePath << ", " << result.stats.props << " props in "
+            << result.stats.loadMs << " ms" << std::endl;
+        if (deterministicMode) std::cout << "The recording from before the reload will not replay" << std::endl;
+    }
+    else {
+        std::cout << "Scene reload failed (" << result.error << "), keeping the current scene" << std::endl;
+    }
+    if (sceneReloadAgain) {
+        sceneReloadAgain = false;
+        startSceneReload();
+    }
+}
 
-    stbi_image_free(data);
-    return textureID;
+// Runs between frames, so nothing swaps while a frame is being drawn
+void applyFileChanges() {
+    std::vector<std::string> changed;
+    fileWatcher.poll(changed);
+    for (const std::string& path : changed) {
+        if (path == vertexShaderPath || path == fragmentShaderPath) {
+            std::cout << "Changed: " << path << ", rebuilding shaders" << std::endl;
+            reloadShaders();
+        }
+        else if (path == scenePath) {
+            startSceneReload();
+        }
+        else if (textureStreamer.reload(path)) {
+            std::cout << "Changed: " << path << ", reloading" << std::endl;
+        }
+    }
+    finishSceneReload();
 }
 
-void initTextures() {
-    int maxTextureSize;
-    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
-    std::cout << "Max texture size supported: " << maxTextureSize << std::endl;
-    textureGround = loadTexture("textures/grass.jpg");
-    textureTrack = loadTexture("textures/asphalt.jpg");
-    textureCar = loadTexture("textures/car.jpg");
-    textureBuilding = loadTexture("textures / building.jpg");
+void initMeshes() {
+    MeshView view;
+    MeshData mesh;
+    if (assetPack.isOpen() && findPackedMesh(assetPack, carModelPath, 0, view)) {
+        std::cout << "Car model: " << carModelPath << " from the asset pack" << std::endl;
+    }
+    else {
+        MeshImportStats stats;
+        std::string error;
+        if (!loadMesh(carModelPath, 0, mesh, stats, error)) {
+            std::cout << "No car model (" << error << "), using the built-in body" << std::endl;
+            return;
+        }
+        view = mesh.view();
+        std::cout << "Car model: " << carModelPath << ", " << stats.vertices << " vertices, " << stats.triangles
+            << " triangles, " << (stats.fromCache ? "cached" : "imported") << " in " << stats.loadMs << " ms" << std::endl;
+    }
+    carMesh = uploadMesh(view);
+
+    // Centred and scaled to the length of the cube body it replaces
+    glm::vec3 size = view.boundsMax - view.boundsMin;
+    glm::vec3 centre = (view.boundsMin + view.boundsMax) * 0.5f;
+    carMeshFit = glm::scale(glm::mat4(1.0f), glm::vec3(4.0f / std::max(size.z, 1e-3f)));
+    carMeshFit = glm::translate(carMeshFit, -centre);
 }
 
 bool initOpenGL() {
@@ -1185,24 +1724,35 @@ void checkOpenGLError(const char* stmt, const char* fname, int line) {
 // Modified render function with error checking
 void render() {
     // Clear screen
-    glm::vec3 clearColor = isNight ? glm::vec3(0.1f, 0.1f, 0.2f) : glm::vec3(0.5f, 0.7f, 1.0f);
+    glm::vec3 clearColor = sim.env.isNight ? glm::vec3(0.1f, 0.1f, 0.2f) : glm::vec3(0.5f, 0.7f, 1.0f);
     GL_CHECK(glClearColor(clearColor.r, clearColor.g, clearColor.b, 1.0f));
     GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
     // Use shader program
     GL_CHECK(glUseProgram(shaderProgram));
 
+    // Every scene texture is a layer of this one array
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureStreamer.arrayTexture());
+
     // Set up matrices
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+    glm::mat4 projection = glm::perspective(glm::radians(fieldOfView),
         (float)SCR_WIDTH / (float)SCR_HEIGHT,
         0.1f, 100.0f);
 
-    glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 view = glm::lookAt(sim.camera.pos, sim.camera.target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    requestTextureDetails();
 
     // Render scene objects
     renderEnvironment(view, projection);
     renderTrack(view, projection);
-    renderCar(view, projection);
+    for (int i = 0; i < sim.carCount; ++i) {
+        bool isAi = i >= sim.carCount - sim.aiCarCount;
+        bool braking = i < (int)simWorld.inputs.size() && simWorld.inputs[i].throttle < 0.0f;
+        renderCar(sim.cars[i], isAi ? glm::vec3(0.2f, 0.3f, 0.8f) : glm::vec3(0.8f, 0.2f, 0.2f),
+            braking, view, projection);
+    }
 }
 
 void printControls() {
@@ -1233,15 +1783,175 @@ void printControls() {
     std::cout << "H - Change tree size" << std::endl;
     std::cout << "J - Toggle tree shape (cone/sphere)" << std::endl;
     std::cout << "U - Rotate car in place" << std::endl;
+    std::cout << "O - Add / remove AI cars" << std::endl;
+    std::cout << "K - Print leaderboard (laps and lap times)" << std::endl;
+
+    std::cout << "\nSIMULATION:" << std::endl;
+    std::cout << "P - Toggle deterministic mode (fixed tick, input recording)" << std::endl;
+    std::cout << "V - Replay recording and verify state hash" << std::endl;
+    std::cout << "F5 - Snapshot simulation state" << std::endl;
+    std::cout << "F9 - Restore snapshot" << std::endl;
+
+    std::cout << "\nCAPTURE:" << std::endl;
+    std::cout << "F12 - Screenshot (PNG)" << std::endl;
+    std::cout << "F10 - Start / stop video recording (Y4M)" << std::endl;
 
     std::cout << "\nESC - Exit simulator" << std::endl;
     std::cout << "\n=====================================" << std::endl;
 }
 
-int main() {
+// Headless parameter sweep: Grafika1DD --sweep [key=value ...]
+int runSweep(int argc, char** argv) {
+    SweepConfig config;
+    std::string error;
+    if (!parseSweepArgs(argc, argv, config, error)) {
+        std::cout << "ERROR: " << error << std::endl;
+        std::cout << "Usage: --sweep [samples=N] [laps=N] [cars=N] [maxLapTime=S] [seed=N] [out=file.csv] [name=min:max ...]" << std::endl;
+        std::cout << "Parameters:";
+        for (const std::string& name : sweepParameterNames()) std::cout << " " << name;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    std::cout << "Sweeping " << config.samples << " samples, " << config.cars << " car(s), "
+        << config.laps << " lap(s) each -> " << config.output << std::endl;
+    SweepSummary summary;
+    bool ok = runParamSweep(config, summary, error, [](const SweepProgress& p) {
+        std::cout << p.samplesDone << "/" << p.samples << " samples, " << p.laps << " laps, "
+            << p.lapsPerSecond << " laps/s, " << p.lapsPerSecondPerCore << " laps/s/core" << std::endl;
+    });
+    if (!ok) {
+        std::cout << "ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "\nDone in " << summary.seconds << " s on " << summary.threads << " threads: "
+        << summary.laps << " laps, " << summary.dnfCars << " DNF, "
+        << summary.lapsPerSecondPerCore << " laps/s/core" << std::endl;
+    std::cout << "Lap time p10 / p50 / p90: " << summary.lapP10 << " / " << summary.lapP50
+        << " / " << summary.lapP90 << " s" << std::endl;
+    if (summary.bestSample >= 0) {
+        std::cout << "Best lap " << summary.bestLap << " s in sample " << summary.bestSample << ":";
+        for (size_t i = 0; i < config.axes.size(); ++i) {
+            std::cout << " " << config.axes[i].name << "=" << summary.bestValues[i];
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// Offline texture bake: Grafika1DD --bake textures/grass.jpg ... writes textures/grass.rctx
+int runBake(int argc, char** argv) {
+    if (argc == 0) {
+        std::cout << "Usage: --bake image [image ...]" << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 0; i < argc; ++i) {
+        std::string destination = bakedTexturePath(argv[i]);
+        TextureBakeStats stats;
+        std::string error;
+        if (!bakeTexture(argv[i], destination, stats, error)) {
+            std::cout << "ERROR: " << error << std::endl;
+            ++failed;
+            continue;
+        }
+        std::cout << destination << ": " << stats.width << "x" << stats.height << ", " << stats.levels
+            << " levels, " << (stats.format == BAKED_BC3 ? "BC3" : "BC1") << ", "
+            << stats.uncompressedBytes / 1024 << " KB -> " << stats.bakedBytes / 1024 << " KB" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
+
+// Model import: Grafika1DD --mesh models/car.obj ... writes models/car.rcms
+int runImport(int argc, char** argv) {
+    if (argc == 0) {
+        std::cout << "Usage: --mesh model.obj [model.obj ...]" << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 0; i < argc; ++i) {
+        MeshData mesh;
+        MeshImportStats stats;
+        std::string error;
+        if (!loadMesh(argv[i], 0, mesh, stats, error)) {
+            std::cout << "ERROR: " << error << std::endl;
+            ++failed;
+            continue;
+        }
+        std::cout << meshCachePath(argv[i]) << ": " << stats.vertices << " vertices, " << stats.triangles
+            << " triangles, " << (stats.fromCache ? "up to date" : "imported") << " in " << stats.loadMs << " ms" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
+
+// Scene compiling: Grafika1DD --compile-scene scenes/default.scene ... writes scenes/default.rcsc
+int runCompileScene(int argc, char** argv) {
+    if (argc == 0) {
+        std::cout << "Usage: --compile-scene file.scene [file.scene ...]" << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 0; i < argc; ++i) {
+        Scene compiled;
+        SceneLoadStats stats;
+        std::string error;
+        if (!loadScene(argv[i], compiled, stats, error)) {
+            std::cout << "ERROR: " << error << std::endl;
+            ++failed;
+            continue;
+        }
+        std::cout << compiledScenePath(argv[i]) << ": " << stats.props << " props in " << compiled.batches.size()
+            << " batches, " << compiled.colliders.size() << " colliders, " << (stats.compiled ? "up to date" : "compiled")
+            << " in " << stats.loadMs << " ms" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
+
+// Asset packing: Grafika1DD --pack assets.pak textures/grass.jpg textures/grass.rctx ...
+// Names are stored as given, so run it from the directory the game runs in.
+int runPack(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: --pack pack file [file ...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> files(argv + 1, argv + argc);
+    AssetPackStats stats;
+    std::string error;
+    if (!writeAssetPack(files, argv[0], stats, error)) {
+        std::cout << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    std::cout << argv[0] << ": " << stats.entries << " assets, " << stats.dataBytes / 1024 << " KB -> "
+        << stats.packBytes / 1024 << " KB" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--sweep") {
+        return runSweep(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bake") {
+        return runBake(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--mesh") {
+        return runImport(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--pack") {
+        return runPack(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--compile-scene") {
+        return runCompileScene(argc - 2, argv + 2);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--scene") {
+        scenePath = argv[2];
+    }
+
     // Print controls
     printControls();
 
+    initSimState(sim);
+
     // Initialize OpenGL FIRST
     if (!initOpenGL()) {
         return -1;
@@ -1252,6 +1962,8 @@ int main() {
 
     // Initialize textures AFTER shaders
     initTextures();
+    initScene();
+    initMeshes();
 
     // Initialize timing
     float deltaTime = 0.0f;
@@ -1271,22 +1983,30 @@ int main() {
         // Process input
         glfwPollEvents();
 
+        applyFileChanges();
+        textureStreamer.update(textureUploadBudgetMs);
+
         // Update game state
-        updateCarPhysics(deltaTime);
+        if (deterministicMode)
+            updateDeterministic(deltaTime);
+        else
+            updateCarPhysics(deltaTime);
         updateCamera();
 
         // Render
         render();
+        frameCapture.endFrame(SCR_WIDTH, SCR_HEIGHT);
 
         // Swap buffers
         glfwSwapBuffers(window);
     }
 
     // Cleanup
-    glDeleteTextures(1, &textureGround);
-    glDeleteTextures(1, &textureTrack);
-    glDeleteTextures(1, &textureCar);
-    glDeleteTextures(1, &textureBuilding);
+    frameCapture.shutdown();
+    textureStreamer.shutdown();
+    deleteMesh(carMesh);
+    deletePropGeometry();
+    assetPack.close();
     glDeleteProgram(shaderProgram);
     glfwTerminate();
 
@@ -0,0 +1,216 @@
+#include "TextureBaker.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// stb_dxt's implementation expects memcpy to be declared already
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize2.h"
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+
+namespace {
+    const char containerMagic[4] = { 'R', 'C', 'T', 'X' };
+    const uint32_t containerVersion = 1;
+    const int maxLevels = 16;               // 32768 x 32768
+
+    size_t blockBytes(int format) {
+        return format == BAKED_BC3 ? 16 : 8;
+    }
+
+    // Compresses an RGBA8 image block by block; edge blocks of levels that
+    // are not a multiple of 4 repeat the last row and column.
+    void compressLevel(const unsigned char* rgba, int width, int height, int format, std::vector<unsigned char>& out) {
+        unsigned char block[16 * 4];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                for (int y = 0; y < 4; ++y) {
+                    for (int x = 0; x < 4; ++x) {
+                        int sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+                        std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                }
+                size_t at = out.size();
+                out.resize(at + blockBytes(format));
+                stb_compress_dxt_block(&out[at], block, format == BAKED_BC3 ? 1 : 0, STB_DXT_HIGHQUAL);
+            }
+        }
+    }
+
+    void appendLevel(const unsigned char* rgba, int width, int height, int format, std::vector<unsigned char>& out) {
+        if (format == BAKED_RGBA8) out.insert(out.end(), rgba, rgba + (size_t)width * height * 4);
+        else compressLevel(rgba, width, height, format, out);
+    }
+
+    void writeU32(std::ofstream& file, uint32_t value) {
+        unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8),
+            (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+        file.write((const char*)bytes, 4);
+    }
+
+    bool readU32(const unsigned char*& at, const unsigned char* end, uint32_t& value) {
+        if (end - at < 4) return false;
+        value = at[0] | (at[1] << 8) | (at[2] << 16) | ((uint32_t)at[3] << 24);
+        at += 4;
+        return true;
+    }
+}
+
+size_t bakedLevelBytes(int format, int width, int height) {
+    if (format == BAKED_RGBA8) return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * blockBytes(format);
+}
+
+bool resizeSrgb(const unsigned char* rgba, int width, int height, int newWidth, int newHeight,
+    std::vector<unsigned char>& out) {
+    out.resize((size_t)newWidth * newHeight * 4);
+    return stbir_resize_uint8_srgb(rgba, width, height, 0, out.data(), newWidth, newHeight, 0, STBIR_RGBA) != nullptr;
+}
+
+bool buildMipChain(const unsigned char* rgba, int width, int height, int format, BakedTexture& out) {
+    out.format = format;
+    out.width = width;
+    out.height = height;
+    out.levels.clear();
+    out.data.clear();
+
+    std::vector<unsigned char> level, next;
+    const unsigned char* pixels = rgba;
+    int levelWidth = width, levelHeight = height;
+    for (;;) {
+        BakedLevel info = { levelWidth, levelHeight, out.data.size(), 0 };
+        appendLevel(pixels, levelWidth, levelHeight, format, out.data);
+        info.size = out.data.size() - info.offset;
+        out.levels.push_back(info);
+        if (levelWidth == 1 && levelHeight == 1) return true;
+
+        // Filtered in linear light, so dark and bright texels average the way they look
+        int nextWidth = std::max(1, levelWidth / 2), nextHeight = std::max(1, levelHeight / 2);
+        if (!resizeSrgb(pixels, levelWidth, levelHeight, nextWidth, nextHeight, next)) return false;
+        level.swap(next);
+        pixels = level.data();
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+}
+
+void bakedFlatUnit(int format, const unsigned char rgba[4], std::vector<unsigned char>& unit) {
+    if (format == BAKED_RGBA8) {
+        unit.assign(rgba, rgba + 4);
+        return;
+    }
+    unsigned char block[16 * 4];
+    for (int i = 0; i < 16; ++i) std::memcpy(block + i * 4, rgba, 4);
+    unit.resize(blockBytes(format));
+    stb_compress_dxt_block(unit.data(), block, format == BAKED_BC3 ? 1 : 0, STB_DXT_NORMAL);
+}
+
+std::string bakedTexturePath(const std::string& source) {
+    size_t slash = source.find_last_of("/\\");
+    size_t dot = source.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return source + ".rctx";
+    return source.substr(0, dot) + ".rctx";
+}
+
+bool bakeTexture(const std::string& source, const std::string& destination,
+    TextureBakeStats& stats, std::string& error) {
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        error = "cannot decode " + source + ": " + stbi_failure_reason();
+        return false;
+    }
+    std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    int format = BAKED_BC1;
+    for (size_t i = 3; i < level.size(); i += 4) {
+        if (level[i] != 255) {
+            format = BAKED_BC3;
+            break;
+        }
+    }
+    BakedTexture baked;
+    if (!buildMipChain(level.data(), width, height, format, baked)) {
+        error = "cannot resize " + source;
+        return false;
+    }
+    stats = TextureBakeStats();
+    for (const BakedLevel& info : baked.levels) stats.uncompressedBytes += (size_t)info.width * info.height * channels;
+
+    std::ofstream file(destination.c_str(), std::ios::binary);
+    if (!file) {
+        error = "cannot write " + destination;
+        return false;
+    }
+    file.write(containerMagic, 4);
+    writeU32(file, containerVersion);
+    writeU32(file, (uint32_t)baked.format);
+    writeU32(file, (uint32_t)baked.width);
+    writeU32(file, (uint32_t)baked.height);
+    writeU32(file, (uint32_t)baked.levels.size());
+    for (const BakedLevel& info : baked.levels) {
+        writeU32(file, (uint32_t)info.width);
+        writeU32(file, (uint32_t)info.height);
+        writeU32(file, (uint32_t)info.size);
+        file.write((const char*)&baked.data[info.offset], info.size);
+    }
+    if (!file) {
+        error = "write failed: " + destination;
+        return false;
+    }
+
+    stats.width = width;
+    stats.height = height;
+    stats.levels = (int)baked.levels.size();
+    stats.format = baked.format;
+    stats.bakedBytes = baked.data.size();
+    return true;
+}
+
+bool parseBakedTexture(const unsigned char* data, size_t size, BakedTexture& texture) {
+    const unsigned char* at = data;
+    const unsigned char* end = data + size;
+
+    uint32_t version, format, width, height, levelCount;
+    if (size < 4 || std::memcmp(at, containerMagic, 4) != 0) return false;
+    at += 4;
+    if (!readU32(at, end, version) || version != containerVersion) return false;
+    if (!readU32(at, end, format) || (format != BAKED_RGBA8 && format != BAKED_BC1 && format != BAKED_BC3)) return false;
+    if (!readU32(at, end, width) || !readU32(at, end, height) || !readU32(at, end, levelCount)) return false;
+    if (width == 0 || height == 0 || width > (1u << (maxLevels - 1)) || height > (1u << (maxLevels - 1))) return false;
+    if (levelCount == 0 || levelCount > (uint32_t)maxLevels) return false;
+
+    texture.format = (int)format;
+    texture.width = (int)width;
+    texture.height = (int)height;
+    texture.levels.clear();
+    texture.data.clear();
+    uint32_t expectedWidth = width, expectedHeight = height;
+    for (uint32_t i = 0; i < levelCount; ++i) {
+        uint32_t levelWidth, levelHeight, levelSize;
+        if (!readU32(at, end, levelWidth) || !readU32(at, end, levelHeight) || !readU32(at, end, levelSize)) return false;
+        if (levelWidth != expectedWidth || levelHeight != expectedHeight) return false;
+        if (levelSize != bakedLevelBytes(texture.format, (int)levelWidth, (int)levelHeight)) return false;
+        if ((size_t)(end - at) < levelSize) return false;
+
+        BakedLevel info = { (int)levelWidth, (int)levelHeight, (size_t)(at - data), levelSize };
+        texture.levels.push_back(info);
+        at += levelSize;
+        expectedWidth = std::max(1u, expectedWidth / 2);
+        expectedHeight = std::max(1u, expectedHeight / 2);
+    }
+    return true;
+}
+
+bool readBakedTexture(const std::string& path, BakedTexture& texture) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) return false;
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!parseBakedTexture(bytes.data(), bytes.size(), texture)) return false;
+    // The level offsets count from the start of the file
+    texture.data.swap(bytes);
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline texture baking. An image is decoded once, its mip chain is
+// filtered in linear light (stb_image_resize2's sRGB path) down to 1x1 and
+// every level is block compressed with stb_dxt: BC1 when the image is
+// opaque, BC3 when it has alpha. The result is a little-endian container
+// the runtime uploads straight to GL with no decoding and no
+// glGenerateMipmap:
+//
+//   header   magic "RCTX", version, format, width, height, level count
+//   levels   width, height, byte size per level, then the level's blocks
+//
+// The streamer builds its runtime chains with the same functions, in RGBA8
+// when the GL cannot sample S3TC.
+
+enum BakedFormat {
+    BAKED_RGBA8 = 0,    // uncompressed, for GLs without S3TC
+    BAKED_BC1 = 1,      // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8 bytes per 4x4 block
+    BAKED_BC3 = 3       // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16 bytes per 4x4 block
+};
+
+struct BakedLevel {
+    int width;
+    int height;
+    size_t offset;      // into BakedTexture::data, or the buffer it was parsed from
+    size_t size;
+};
+
+struct BakedTexture {
+    int format = BAKED_BC1;
+    int width = 0;
+    int height = 0;
+    std::vector<BakedLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+struct TextureBakeStats {
+    int width;
+    int height;
+    int levels;
+    int format;
+    size_t uncompressedBytes;   // what the runtime used to keep: RGB(A)8 plus generated mips
+    size_t bakedBytes;
+};
+
+// Bytes of one mip level of the given size in the format.
+size_t bakedLevelBytes(int format, int width, int height);
+
+// Downsamples an RGBA8 image in linear light.
+bool resizeSrgb(const unsigned char* rgba, int width, int height, int newWidth, int newHeight,
+    std::vector<unsigned char>& out);
+
+// Builds the mip chain of an RGBA8 image down to 1x1 in the given format.
+bool buildMipChain(const unsigned char* rgba, int width, int height, int format, BakedTexture& out);
+
+// The smallest repeating unit of a flat colour in the format: one texel,
+// or one 4x4 block for BC1 and BC3. Repeating it fills a level.
+void bakedFlatUnit(int format, const unsigned char rgba[4], std::vector<unsigned char>& unit);
+
+// Where the baked file for a source image lives: the same name with the
+// extension replaced by .rctx (textures/grass.jpg -> textures/grass.rctx).
+std::string bakedTexturePath(const std::string& source);
+
+// Decodes, mips, compresses and writes source to destination.
+bool bakeTexture(const std::string& source, const std::string& destination,
+    TextureBakeStats& stats, std::string& error);
+
+// Validates a container in memory and fills in its levels, with offsets
+// counted from data. texture.data is left empty: the levels are read from
+// data in place, which must outlive their use.
+bool parseBakedTexture(const unsigned char* data, size_t size, BakedTexture& texture);
+
+// Reads a baked file; false if it is missing or not a valid container.
+bool readBakedTexture(const std::string& path, BakedTexture& texture);
@@ -0,0 +1,525 @@
+#include "TextureStreamer.h"
+#include "stb_image.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // Bytes per upload call; small enough that one call never takes a
+    // noticeable part of a frame
+    const int stripBytes = 256 * 1024;
+
+    // Compressed levels are created in this colour; no layer samples a
+    // level before its own texels are uploaded to it
+    const unsigned char emptyColor[4] = { 128, 128, 128, 255 };
+
+    // Levels up to this size are loaded whatever the camera sees
+    const int startSize = 128;
+
+    // A level no texture wants is freed after this many frames, so looking
+    // away for a moment does not stream it all again
+    const int freeAfterFrames = 120;
+
+    GLenum glFormat(int format) {
+        return format == BAKED_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA;
+    }
+
+    // Rows per upload unit: compressed data goes in whole rows of blocks
+    int unitRows(int format) {
+        return format == BAKED_RGBA8 ? 1 : 4;
+    }
+
+    void repeatUnit(const std::vector<unsigned char>& unit, size_t bytes, std::vector<unsigned char>& out) {
+        out.resize(bytes);
+        for (size_t i = 0; i < bytes; i += unit.size()) std::copy(unit.begin(), unit.end(), out.begin() + i);
+    }
+
+    // Uploads rows [y, y + rows) of one level of one layer
+    void uploadRows(int format, int level, int layer, int width, int y, int rows, const unsigned char* data) {
+        if (format == BAKED_RGBA8) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y, layer, width, rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        else {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y, layer, width, rows, 1, glFormat(format),
+                (GLsizei)bakedLevelBytes(format, width, rows), data);
+        }
+    }
+}
+
+TextureStreamer::TextureStreamer(int layerSize, int layerCount, unsigned int decodeThreads)
+    : layerSize(layerSize), layerCount(layerCount), threadCount(std::max(1u, decodeThreads)) {
+}
+
+TextureStreamer::~TextureStreamer() {
+    stopThreads();
+}
+
+TextureHandle TextureStreamer::load(const char* path, unsigned char r, unsigned char g, unsigned char b) {
+    if (!array) createArray();
+    int layer = takeLayer();
+    if (layer < 0) return -1;
+
+    // Handles of released textures are reused
+    TextureHandle handle = 0;
+    while (handle < (int)entries.size() && !(entries[handle]->released && entries[handle]->layer < 0)) ++handle;
+    if (handle == (int)entries.size()) entries.emplace_back();
+    entries[handle].reset(new Entry());
+    Entry& entry = *entries[handle];
+    entry.path = path;
+    entry.layer = entry.uploadLayer = layer;
+
+    // The placeholder is flat, so its coarsest level shows it as well as any
+    entry.top = levelCount - 1;
+    entry.wanted = levelCount;
+    const unsigned char color[4] = { r, g, b, 255 };
+    fillLayer(layer, color);
+
+    queueDecode(entry);
+    return handle;
+}
+
+void TextureStreamer::release(TextureHandle handle) {
+    if (handle < 0 || handle >= (int)entries.size() || entries[handle]->released) return;
+    Entry& entry = *entries[handle];
+    entry.released = true;
+    entry.reloadAgain = false;
+    // A decoder may be reading the entry; finish() drops it then
+    if (entry.status != TEXTURE_PENDING) drop(entry);
+}
+
+// Frees the layer and texels of a released entry
+void TextureStreamer::drop(Entry& entry) {
+    if (entry.layer >= 0 && entry.layer < (int)layerUsed.size()) layerUsed[entry.layer] = false;
+    entry.layer = entry.uploadLayer = -1;
+    entry.path.clear();
+    entry.status = entry.previousStatus = TEXTURE_FAILED;
+    entry.texels = Texels();
+    entry.level = -1;
+    entry.rowsUploaded = 0;
+}
+
+bool TextureStreamer::reload(const std::string& path) {
+    bool found = false;
+    for (auto& entry : entries) {
+        bool source = entry->path == path;
+        if (!source && bakedTexturePath(entry->path) != path) continue;
+        found = true;
+        // A decoder may be reading the entry, so a texture still loading only takes a note
+        if (entry->status == TEXTURE_PENDING) {
+            entry->reloadAgain = true;
+            entry->againFromSource = source;
+        }
+        else {
+            entry->preferSource = source;
+            restart(*entry);
+        }
+    }
+    return found;
+}
+
+void TextureStreamer::restart(Entry& entry) {
+    entry.previousStatus = entry.status;
+    entry.status = TEXTURE_PENDING;
+    int spare = takeLayer();
+    entry.uploadLayer = spare >= 0 ? spare : entry.layer;
+    queueDecode(entry);
+}
+
+void TextureStreamer::update(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [start] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    if (!array) return;
+
+    std::deque<Entry*> picked;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        picked.swap(decoded);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    for (Entry* entry : picked) {
+        if (entry->released || entry->incoming.baked.levels.empty()) {
+            entry->incoming = Texels();
+            finish(*entry, TEXTURE_FAILED);
+            continue;
+        }
+        // A reload brings back the levels the texture had; a new one the start levels
+        entry->texels = std::move(entry->incoming);
+        entry->incoming = Texels();
+        entry->loadTop = std::max(allocatedBase, entry->previousStatus == TEXTURE_RESIDENT ? entry->top : startLevel);
+        entry->level = levelCount - 1;
+        entry->rowsUploaded = 0;
+        uploads.push_back(entry);
+    }
+
+    while (!uploads.empty()) {
+        Entry& entry = *uploads.front();
+        if (entry.released) {
+            finish(entry, TEXTURE_FAILED);
+            uploads.pop_front();
+            continue;
+        }
+        // Freeing a level can leave nothing more to upload
+        if (entry.level >= entry.loadTop && uploadStep(entry, entry.uploadLayer)) {
+            // Over a placeholder, a finished level only adds detail
+            if (entry.uploadLayer == entry.layer && entry.previousStatus != TEXTURE_RESIDENT) entry.top = entry.level;
+            --entry.level;
+        }
+        if (entry.level < entry.loadTop) {
+            entry.level = -1;
+            entry.rowsUploaded = 0;
+            entry.top = entry.loadTop;
+            finish(entry, TEXTURE_RESIDENT);
+            uploads.pop_front();
+        }
+        if (elapsed() >= budgetMs) break;
+    }
+
+    updateLevels();
+    while (elapsed() < budgetMs) {
+        Entry* entry = nextRefinement();
+        if (!entry) break;
+        entry->level = entry->top - 1;
+        if (uploadStep(*entry, entry->layer)) {
+            entry->top = entry->level;
+            entry->level = -1;
+        }
+    }
+    for (auto& entry : entries) {
+        entry->wanted = levelCount;
+    }
+}
+
+void TextureStreamer::request(TextureHandle handle, int level) {
+    if (handle < 0 || handle >= (int)entries.size()) return;
+    Entry& entry = *entries[handle];
+    entry.wanted = std::min(entry.wanted, std::max(0, std::min(level, levelCount - 1)));
+}
+
+int TextureStreamer::levelFor(float texelsPerPixel) {
+    return texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+}
+
+float TextureStreamer::minLevel(TextureHandle handle) const {
+    if (handle < 0 || handle >= (int)entries.size()) return 0.0f;
+    return (float)std::max(0, entries[handle]->top - allocatedBase);
+}
+
+// The resident texture furthest from the level it wants, if any can get closer
+TextureStreamer::Entry* TextureStreamer::nextRefinement() {
+    Entry* next = nullptr;
+    int nextGap = 0;
+    for (auto& entry : entries) {
+        if (entry->status != TEXTURE_RESIDENT) continue;
+        int gap = entry->top - std::max(entry->wanted, allocatedBase);
+        if (gap > nextGap) {
+            next = entry.get();
+            nextGap = gap;
+        }
+    }
+    return next;
+}
+
+// Moves the array's base level one step towards the finest level wanted
+void TextureStreamer::updateLevels() {
+    int wanted = levelCount - 1;
+    for (auto& entry : entries) {
+        if (entry->status != TEXTURE_FAILED) wanted = std::min(wanted, entry->wanted);
+    }
+    int budgetBase = 0;
+    while (budgetBase < startLevel && arrayBytes(budgetBase) > memoryBudget) ++budgetBase;
+    int target = std::max(std::min(wanted, startLevel), budgetBase);
+
+    if (target < allocatedBase) {
+        unwantedFrames = 0;
+        allocateLevel(allocatedBase - 1);
+    }
+    else if (target > allocatedBase) {
+        if (arrayBytes(allocatedBase) > memoryBudget || ++unwantedFrames >= freeAfterFrames) {
+            unwantedFrames = 0;
+            freeLevel(allocatedBase);
+        }
+    }
+    else {
+        unwantedFrames = 0;
+    }
+}
+
+// Gives level storage in every layer, showing no layer until uploaded to.
+// Layers clamp sampling to their finest uploaded level, so the new level's
+// contents are never seen and RGBA8 storage is left undefined.
+void TextureStreamer::allocateLevel(int level) {
+    int size = std::max(1, layerSize >> level);
+    size_t bytes = bakedLevelBytes(format, size, size) * layerCount;
+    if (format == BAKED_RGBA8) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, layerCount, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    else {
+        // Real texels, so compressed levels never depend on the driver
+        // accepting a null pointer; built once at the largest size yet
+        if (emptyLevel.size() < bytes) {
+            std::vector<unsigned char> unit;
+            bakedFlatUnit(format, emptyColor, unit);
+            repeatUnit(unit, bytes, emptyLevel);
+        }
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, glFormat(format), size, size, layerCount, 0,
+            (GLsizei)bytes, emptyLevel.data());
+    }
+    allocatedBase = level;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, allocatedBase);
+}
+
+// Frees the base level; layers sampling it drop to the next one
+void TextureStreamer::freeLevel(int level) {
+    allocatedBase = level + 1;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, allocatedBase);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    for (auto& entry : entries) {
+        entry->top = std::max(entry->top, allocatedBase);
+        entry->loadTop = std::max(entry->loadTop, allocatedBase);
+        // A refinement in progress was of the freed level
+        if (entry->status != TEXTURE_PENDING) {
+            entry->level = -1;
+            entry->rowsUploaded = 0;
+        }
+    }
+}
+
+size_t TextureStreamer::arrayBytes(int base) const {
+    size_t bytes = 0;
+    for (int level = base; level < levelCount; ++level) {
+        int size = std::max(1, layerSize >> level);
+        bytes += bakedLevelBytes(format, size, size);
+    }
+    return bytes * layerCount;
+}
+
+int TextureStreamer::layer(TextureHandle handle) const {
+    if (handle < 0 || handle >= (int)entries.size()) return -1;
+    return entries[handle]->layer;
+}
+
+TextureStatus TextureStreamer::status(TextureHandle handle) const {
+    if (handle < 0 || handle >= (int)entries.size()) return TEXTURE_FAILED;
+    return entries[handle]->status;
+}
+
+int TextureStreamer::pendingCount() const {
+    return pending;
+}
+
+void TextureStreamer::shutdown() {
+    stopThreads();
+    uploads.clear();
+    for (auto& entry : entries) {
+        entry->texels = Texels();
+        entry->incoming = Texels();
+    }
+    if (array) glDeleteTextures(1, &array);
+    array = 0;
+    emptyLevel = std::vector<unsigned char>();
+    layerUsed.clear();
+    pending = 0;
+}
+
+int TextureStreamer::takeLayer() {
+    auto free = std::find(layerUsed.begin(), layerUsed.end(), false);
+    if (free == layerUsed.end()) return -1;
+    *free = true;
+    return (int)(free - layerUsed.begin());
+}
+
+// Every allocated level of the layer in a flat colour
+void TextureStreamer::fillLayer(int layer, const unsigned char rgba[4]) {
+    std::vector<unsigned char> unit, texels;
+    bakedFlatUnit(format, rgba, unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    for (int level = allocatedBase; level < levelCount; ++level) {
+        int size = std::max(1, layerSize >> level);
+        repeatUnit(unit, bakedLevelBytes(format, size, size), texels);
+        uploadRows(format, level, layer, size, 0, size, texels.data());
+    }
+}
+
+void TextureStreamer::queueDecode(Entry& entry) {
+    entry.level = -1;
+    entry.rowsUploaded = 0;
+    ++pending;
+    if (decoders.empty()) startThreads();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        toDecode.push_back(&entry);
+    }
+    wake.notify_one();
+}
+
+void TextureStreamer::createArray() {
+    format = GLEW_EXT_texture_compression_s3tc ? BAKED_BC1 : BAKED_RGBA8;
+    layerUsed.assign(layerCount, false);
+    levelCount = 1;
+    while ((layerSize >> (levelCount - 1)) > 1) ++levelCount;
+
+    glGenTextures(1, &array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    // Only the start levels get storage; finer ones come when wanted
+    startLevel = 0;
+    while ((layerSize >> startLevel) > startSize && startLevel < levelCount - 1) ++startLevel;
+    for (int level = levelCount - 1; level >= startLevel; --level) {
+        allocateLevel(level);
+    }
+}
+
+void TextureStreamer::startThreads() {
+    stopping = false;
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        decoders.emplace_back(&TextureStreamer::decodeLoop, this);
+    }
+}
+
+void TextureStreamer::stopThreads() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        toDecode.clear();
+    }
+    wake.notify_all();
+    for (auto& decoder : decoders) {
+        decoder.join();
+    }
+    decoders.clear();
+    // Anything decoded but not picked up yet is freed with its entry
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded.clear();
+}
+
+void TextureStreamer::decodeLoop() {
+    for (;;) {
+        Entry* entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !toDecode.empty(); });
+            if (stopping) return;
+            entry = toDecode.front();
+            toDecode.pop_front();
+        }
+        decode(*entry);
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(entry);
+    }
+}
+
+// Produces the layer's mip chain in the array's format. Runs on a decoder
+// thread; the GL thread does not look at the entry until it is queued.
+void TextureStreamer::decode(Entry& entry) {
+    BakedTexture baked;
+    const unsigned char* bakedData;
+    if (format == BAKED_BC1 && !entry.preferSource && readBaked(entry.path, baked, bakedData) && baked.format == BAKED_BC1) {
+        for (size_t level = 0; level < baked.levels.size(); ++level) {
+            // The chain must go on down to 1 x 1, every level the array has
+            if (baked.levels[level].width == layerSize && baked.levels[level].height == layerSize
+                && baked.levels.size() - level >= (size_t)levelCount) {
+                Texels& texels = entry.incoming;
+                texels.width = baked.width;
+                texels.height = baked.height;
+                texels.firstLevel = (int)level;
+                texels.baked = std::move(baked);
+                texels.data = bakedData ? bakedData : texels.baked.data.data();
+                return;
+            }
+        }
+    }
+
+    int width, height, channels;
+    AssetView view = pack ? pack->find(entry.path) : AssetView();
+    unsigned char* pixels = view ? stbi_load_from_memory(view.data, (int)view.size, &width, &height, &channels, 4)
+        : stbi_load(entry.path.c_str(), &width, &height, &channels, 4);
+    if (!pixels) return;
+
+    // Layers all share one size, so the image is filtered to it first
+    std::vector<unsigned char> resized;
+    const unsigned char* source = pixels;
+    bool ok = true;
+    if (width != layerSize || height != layerSize) {
+        ok = resizeSrgb(pixels, width, height, layerSize, layerSize, resized);
+        source = resized.data();
+    }
+    Texels& texels = entry.incoming;
+    if (ok && buildMipChain(source, layerSize, layerSize, format, texels.baked)) {
+        texels.width = width;
+        texels.height = height;
+        texels.firstLevel = 0;
+        texels.data = texels.baked.data.data();
+    }
+    else {
+        texels = Texels();
+    }
+    stbi_image_free(pixels);
+}
+
+// The baked file for an image, parsed in place when it is in the pack (data
+// points into the mapping) and read into baked.data otherwise (data is null).
+bool TextureStreamer::readBaked(const std::string& path, BakedTexture& baked, const unsigned char*& data) const {
+    std::string bakedPath = bakedTexturePath(path);
+    AssetView view = pack ? pack->find(bakedPath) : AssetView();
+    if (view) {
+        data = view.data;
+        return parseBakedTexture(view.data, view.size, baked);
+    }
+    data = nullptr;
+    return readBakedTexture(bakedPath, baked);
+}
+
+// Uploads one strip of rows of the entry's current level to layer. Levels
+// go from the smallest up; update() lets a new texture be sampled down to
+// each level as it is done, so it sharpens as it loads, while a reload is
+// shown only once complete. Returns true when the level is done.
+bool TextureStreamer::uploadStep(Entry& entry, int layer) {
+    const Texels& texels = entry.texels;
+    const BakedLevel& level = texels.baked.levels[texels.firstLevel + entry.level];
+    int unit = unitRows(format);
+    size_t unitBytes = bakedLevelBytes(format, level.width, unit);
+    int rows = std::max(1, (int)(stripBytes / unitBytes)) * unit;
+    rows = std::min(rows, level.height - entry.rowsUploaded);
+    uploadRows(format, entry.level, layer, level.width, entry.rowsUploaded, rows,
+        texels.data + level.offset + bakedLevelBytes(format, level.width, entry.rowsUploaded));
+    entry.rowsUploaded += rows;
+    if (entry.rowsUploaded < level.height) return false;
+    entry.rowsUploaded = 0;
+    return true;
+}
+
+void TextureStreamer::finish(Entry& entry, TextureStatus status) {
+    --pending;
+    if (entry.released) {
+        if (entry.uploadLayer != entry.layer) layerUsed[entry.uploadLayer] = false;
+        drop(entry);
+        return;
+    }
+    if (onFinished) onFinished(entry.path, status, entry.texels.width, entry.texels.height);
+
+    // A reload shows its layer only once complete; a failed one keeps the old texels
+    if (entry.uploadLayer != entry.layer) {
+        int unused = status == TEXTURE_RESIDENT ? entry.layer : entry.uploadLayer;
+        layerUsed[unused] = false;
+        if (status == TEXTURE_RESIDENT) entry.layer = entry.uploadLayer;
+        entry.uploadLayer = entry.layer;
+    }
+    if (status == TEXTURE_FAILED && entry.previousStatus == TEXTURE_RESIDENT) status = TEXTURE_RESIDENT;
+    entry.status = status;
+    entry.previousStatus = status;
+
+    if (entry.reloadAgain) {
+        entry.reloadAgain = false;
+        entry.preferSource = entry.againFromSource;
+        restart(entry);
+    }
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include "AssetPack.h"
+#include "TextureBaker.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Index of a texture requested from a TextureStreamer.
+typedef int TextureHandle;
+
+enum TextureStatus {
+    TEXTURE_PENDING,    // the layer shows its placeholder colour
+    TEXTURE_RESIDENT,
+    TEXTURE_FAILED      // the placeholder colour stays for good
+};
+
+// Scene textures, streamed into the layers of one GL_TEXTURE_2D_ARRAY so
+// the whole scene draws with a single texture binding and picks a layer
+// per draw. Every layer is layerSize x layerSize with a mip chain, in BC1
+// when the GL has S3TC and RGBA8 otherwise.
+//
+// Loading never stalls the frame. A baked file (see TextureBaker.h) next
+// to the image is read when it is BC1 and has a level of the layer size;
+// otherwise the image is decoded with stb_image, resized to the layer and
+// mipped (and compressed) on the decoder threads. The GL thread uploads
+// the result in update(), smallest level first and in strips of rows,
+// stopping once the frame's budget is spent. Until then the layer holds a
+// flat placeholder colour, so render code can use a handle from the first
+// frame and never checks whether loading is done.
+//
+// reload() decodes a texture again after its file changed. The new texels
+// go into a spare layer while the old ones stay on screen, and the handle
+// switches layers once every level is uploaded, so a texture is never seen
+// half old and half new. With no spare layer it is uploaded in place.
+//
+// Only levels of at most 128 x 128 are loaded at first. Render code says
+// each frame which level it needs for a texture (request()), from how many
+// texels fall on a pixel where it is drawn, and finer levels are streamed
+// in from the decoded chain, which stays in memory, as the camera gets
+// close. The array shares one size for all layers, so storage is held per
+// level: the finest level allocated (GL_TEXTURE_BASE_LEVEL) follows the
+// finest level any texture wants, within the memory budget, and a level no
+// texture wanted for a while is freed again. A layer is sampled no finer
+// than its finest uploaded level, minLevel(), which shaders clamp to.
+//
+// With an asset pack set, both are looked up in the pack first and baked
+// levels are uploaded straight from its mapping; anything the pack lacks
+// comes from loose files.
+//
+// Everything except the decoding runs on the GL thread: load(), update()
+// and shutdown() need the context current.
+class TextureStreamer {
+public:
+    // Called from update() once per texture when it becomes resident or
+    // fails to load.
+    typedef std::function<void(const std::string& path, TextureStatus status, int width, int height)> FinishedFn;
+
+    TextureStreamer(int layerSize = 1024, int layerCount = 8, unsigned int decodeThreads = 2);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Queues path for the next free layer and fills that layer with the
+    // placeholder colour. Returns -1 when every layer is taken.
+    TextureHandle load(const char* path, unsigned char r, unsigned char g, unsigned char b);
+
+    // Gives the handle's layer back for later loads; a texture still
+    // loading keeps it until the decode and upload finish. The handle is
+    // invalid afterwards and may be returned by a later load().
+    void release(TextureHandle handle);
+
+    // Queues every texture loaded from path, or whose baked file is path,
+    // to be decoded again. A texture still loading is redone when it
+    // finishes. A reload that fails keeps the old texels. Returns false
+    // when no texture uses the path.
+    bool reload(const std::string& path);
+
+    // Uploads decoded texels for at most budgetMs milliseconds, always
+    // making some progress on textures still loading, then finer levels of
+    // the requested textures with what is left. Requests are cleared.
+    void update(double budgetMs);
+
+    // Asks for level (0 is layerSize) of the handle's texture for this
+    // frame; the finest request since the last update() counts.
+    void request(TextureHandle handle, int level);
+    // The level a texture needs when texelsPerPixel of its layerSize texels
+    // cover one pixel of the screen.
+    static int levelFor(float texelsPerPixel);
+    // The finest level to sample for the handle, relative to the array's
+    // base level, as textureLod() takes it.
+    float minLevel(TextureHandle handle) const;
+    // Array storage at most this many bytes, except that levels up to
+    // 128 x 128 are always kept.
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+    size_t residentBytes() const { return arrayBytes(allocatedBase); }
+
+    // The texture array to bind to GL_TEXTURE_2D_ARRAY, 0 before the first load.
+    unsigned int arrayTexture() const { return array; }
+    // Width and height of level 0 of every layer.
+    int textureSize() const { return layerSize; }
+    // Layer to sample for the handle, -1 for an invalid handle.
+    int layer(TextureHandle handle) const;
+    TextureStatus status(TextureHandle handle) const;
+    // Textures requested but not yet resident or failed.
+    int pendingCount() const;
+
+    void setFinishedCallback(const FinishedFn& fn) { onFinished = fn; }
+    // Set before the first load(); the pack must stay open until shutdown().
+    void setAssetPack(const AssetPack* assetPack) { pack = assetPack; }
+
+    // Stops the decoders and deletes the array. Call before the context is
+    // destroyed; the destructor only stops the threads.
+    void shutdown();
+
+private:
+    struct Texels {
+        BakedTexture baked;             // in the array's format; no levels = failed
+        const unsigned char* data = nullptr;    // baked.data or a pack view
+        int firstLevel = 0;             // baked level that matches the layer size
+        int width = 0;                  // of the source image
+        int height = 0;
+    };
+
+    struct Entry {
+        std::string path;
+        int layer = 0;                  // layer sampled
+        int uploadLayer = 0;            // layer being filled; differs while reloading
+        TextureStatus status = TEXTURE_PENDING;
+        TextureStatus previousStatus = TEXTURE_PENDING;
+        bool reloadAgain = false;       // changed again while loading
+        bool againFromSource = false;
+        bool preferSource = false;      // the image changed, its baked file may be stale
+        bool released = false;          // layer goes back once nothing is loading
+        // Written by a decoder, read by the GL thread once queued as decoded
+        Texels incoming;
+        // GL thread only
+        Texels texels;                  // the chain levels are uploaded from
+        int top = 0;                    // finest level uploaded to layer
+        int loadTop = 0;                // finest level the current load uploads
+        int wanted = 0;                 // finest level requested this frame
+        int level = -1;                 // array level being uploaded
+        int rowsUploaded = 0;
+    };
+
+    void createArray();
+    int takeLayer();
+    void fillLayer(int layer, const unsigned char rgba[4]);
+    void queueDecode(Entry& entry);
+    void restart(Entry& entry);
+    void startThreads();
+    void stopThreads();
+    void decodeLoop();
+    void decode(Entry& entry);
+    bool readBaked(const std::string& path, BakedTexture& baked, const unsigned char*& data) const;
+    bool uploadStep(Entry& entry, int layer);
+    void finish(Entry& entry, TextureStatus status);
+    void drop(Entry& entry);
+    Entry* nextRefinement();
+    void updateLevels();
+    void allocateLevel(int level);
+    void freeLevel(int level);
+    size_t arrayBytes(int base) const;
+
+    const int layerSize;
+    const int layerCount;
+    int levelCount = 0;
+    int startLevel = 0;                 // the first level of at most startSize
+    int allocatedBase = 0;              // levels below it have no storage
+    size_t memoryBudget = 64u << 20;
+    int unwantedFrames = 0;             // frames allocatedBase has gone unwanted
+    int format = BAKED_RGBA8;           // decided when the array is created
+    unsigned int array = 0;
+    std::vector<bool> layerUsed;
+    std::vector<unsigned char> emptyLevel;  // emptyColor blocks for allocateLevel()
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::deque<Entry*> uploads;             // GL thread only
+    FinishedFn onFinished;
+    const AssetPack* pack = nullptr;
+    int pending = 0;
+
+    // Shared with the decoders
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Entry*> toDecode;
+    std::deque<Entry*> decoded;
+    bool stopping = false;
+
+    unsigned int threadCount;
+    std::vector<std::thread> decoders;
+};
@@ -0,0 +1,58 @@
+#include "DetMath.h"
+#include "TireModel.h"
+#include <algorithm>
+
+using namespace simd;
+
+namespace {
+    // Combined slip past this is treated as a full slide.
+    const float tableMaxSlip = 2.0f;
+
+    // Built with the deterministic sin/atan so every platform gets the same table.
+    float magicFormula(const TireCurve& curve, float slip) {
+        float bs = curve.b * slip;
+        return curve.d * detSin(curve.c * detAtan(bs - curve.e * (bs - detAtan(bs))));
+    }
+}
+
+TireTable::TireTable(const TireCurve& curve) {
+    maxSlip = tableMaxSlip;
+    invStep = size / maxSlip;
+
+    // The secant at zero slip is the cornering stiffness B * C * D.
+    values[0] = curve.b * curve.c * curve.d;
+    for (int i = 1; i <= size; ++i) {
+        float slip = i / invStep;
+        values[i] = magicFormula(curve, slip) / slip;
+    }
+    endForce = magicFormula(curve, maxSlip);
+}
+
+F4 TireTable::secant(F4 slip) const {
+    F4 x = vmin(slip, F4(maxSlip)) * F4(invStep);
+    int index[4];
+    truncToInt(x, index);
+
+    float lo[4], hi[4];
+    for (int i = 0; i < 4; ++i) {
+        index[i] = std::min(index[i], size - 1);
+        lo[i] = values[index[i]];
+        hi[i] = values[index[i] + 1];
+    }
+    F4 frac = x - toFloat(index);
+    F4 a = load(lo);
+    F4 inside = a + (load(hi) - a) * frac;
+
+    F4 beyond = cmpGt(slip, F4(maxSlip));
+    return select(beyond, F4(endForce) / vmax(slip, F4(maxSlip)), inside);
+}
+
+const TireTable& longitudinalTireTable() {
+    static const TireTable table(longitudinalTireCurve);
+    return table;
+}
+
+const TireTable& lateralTireTable() {
+    static const TireTable table(lateralTireCurve);
+    return table;
+}
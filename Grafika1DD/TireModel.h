@@ -0,0 +1,38 @@
+#pragma once
+#include "Simd.h"
+
+// Pacejka magic formula: F(s) = D sin(C atan(B s - E (B s - atan(B s)))),
+// normalised so D is the peak force as a fraction of load * grip.
+struct TireCurve {
+    float b, c, d, e;
+};
+
+const TireCurve longitudinalTireCurve = { 10.0f, 1.9f, 1.0f, 0.97f };
+const TireCurve lateralTireCurve = { 8.0f, 1.4f, 0.95f, 0.6f };
+
+// One curve sampled as its secant F(s) / s over [0, maxSlip], so combined
+// slip becomes force = load * grip * secant(|slip|) * slip per direction.
+// 257 floats per curve, small enough to stay in L1 next to the car data.
+class TireTable {
+public:
+    static const int size = 256;
+
+    explicit TireTable(const TireCurve& curve);
+
+    // Secant at four combined slip magnitudes (>= 0) by linear interpolation.
+    // Past maxSlip the force holds its last value.
+    simd::F4 secant(simd::F4 slip) const;
+
+    // Slope at zero slip (B * C * D), the stiffest the curve gets.
+    float zeroSlipStiffness() const { return values[0]; }
+
+private:
+    float values[size + 1];
+    float maxSlip;
+    float invStep;
+    float endForce;
+};
+
+// Process-wide tables, built on first use.
+const TireTable& longitudinalTireTable();
+const TireTable& lateralTireTable();
@@ -0,0 +1,17 @@
+#pragma once
+
+// Dimensions of the track drawn by renderTrack (before trackRotation).
+// The driving surface spans x in [-trackHalfWidth, trackHalfWidth] and
+// z in [-trackHalfLength, trackHalfLength]; a barrier runs along each side.
+const float trackHalfWidth = 10.0f;
+const float trackHalfLength = 20.0f;
+const float barrierOffset = 11.0f;
+const float barrierThickness = 0.5f;
+const float barrierHeight = 1.0f;
+const float barrierLength = 42.0f;
+
+// Kerbs run along the inside of every edge of the driving surface; gravel
+// run-off surrounds it, reaching past the barriers and beyond both ends.
+const float kerbWidth = 0.75f;
+const float gravelWidth = 2.0f;
+const float gravelLength = 5.0f;
@@ -0,0 +1,185 @@
+#include "DetMath.h"
+#include "TrackProgress.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const float cellSize = 1.0f;
+    // Grid reaches this far past the lanes; cars further out fall back to
+    // testing every segment
+    const float gridMargin = 10.0f;
+}
+
+void TrackIndex::build(const RacingLine& line) {
+    const int n = (int)line.centerX.size();
+    x = line.centerX;
+    z = line.centerZ;
+    laneHalfWidth = line.halfWidth;
+
+    start.resize(n);
+    float total = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        start[i] = total;
+        int next = (i + 1) % n;
+        float dx = x[next] - x[i], dz = z[next] - z[i];
+        total += detSqrt(dx * dx + dz * dz);
+    }
+    lapLength = total;
+
+    cellStart.assign(1, 0);
+    cellSegments.clear();
+    if (n == 0) return;
+
+    glm::vec2 lo(x[0], z[0]), hi = lo;
+    for (int i = 0; i < n; ++i) {
+        lo = glm::min(lo, glm::vec2(x[i], z[i]));
+        hi = glm::max(hi, glm::vec2(x[i], z[i]));
+    }
+    float pad = laneHalfWidth + gridMargin;
+    cell = cellSize;
+    invCell = 1.0f / cell;
+    corner = lo - glm::vec2(pad);
+    cellsX = (int)((hi.x - lo.x + 2.0f * pad) * invCell) + 1;
+    cellsZ = (int)((hi.y - lo.y + 2.0f * pad) * invCell) + 1;
+
+    // A segment can be nearest to some point of the cell only if it is
+    // within the nearest distance from the cell centre plus the cell's
+    // diameter
+    const float diameter = cell * 1.4142136f;
+    std::vector<float> distances(n);
+    cellStart.resize((size_t)cellsX * cellsZ + 1);
+    for (int j = 0; j < cellsZ; ++j) {
+        for (int i = 0; i < cellsX; ++i) {
+            glm::vec2 center = corner + (glm::vec2((float)i, (float)j) + 0.5f) * cell;
+            float nearest = 3.0e38f;
+            for (int s = 0; s < n; ++s) {
+                float t;
+                distances[s] = detSqrt(distanceSq(center, s, t));
+                nearest = std::min(nearest, distances[s]);
+            }
+            for (int s = 0; s < n; ++s) {
+                if (distances[s] <= nearest + diameter) cellSegments.push_back((uint16_t)s);
+            }
+            cellStart[j * cellsX + i + 1] = (int)cellSegments.size();
+        }
+    }
+}
+
+float TrackIndex::distanceSq(const glm::vec2& point, int segment, float& t) const {
+    int next = segment + 1 == (int)x.size() ? 0 : segment + 1;
+    glm::vec2 a(x[segment], z[segment]), b(x[next], z[next]);
+    glm::vec2 ab = b - a;
+    t = std::max(0.0f, std::min(glm::dot(point - a, ab) / std::max(glm::dot(ab, ab), 1e-12f), 1.0f));
+    glm::vec2 d = point - (a + ab * t);
+    return glm::dot(d, d);
+}
+
+TrackLocation TrackIndex::locate(const glm::vec2& point, int hint) const {
+    const int n = (int)x.size();
+    TrackLocation location{ 0, 0.0f, 0.0f };
+    if (n == 0) return location;
+
+    int best = -1;
+    float bestSq = 3.0e38f, bestT = 0.0f;
+    if (hint >= 0 && hint < n) {
+        // Walk downhill from last tick's segment
+        best = hint;
+        bestSq = distanceSq(point, hint, bestT);
+        for (int steps = 0; steps < n; ++steps) {
+            int forward = best + 1 == n ? 0 : best + 1;
+            int back = best == 0 ? n - 1 : best - 1;
+            float forwardT, backT;
+            float forwardSq = distanceSq(point, forward, forwardT);
+            float backSq = distanceSq(point, back, backT);
+            if (forwardSq < bestSq && forwardSq <= backSq) {
+                best = forward;
+                bestSq = forwardSq;
+                bestT = forwardT;
+            }
+            else if (backSq < bestSq) {
+                best = back;
+                bestSq = backSq;
+                bestT = backT;
+            }
+            else break;
+        }
+        // Inside the lane the local minimum is the nearest segment overall
+        if (bestSq > laneHalfWidth * laneHalfWidth) best = -1;
+    }
+
+    if (best < 0) {
+        int i = (int)((point.x - corner.x) * invCell), j = (int)((point.y - corner.y) * invCell);
+        bool inGrid = point.x >= corner.x && point.y >= corner.y && i < cellsX && j < cellsZ;
+        int first = inGrid ? cellStart[j * cellsX + i] : 0;
+        int last = inGrid ? cellStart[j * cellsX + i + 1] : n;
+        bestSq = 3.0e38f;
+        for (int k = first; k < last; ++k) {
+            int segment = inGrid ? cellSegments[k] : k;
+            float t;
+            float d = distanceSq(point, segment, t);
+            if (d < bestSq) {
+                best = segment;
+                bestSq = d;
+                bestT = t;
+            }
+        }
+    }
+
+    int next = best + 1 == n ? 0 : best + 1;
+    glm::vec2 a(x[best], z[best]), b(x[next], z[next]);
+    glm::vec2 ab = b - a;
+    float segmentLength = detSqrt(glm::dot(ab, ab));
+    glm::vec2 along = segmentLength > 0.0f ? ab / segmentLength : glm::vec2(0.0f, 1.0f);
+    glm::vec2 d = point - a;
+
+    location.segment = best;
+    location.distance = start[best] + bestT * segmentLength;
+    if (location.distance >= lapLength) location.distance -= lapLength;
+    // Left of travel is (dz, -dx) for a direction (dx, dz)
+    location.offset = d.x * along.y - d.y * along.x;
+    return location;
+}
+
+int TrackIndex::sectorAt(float distance) const {
+    int sector = (int)(distance / lapLength * trackSectorCount);
+    return std::max(0, std::min(sector, trackSectorCount - 1));
+}
+
+void updateTrackProgress(const TrackIndex& track, CarState& car, float deltaTime) {
+    if (track.empty()) return;
+
+    TrackLocation location = track.locate(glm::vec2(car.pos.x, car.pos.z), car.trackSegment);
+    car.trackSegment = location.segment;
+    car.trackDistance = location.distance;
+    car.trackOffset = location.offset;
+    car.lapTime += deltaTime;
+
+    int sector = track.sectorAt(location.distance);
+    if (car.trackSector < 0) {
+        // First fix: the lap until the start line is an untimed out lap
+        car.trackSector = sector;
+        car.sectorStartTime = car.lapTime;
+        return;
+    }
+    if (sector != (car.trackSector + 1) % trackSectorCount) return;
+
+    car.lastSectorTime = car.lapTime - car.sectorStartTime;
+    if (sector == 0) {
+        if (car.lap > 0) {
+            car.lastLapTime = car.lapTime;
+            if (car.bestLapTime == 0.0f || car.lapTime < car.bestLapTime) car.bestLapTime = car.lapTime;
+        }
+        ++car.lap;
+        car.lapTime = 0.0f;
+    }
+    car.trackSector = sector;
+    car.sectorStartTime = car.lapTime;
+}
+
+float raceDistance(const TrackIndex& track, const CarState& car) {
+    return car.lap * track.length() + car.trackDistance;
+}
+
+bool outsideTrackLimits(const TrackIndex& track, const CarState& car) {
+    return car.trackSegment >= 0 && std::abs(car.trackOffset) > track.halfWidth();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "CarPhysics.h"
+#include "RacingLine.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// The lap is split into this many sectors of equal centreline length; the
+// start line is the beginning of sector 0.
+const int trackSectorCount = 3;
+
+// Where a point lies relative to the track centreline.
+struct TrackLocation {
+    int segment;        // from centreline point segment to segment + 1
+    float distance;     // along the centreline from the start line, [0, length)
+    float offset;       // sideways from the centreline, positive = left
+};
+
+// Centreline of the racing line as a closed chain of segments, with a
+// uniform grid over it. Each grid cell lists only the segments that can be
+// the nearest one for some point inside the cell, so a lookup tests a few
+// segments instead of the whole lap. A lookup that starts from last tick's
+// segment walks to the neighbouring segments and skips the grid entirely
+// while the car stays inside its lane.
+class TrackIndex {
+public:
+    void build(const RacingLine& line);
+
+    bool empty() const { return x.empty(); }
+    int segmentCount() const { return (int)x.size(); }
+    float length() const { return lapLength; }
+    float halfWidth() const { return laneHalfWidth; }
+
+    // hint is the segment found for the same car last tick, or -1.
+    TrackLocation locate(const glm::vec2& point, int hint) const;
+    int sectorAt(float distance) const;
+
+private:
+    float distanceSq(const glm::vec2& point, int segment, float& t) const;
+
+    std::vector<float> x, z;            // segment start points
+    std::vector<float> start;           // centreline distance at each start point
+    std::vector<int> cellStart;         // segments of cell c: cellSegments[cellStart[c] .. cellStart[c + 1])
+    std::vector<uint16_t> cellSegments;
+    glm::vec2 corner = glm::vec2(0.0f);
+    float cell = 1.0f;
+    float invCell = 1.0f;
+    int cellsX = 0;
+    int cellsZ = 0;
+    float lapLength = 0.0f;
+    float laneHalfWidth = 0.0f;
+};
+
+// Locates the car on the track and advances its lap and sector timing.
+// Sectors only count when entered in order, so driving backwards over the
+// start line or cutting across the infield does not complete a lap.
+void updateTrackProgress(const TrackIndex& track, CarState& car, float deltaTime);
+
+// Total centreline distance covered since the start, for ordering cars.
+float raceDistance(const TrackIndex& track, const CarState& car);
+
+// Track limits: the car's centre is outside its lane.
+bool outsideTrackLimits(const TrackIndex& track, const CarState& car);
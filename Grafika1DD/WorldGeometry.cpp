@@ -0,0 +1,116 @@
+#include "DetMath.h"
+#include "WorldGeometry.h"
+#include "Scene.h"
+#include "Terrain.h"
+#include "TrackLayout.h"
+
+void buildStaticColliders(const Scene& scene, const EnvironmentState& env, std::vector<StaticBox>& boxes) {
+    boxes.clear();
+    boxes.reserve(scene.colliders.size());
+
+    // Track-space props rotate with the track around the origin
+    float s, c;
+    detSinCos(glm::radians(env.trackRotation), s, c);
+    for (const SceneCollider& collider : scene.colliders) {
+        if (collider.kind == noCollider) continue;
+        StaticBox box;
+        box.center = collider.center;
+        box.rotation = collider.yaw;
+        if (collider.space == SPACE_TRACK) {
+            // The z terms only when needed, so props on the track's centre
+            // line come out bit for bit as the barriers always have
+            box.center.x = collider.center.x * c;
+            box.center.z = -collider.center.x * s;
+            if (collider.center.z != 0.0f) {
+                box.center.x += collider.center.z * s;
+                box.center.z += collider.center.z * c;
+            }
+            box.rotation += env.trackRotation;
+        }
+        // Crowns sit above the cars; only trunks follow the tree size
+        box.halfExtents = collider.tag == TAG_TRUNK ? collider.halfExtents * env.treeSize : collider.halfExtents;
+        box.kind = (ColliderKind)collider.kind;
+        boxes.push_back(box);
+    }
+}
+
+SurfaceId colliderSurface(ColliderKind kind) {
+    switch (kind) {
+    case COLLIDER_BARRIER: return SURFACE_BARRIER;
+    case COLLIDER_BUILDING: return SURFACE_BUILDING;
+    default: return SURFACE_TREE;
+    }
+}
+
+namespace {
+    void addQuad(std::vector<WorldTriangle>& triangles, const glm::vec3 corners[4], SurfaceId surface) {
+        WorldTriangle a = { { corners[0], corners[1], corners[2] }, surface };
+        WorldTriangle b = { { corners[0], corners[2], corners[3] }, surface };
+        triangles.push_back(a);
+        triangles.push_back(b);
+    }
+
+    // Horizontal rectangle at height y, rotated about the origin by rotation.
+    void addFlatRect(std::vector<WorldTriangle>& triangles, float halfX, float halfZ, float y,
+        float rotation, SurfaceId surface) {
+        float s, c;
+        detSinCos(glm::radians(rotation), s, c);
+        const float xs[4] = { -halfX, halfX, halfX, -halfX };
+        const float zs[4] = { -halfZ, -halfZ, halfZ, halfZ };
+        glm::vec3 corners[4];
+        for (int i = 0; i < 4; ++i) {
+            corners[i] = glm::vec3(xs[i] * c + zs[i] * s, y, -xs[i] * s + zs[i] * c);
+        }
+        addQuad(triangles, corners, surface);
+    }
+}
+
+void buildWorldTriangles(const EnvironmentState& env, const std::vector<StaticBox>& boxes,
+    const Terrain* terrain, std::vector<WorldTriangle>& triangles) {
+    triangles.clear();
+
+    if (terrain && !terrain->empty()) {
+        float cell = terrain->cellSize();
+        glm::vec2 origin = terrain->origin();
+        for (int j = 0; j < terrain->cellsZ(); ++j) {
+            for (int i = 0; i < terrain->cellsX(); ++i) {
+                glm::vec3 corners[4];
+                const int di[4] = { 0, 1, 1, 0 }, dj[4] = { 0, 0, 1, 1 };
+                for (int k = 0; k < 4; ++k) {
+                    corners[k] = glm::vec3(origin.x + (i + di[k]) * cell,
+                        terrain->vertex(i + di[k], j + dj[k]) - 0.05f,
+                        origin.y + (j + dj[k]) * cell);
+                }
+                addQuad(triangles, corners, SURFACE_GRASS);
+            }
+        }
+    }
+    else {
+        addFlatRect(triangles, 50.0f, 50.0f, -0.05f, 0.0f, SURFACE_GRASS);
+    }
+    addFlatRect(triangles, trackHalfWidth, trackHalfLength, 0.05f, env.trackRotation, SURFACE_ASPHALT);
+
+    for (const StaticBox& box : boxes) {
+        float s, c;
+        detSinCos(glm::radians(box.rotation), s, c);
+        glm::vec3 axisX(c, 0.0f, -s), axisY(0.0f, 1.0f, 0.0f), axisZ(s, 0.0f, c);
+        glm::vec3 ex = axisX * box.halfExtents.x;
+        glm::vec3 ey = axisY * box.halfExtents.y;
+        glm::vec3 ez = axisZ * box.halfExtents.z;
+
+        glm::vec3 p[8];
+        for (int i = 0; i < 8; ++i) {
+            p[i] = box.center + ((i & 1) ? ex : -ex) + ((i & 2) ? ey : -ey) + ((i & 4) ? ez : -ez);
+        }
+        const int faces[6][4] = {
+            { 0, 2, 3, 1 }, { 4, 5, 7, 6 },   // -Z, +Z
+            { 0, 4, 6, 2 }, { 1, 3, 7, 5 },   // -X, +X
+            { 0, 1, 5, 4 }, { 2, 6, 7, 3 }    // -Y, +Y
+        };
+        SurfaceId surface = colliderSurface(box.kind);
+        for (const auto& face : faces) {
+            glm::vec3 corners[4] = { p[face[0]], p[face[1]], p[face[2]], p[face[3]] };
+            addQuad(triangles, corners, surface);
+        }
+    }
+}
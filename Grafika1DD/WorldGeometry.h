@@ -0,0 +1,51 @@
+#pragma once
+#include "SimState.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct Scene;
+
+enum ColliderKind { COLLIDER_BARRIER, COLLIDER_BUILDING, COLLIDER_TREE };
+
+// Surface identifiers reported by sensors and baked into the surface grid.
+enum SurfaceId : uint8_t {
+    SURFACE_NONE = 0,
+    SURFACE_ASPHALT,
+    SURFACE_GRASS,
+    SURFACE_BARRIER,
+    SURFACE_BUILDING,
+    SURFACE_TREE,
+    SURFACE_KERB,
+    SURFACE_GRAVEL,
+    SURFACE_COUNT
+};
+
+// Box rotated about the vertical axis. rotation uses the car convention:
+// degrees, local +Z maps to (sin, cos) in world XZ.
+struct StaticBox {
+    glm::vec3 center;
+    glm::vec3 halfExtents;
+    float rotation;
+    ColliderKind kind;
+};
+
+SurfaceId colliderSurface(ColliderKind kind);
+
+// Generates the solid boxes of the scene's props (see Scene.h), in scene
+// order: track-space props turn with trackRotation, trunks scale with treeSize.
+// The renderer draws the same props, so what is drawn is what the cars hit.
+void buildStaticColliders(const Scene& scene, const EnvironmentState& env, std::vector<StaticBox>& boxes);
+
+struct WorldTriangle {
+    glm::vec3 v[3];
+    SurfaceId surface;
+};
+
+class Terrain;
+
+// Triangle soup of the static world for ray queries: the ground (terrain
+// cells, or a flat plane when terrain is null), the track surface and every
+// static collider box.
+void buildWorldTriangles(const EnvironmentState& env, const std::vector<StaticBox>& boxes,
+    const Terrain* terrain, std::vector<WorldTriangle>& triangles);